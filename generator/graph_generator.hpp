@@ -18,6 +18,9 @@
 
 #include <stdint.h>
 #include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 #include <algorithm>
 
@@ -31,6 +34,13 @@
 //-------------------------------------------------------------//
 // Edge List
 //-------------------------------------------------------------//
+// Backends:
+// - memory: the edges are stored in the heap.
+// - MPI-IO (filepath != NULL): the edges are written to the file and read back
+//   through the double buffer with MPI_File_iread_at.
+// - mapped (use_mmap == true): the edges are stored in a shared mapping of the file
+//   (filepath != NULL) or in an anonymous mapping with transparent huge pages.
+//   read() returns pointers into the mapping and the page cache spills the data to the file.
 
 template <typename EdgeType, int CHUNK_SIZE_>
 class EdgeListStorage {
@@ -38,8 +48,10 @@ public:
 	static const int CHUNK_SIZE = CHUNK_SIZE_;
 	typedef EdgeType edge_type;
 
-	EdgeListStorage(int64_t nLocalEdges, const char* filepath = NULL)
+	EdgeListStorage(int64_t nLocalEdges, const char* filepath = NULL, bool use_mmap = false)
 		: data_in_file_(false)
+		, mapped_(use_mmap)
+		, mapped_fd_(-1)
 		, edge_memory_(NULL)
 		, edge_file_(NULL)
 		, num_local_edges_(nLocalEdges)
@@ -61,6 +73,19 @@ public:
 			print_with_prefix("Allocating edge list memory (%"PRId64" * %d bytes)", edge_memory_size_*sizeof(EdgeType), mpi.size_2d);
 		}
 #endif
+		if(mapped_) {
+			if(filepath != NULL) {
+				sprintf(filepath_, "%s-%03d", filepath, mpi.rank_2d);
+				mapped_fd_ = open(filepath_, O_RDWR | O_CREAT | O_TRUNC, 0600);
+				if(mapped_fd_ == -1) {
+					throw_exception("Failed to open edge list file %s", filepath_);
+				}
+				unlink(filepath_); // the file is deleted on close
+			}
+			edge_memory_ = mapEdgeMemory(edge_memory_size_);
+			return ;
+		}
+
 		edge_memory_ = static_cast<EdgeType*>
 			(cache_aligned_xmalloc(edge_memory_size_*sizeof(EdgeType)));
 
@@ -85,6 +110,11 @@ public:
 
 	~EdgeListStorage()
 	{
+		if(mapped_) {
+			if(edge_memory_ != NULL) { munmap(edge_memory_, edge_memory_size_*sizeof(EdgeType)); edge_memory_ = NULL; }
+			if(mapped_fd_ != -1) { close(mapped_fd_); mapped_fd_ = -1; }
+			return ;
+		}
 		if(edge_memory_ != NULL) { free(edge_memory_); edge_memory_ = NULL; }
 		if(data_in_file_ == false) {
 		}
@@ -100,6 +130,10 @@ public:
 		assert (read_enabled_ == false);
 		read_enabled_ = true;
 		read_block_index_ = 0;
+		if(mapped_ && edge_filled_size_ > 0) {
+			// each pass reads the edges from the beginning to the end
+			madvise(edge_memory_, edge_filled_size_*sizeof(EdgeType), MADV_SEQUENTIAL);
+		}
 		if(data_in_file_) {
 			if(release_buffer) {
 				if(edge_memory_ != NULL) { free(edge_memory_); edge_memory_ = NULL; }
@@ -134,6 +168,10 @@ public:
 			if(edge_memory_ != NULL) {
 				*pp_buffer = edge_memory_ + read_offset;
 				++read_block_index_; read_offset += CHUNK_SIZE;
+				if(mapped_fd_ != -1 && edge_filled_size_ > read_offset) {
+					// let the kernel read the next chunk from the file while the user processes this chunk
+					madviseRange(read_offset, std::min<int64_t>(edge_filled_size_ - read_offset, CHUNK_SIZE), MADV_WILLNEED);
+				}
 			}
 			else {
 				MPI_Status read_result;
@@ -244,10 +282,54 @@ public:
 	}
 
 	int64_t num_local_edges() { return num_local_edges_; }
-	bool data_is_in_file() { return data_in_file_; }
+	bool data_is_in_file() { return data_in_file_ || mapped_fd_ != -1; }
+	bool is_mapped() { return mapped_; }
 	const char* get_filepath() { return filepath_; }
 
 private:
+	EdgeType* mapEdgeMemory(int64_t num_edges) {
+		const size_t length = num_edges*sizeof(EdgeType);
+		void* region;
+		if(mapped_fd_ != -1) {
+			if(ftruncate(mapped_fd_, length) != 0) {
+				throw_exception("Failed to extend edge list file %s", filepath_);
+			}
+			region = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, mapped_fd_, 0);
+		}
+		else {
+			region = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		}
+		if(region == MAP_FAILED) {
+			throw_exception("Failed to map edge list memory (%zu bytes)", length);
+		}
+#ifdef MADV_HUGEPAGE
+		if(mapped_fd_ == -1) madvise(region, length, MADV_HUGEPAGE);
+#endif
+		return static_cast<EdgeType*>(region);
+	}
+
+	void remapEdgeMemory(int64_t num_edges) {
+		const size_t old_length = edge_memory_size_*sizeof(EdgeType);
+		const size_t new_length = num_edges*sizeof(EdgeType);
+		if(mapped_fd_ != -1 && ftruncate(mapped_fd_, new_length) != 0) {
+			throw_exception("Failed to extend edge list file %s", filepath_);
+		}
+		void* region = mremap(edge_memory_, old_length, new_length, MREMAP_MAYMOVE);
+		if(region == MAP_FAILED) {
+			throw_exception("Failed to remap edge list memory (%zu bytes)", new_length);
+		}
+		edge_memory_ = static_cast<EdgeType*>(region);
+		edge_memory_size_ = num_edges;
+	}
+
+	// the range is extended to the page boundaries
+	void madviseRange(int64_t offset, int64_t count, int advice) {
+		const uintptr_t page_mask = sysconf(_SC_PAGESIZE) - 1;
+		uintptr_t begin = reinterpret_cast<uintptr_t>(edge_memory_ + offset) & ~page_mask;
+		uintptr_t end = reinterpret_cast<uintptr_t>(edge_memory_ + offset + count);
+		madvise(reinterpret_cast<void*>(begin), end - begin, advice);
+	}
+
 	void getReadBuffer(EdgeType** pp_buffer_to_read, EdgeType** pp_buffer_for_user) {
 		if(read_block_index_ % 2) {
 			*pp_buffer_to_read = read_buffer_ + CHUNK_SIZE;
@@ -260,7 +342,14 @@ private:
 	}
 
 	void writeInternal(EdgeType* edge_data, int count) {
-		if(edge_memory_ != NULL) {
+		if(mapped_) {
+			if(write_offset_ + count > edge_memory_size_) {
+				// grow by 1/8 to avoid remapping for each chunk
+				remapEdgeMemory(std::max<int64_t>(write_offset_ + count, edge_memory_size_ + edge_memory_size_ / 8));
+			}
+			memcpy(edge_memory_ + write_offset_, edge_data, count*sizeof(EdgeType));
+		}
+		else if(edge_memory_ != NULL) {
 			if(write_offset_ + count > edge_memory_size_) {
 				fprintf(IMD_OUT, "Warning: re-allocation edge memory buffer !!");
 				EdgeType* new_memory = static_cast<EdgeType*>(realloc(edge_memory_, (write_offset_ + count)*sizeof(EdgeType)));
@@ -294,6 +383,8 @@ private:
 	}
 
 	bool data_in_file_;
+	bool mapped_;
+	int mapped_fd_;
 	EdgeType* edge_memory_;
 	MPI_File edge_file_;
 	int64_t num_local_edges_;
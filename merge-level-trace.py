@@ -0,0 +1,154 @@
+#! /usr/bin/env python
+
+# Merges the per-level trace files written by runnable with LEVEL_TRACE=<prefix>
+# (<prefix>.<rank>.jsonl) into one timeline.
+# Each line of the output is one level of one BFS with the statistics over the processes.
+
+from optparse import OptionParser
+import glob
+import json
+import sys
+
+#####################################
+# reading trace files
+#####################################
+
+def readTraceFiles(prefix):
+    files = glob.glob(prefix + ".*.jsonl")
+    if len(files) == 0:
+        sys.exit("No trace files: " + prefix + ".*.jsonl")
+    headers = {}
+    levels = {}
+    for path in files:
+        with open(path) as f:
+            rank = None
+            for line in f:
+                line = line.strip()
+                if line == "":
+                    continue
+                rec = json.loads(line)
+                if rec["type"] == "header":
+                    rank = rec["rank"]
+                    headers[rank] = rec
+                elif rec["type"] == "level":
+                    levels.setdefault((rec["bfs"], rec["level"]), {})[rank] = rec
+    size = headers[min(headers)]["size"]
+    if len(headers) != size:
+        sys.stderr.write("Warning: %d of %d trace files are found\n" % (len(headers), size))
+    return levels
+
+#####################################
+# merging
+#####################################
+
+def statistics(values):
+    # returns (sum, avg, max, rank of max)
+    total = sum(values.values())
+    maxRank = max(values, key=lambda r: values[r])
+    return total, total / float(len(values)), values[maxRank], maxRank
+
+def imbalance(avg, maximum):
+    # percentage of the maximum over the average
+    if avg == 0:
+        return 0.0
+    return (maximum / avg - 1.0) * 100.0
+
+def mergeLevel(key, ranks):
+    first = ranks[min(ranks)]
+    out = {
+        "bfs": key[0], "root": first["root"], "level": key[1],
+        "dir": first["dir"], "format": first["format"],
+        "global_nq": first["global_nq"], "global_unvisited": first["global_unvisited"],
+        "begin": min(r["begin"] for r in ranks.values()),
+        "ranks": len(ranks),
+    }
+    for name in ["expand", "fold", "nq", "edge_relax", "a2a_send"]:
+        if name not in first:
+            continue
+        total, avg, maximum, maxRank = statistics(dict((rank, r[name]) for rank, r in ranks.items()))
+        if name not in ["expand", "fold"]:
+            out[name + "_sum"] = total
+        out[name + "_avg"] = avg
+        out[name + "_max"] = maximum
+        out[name + "_max_rank"] = maxRank
+        out[name + "_imbalance"] = imbalance(avg, maximum)
+    total, avg, maximum, maxRank = statistics(
+            dict((rank, r["expand"] + r["fold"]) for rank, r in ranks.items()))
+    out["time_avg"] = avg
+    out["time_max"] = maximum
+    out["slowest_rank"] = maxRank
+    if "comm" in first:
+        for name in first["comm"]:
+            total, avg, maximum, maxRank = statistics(dict((rank, r["comm"][name]) for rank, r in ranks.items()))
+            out[name + "_sum"] = total
+            out[name + "_max"] = maximum
+    if "spans" in first:
+        # the spans of the same content are added up in each process
+        spans = {}
+        for rank, r in ranks.items():
+            perRank = {}
+            for content, number, span in r["spans"]:
+                perRank[content] = perRank.get(content, 0.0) + span
+            for content, span in perRank.items():
+                spans.setdefault(content, {})[rank] = span
+        out["spans"] = {}
+        for content, values in spans.items():
+            total, avg, maximum, maxRank = statistics(values)
+            out["spans"][content] = {"avg": avg, "max": maximum, "max_rank": maxRank}
+    return out
+
+def mergeTrace(levels):
+    return [mergeLevel(key, levels[key]) for key in sorted(levels)]
+
+#####################################
+# output
+#####################################
+
+def writeJson(merged, out):
+    for rec in merged:
+        out.write(json.dumps(rec, sort_keys=True) + "\n")
+
+def writeCsv(merged, out):
+    columns = []
+    for rec in merged:
+        for name in rec:
+            if name != "spans" and name not in columns:
+                columns.append(name)
+    out.write(",".join(columns) + "\n")
+    for rec in merged:
+        out.write(",".join(str(rec.get(name, "")) for name in columns) + "\n")
+
+def printSlowest(merged, num):
+    sys.stderr.write("Slowest levels (max time over the processes):\n")
+    for rec in sorted(merged, key=lambda r: -r["time_max"])[:num]:
+        sys.stderr.write("  BFS %d level %d %s %s: max %.3f ms (rank %d), avg %.3f ms, NQ %d\n" % (
+                rec["bfs"], rec["level"], rec["dir"], rec["format"],
+                rec["time_max"], rec["slowest_rank"], rec["time_avg"], rec["global_nq"]))
+
+#####################################
+# main
+#####################################
+
+if __name__ == "__main__":
+    parser = OptionParser(usage="%prog [options] <trace prefix>")
+    parser.add_option("-o", "--output", dest="output", default="-",
+                      help="output file (default: standard output)")
+    parser.add_option("--csv", dest="csv", action="store_true", default=False,
+                      help="write CSV instead of JSON lines (the spans are omitted)")
+    parser.add_option("--slowest", dest="slowest", type="int", default=5,
+                      help="number of the slowest levels printed to the standard error (default: 5)")
+    (options, args) = parser.parse_args()
+    if len(args) != 1:
+        parser.error("trace prefix is required")
+
+    levels = readTraceFiles(args[0])
+    merged = mergeTrace(levels)
+    out = sys.stdout if options.output == "-" else open(options.output, "w")
+    if options.csv:
+        writeCsv(merged, out)
+    else:
+        writeJson(merged, out)
+    if out is not sys.stdout:
+        out.close()
+    if options.slowest > 0:
+        printSlowest(merged, options.slowest)
@@ -11,11 +11,13 @@
 #include <limits.h>
 #include "utils.hpp"
 #include "fiber.hpp"
+#include "rma_comm.hpp"
 
 #define debug(...) debug_print(ABSCO, __VA_ARGS__)
 class AlltoallBufferHandler {
 public:
 	virtual ~AlltoallBufferHandler() { }
+	// This is called concurrently by the sending threads.
 	virtual void* get_buffer() = 0;
 	virtual void add(void* buffer, void* data, int offset, int length) = 0;
 	virtual void* clear_buffers() = 0;
@@ -40,57 +42,110 @@ class AsyncAlltoallManager {
 		int64_t header;
 	};
 
+	// A buffer obtained from the buffer provider.
+	// filled: the number of elements written. SEALED is added when the buffer is replaced.
+	// The thread which makes filled == SEALED pushes the buffer to the ready list of the target.
+	struct BufferDesc {
+		void* ptr;
+		volatile int filled;
+		int length;
+		uint32_t next; // ready list
+	};
+
 	struct CommTarget {
 		CommTarget()
-			: reserved_size_(0)
-			, filled_size_(0) {
-			cur_buf.ptr = NULL;
-			cur_buf.length = 0;
-			pthread_mutex_init(&send_mutex, NULL);
-		}
-		~CommTarget() {
-			pthread_mutex_destroy(&send_mutex);
-		}
-
-		pthread_mutex_t send_mutex;
-		// monitor : send_mutex
-		volatile int reserved_size_;
-		volatile int filled_size_;
-		Buffer cur_buf;
+			: state(EMPTY_STATE)
+			, ready(NO_BUFFER) { }
+
+		// (current buffer << 32) | reserved size
+		volatile uint64_t state;
+		// MPSC lock-free list of the filled buffers (BufferDesc::next)
+		volatile uint32_t ready;
+		uint8_t pad[CACHE_LINE - sizeof(uint64_t) - sizeof(uint32_t)];
 		std::vector<Buffer> send_data;
 		std::vector<PointerData> send_ptr;
 	};
+
+	// spare buffer of each thread
+	struct SpareBuffer {
+		uint32_t id;
+		uint8_t pad[CACHE_LINE - sizeof(uint32_t)];
+	};
+
+	enum {
+		SEALED = 1 << 30,
+	};
+	static const uint32_t NO_BUFFER = 0xFFFFFFFFu;
+	static const uint64_t EMPTY_STATE = uint64_t(NO_BUFFER) << 32;
 public:
 	AsyncAlltoallManager(MPI_Comm comm_, AlltoallBufferHandler* buffer_provider_)
 		: comm_(comm_)
 		, buffer_provider_(buffer_provider_)
 		, scatter_(comm_)
+		, desc_(NULL)
+		, desc_capacity_(0)
+		, num_descs_(0)
+		, rma_(NULL)
 	{
 		CTRACER(AsyncA2A_construtor);
 		MPI_Comm_size(comm_, &comm_size_);
+		max_threads_ = omp_get_max_threads();
 		node_ = new CommTarget[comm_size_]();
-		d_ = new DynamicDataSet();
-		pthread_mutex_init(&d_->thread_sync_, NULL);
+		spare_ = static_cast<SpareBuffer*>(cache_aligned_xmalloc(max_threads_*sizeof(SpareBuffer)));
+		thread_ptr_ = new std::vector<PointerData>[max_threads_ * comm_size_];
 		buffer_size_ = buffer_provider_->buffer_length();
 	}
 	virtual ~AsyncAlltoallManager() {
 		delete [] node_; node_ = NULL;
+		free(spare_); spare_ = NULL;
+		delete [] thread_ptr_; thread_ptr_ = NULL;
+		free(desc_); desc_ = NULL;
+		delete rma_; rma_ = NULL;
+	}
+
+	// Receives the data with the one-sided puts (rma_comm.hpp) instead of MPI_Alltoallv.
+	// The buffer of the window must be the buffer returned by clear_buffers() of the buffer provider.
+	void enable_rma(RmaAlltoallWindow* window, int channel) {
+		delete rma_;
+		rma_ = new RmaAlltoallChannel(window, channel, comm_);
+	}
+	void disable_rma() {
+		delete rma_; rma_ = NULL;
+	}
+
+	// call this when the buffer length of the handler is changed
+	void reset_buffer_size() {
+		buffer_size_ = buffer_provider_->buffer_length();
 	}
 
+	// This must be called before the put() of each communication.
 	void prepare() {
 		CTRACER(prepare);
 		debug("prepare idx=%d", sub_comm);
+		// at most all the buffers of the provider and the spare buffers
+		int64_t max_descs = buffer_provider_->max_size() /
+				(int64_t(buffer_size_) * buffer_provider_->element_size()) + max_threads_ + 1;
+		if(desc_capacity_ < max_descs) {
+			free(desc_);
+			desc_capacity_ = max_descs;
+			desc_ = static_cast<BufferDesc*>(cache_aligned_xmalloc(desc_capacity_*sizeof(BufferDesc)));
+		}
+		num_descs_ = 0;
+		for(int i = 0; i < max_threads_; ++i) {
+			spare_[i].id = NO_BUFFER;
+		}
 		for(int i = 0; i < comm_size_; ++i) {
-			node_[i].reserved_size_ = node_[i].filled_size_ = buffer_size_;
+			node_[i].state = EMPTY_STATE;
+			node_[i].ready = NO_BUFFER;
 		}
 	}
 
 	/**
-	 * Asynchronous send.
-	 * When the communicator receive data, it will call fold_received(FoldCommBuffer*) function.
-	 * To reduce the memory consumption, when the communicator detects stacked jobs,
-	 * it also process the tasks in the fiber_man_ except the tasks that have the lowest priority (0).
-	 * This feature realize the fixed memory consumption.
+	 * Asynchronous send. This is called concurrently by the threads.
+	 * The data is appended to the current buffer of the target.
+	 * The space is reserved with CAS on the target state and the thread which cannot reserve
+	 * the space replaces the buffer with its spare buffer. The replaced buffer is pushed to
+	 * the ready list by the thread which writes the last data, so no thread waits for the others.
 	 */
 	void put(void* ptr, int length, int target)
 	{
@@ -99,41 +154,42 @@ public:
 			assert(length > 0);
 			return ;
 		}
+		assert (length <= buffer_size_);
 		CommTarget& node = node_[target];
 
-//#if ASYNC_COMM_LOCK_FREE
-		do {
-			int offset = __sync_fetch_and_add(&node.reserved_size_, length);
-			if(offset > buffer_size_) {
-				// wait
-				while(node.reserved_size_ > buffer_size_) ;
-				continue ;
+		uint64_t state = node.state;
+		while(true) {
+			uint32_t id = uint32_t(state >> 32);
+			int offset = int(state & 0xFFFFFFFFu);
+			if(id != NO_BUFFER && offset + length <= buffer_size_) {
+				if(__atomic_compare_exchange_n(&node.state, &state, state + length,
+						false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+				{
+					buffer_provider_->add(desc_[id].ptr, ptr, offset, length);
+					complete(node, id, length);
+					return ;
+				}
+				continue; // state is updated by the CAS
 			}
-			else if(offset + length > buffer_size_) {
-				// swap buffer
-				assert (offset > 0);
-				while(offset != node.filled_size_) ;
-				flush(node);
-				node.cur_buf.ptr = get_send_buffer(); // Maybe, this takes much time.
-				// This order is important.
-				offset = node.filled_size_ = 0;
-				__sync_synchronize(); // membar
-				node.reserved_size_ = length;
+			// replace the buffer
+			uint32_t new_id = get_spare_buffer();
+			if(__atomic_compare_exchange_n(&node.state, &state, (uint64_t(new_id) << 32) | length,
+					false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+			{
+				if(id != NO_BUFFER) seal(node, id, offset);
+				buffer_provider_->add(desc_[new_id].ptr, ptr, 0, length);
+				complete(node, new_id, length);
+				return ;
 			}
-			buffer_provider_->add(node.cur_buf.ptr, ptr, offset, length);
-			__sync_fetch_and_add(&node.filled_size_, length);
-			break;
-		} while(true);
-// #endif
+			// another thread replaced the buffer
+			spare_[omp_get_thread_num()].id = new_id;
+		}
 	}
 
 	void put_ptr(void* ptr, int length, int64_t header, int target) {
-		CommTarget& node = node_[target];
 		PointerData data = { ptr, length, header };
-
-		pthread_mutex_lock(&node.send_mutex);
-		node.send_ptr.push_back(data);
-		pthread_mutex_unlock(&node.send_mutex);
+		// thread private: merged into the target in collect()
+		thread_ptr_[omp_get_thread_num() * comm_size_ + target].push_back(data);
 	}
 
 	void run_with_ptr() {
@@ -153,7 +209,7 @@ public:
 #pragma omp for schedule(static)
 				for(int i = 0; i < comm_size_; ++i) {
 					CommTarget& node = node_[i];
-					flush(node);
+					collect(node, i);
 					for(int b = 0; b < (int)node.send_data.size(); ++b) {
 						counts[i] += node.send_data[b].length;
 					}
@@ -243,7 +299,7 @@ public:
 			PROF(merge_time_ += tk_all);
 			USER_START(a2a_comm);
 			VERVOSE(if(loop > 0 && mpi.isMaster()) print_with_prefix("Alltoall with pointer (Again)"));
-			scatter_.alltoallv(sendbuf, recvbuf, type, recvbufsize);
+			alltoallv(sendbuf, recvbuf, type, recvbufsize);
 			PROF(comm_time_ += tk_all);
 			USER_END(a2a_comm);
 
@@ -285,7 +341,7 @@ public:
 #pragma omp for schedule(static)
 			for(int i = 0; i < comm_size_; ++i) {
 				CommTarget& node = node_[i];
-				flush(node);
+				collect(node, i);
 				for(int b = 0; b < (int)node.send_data.size(); ++b) {
 					counts[i] += node.send_data[b].length;
 				}
@@ -320,7 +376,7 @@ public:
 		int recvbufsize = buffer_provider_->max_size();
 		PROF(merge_time_ += tk_all);
 		USER_START(a2a_comm);
-		scatter_.alltoallv(sendbuf, recvbuf, type, recvbufsize);
+		alltoallv(sendbuf, recvbuf, type, recvbufsize);
 		PROF(comm_time_ += tk_all);
 		USER_END(a2a_comm);
 
@@ -353,23 +409,23 @@ public:
 	int get_last_send_size() { return last_send_size_; }
 #endif
 private:
-
-	struct DynamicDataSet {
-		// lock topology
-		// FoldNode::send_mutex -> thread_sync_
-		pthread_mutex_t thread_sync_;
-	} *d_;
-
 	MPI_Comm comm_;
 
 	int buffer_size_;
 	int comm_size_;
+	int max_threads_;
 
-	int node_list_length_;
 	CommTarget* node_;
 	AlltoallBufferHandler* buffer_provider_;
 	ScatterContext scatter_;
 
+	BufferDesc* desc_;
+	int64_t desc_capacity_;
+	volatile int num_descs_;
+	SpareBuffer* spare_; // [thread]
+	std::vector<PointerData>* thread_ptr_; // [thread][target]
+	RmaAlltoallChannel* rma_;
+
 	PROF(profiling::TimeSpan merge_time_);
 	PROF(profiling::TimeSpan comm_time_);
 	PROF(profiling::TimeSpan recv_proc_time_);
@@ -377,20 +433,80 @@ private:
 	VERVOSE(int last_send_size_);
 	VERVOSE(int last_recv_size_);
 
-	void flush(CommTarget& node) {
-		if(node.cur_buf.ptr != NULL) {
-			node.cur_buf.length = node.filled_size_;
-			node.send_data.push_back(node.cur_buf);
-			node.cur_buf.ptr = NULL;
+	void alltoallv(void* sendbuf, void* recvbuf, MPI_Datatype type, int recvbufsize) {
+		if(rma_ != NULL) {
+			assert (rma_->recv_buffer() == recvbuf);
+			scatter_.alltoallv(sendbuf, rma_, type, recvbufsize);
+		}
+		else {
+			scatter_.alltoallv(sendbuf, recvbuf, type, recvbufsize);
 		}
 	}
 
-	void* get_send_buffer() {
+	uint32_t get_spare_buffer() {
+		SpareBuffer& spare = spare_[omp_get_thread_num()];
+		uint32_t id = spare.id;
+		if(id != NO_BUFFER) {
+			spare.id = NO_BUFFER;
+			return id;
+		}
 		CTRACER(get_send_buffer);
-		pthread_mutex_lock(&d_->thread_sync_);
-		void* ret = buffer_provider_->get_buffer();
-		pthread_mutex_unlock(&d_->thread_sync_);
-		return ret;
+		id = __sync_fetch_and_add(&num_descs_, 1);
+		if(id >= desc_capacity_) {
+			fprintf(IMD_OUT, "Too many send buffers (capacity=%" PRId64 ")\n", desc_capacity_);
+			throw "Error: too many send buffers";
+		}
+		BufferDesc& desc = desc_[id];
+		desc.ptr = buffer_provider_->get_buffer();
+		desc.filled = 0;
+		desc.length = 0;
+		desc.next = NO_BUFFER;
+		return id;
+	}
+
+	void push_ready(CommTarget& node, uint32_t id) {
+		uint32_t head = node.ready;
+		do {
+			desc_[id].next = head;
+		} while(!__atomic_compare_exchange_n(&node.ready, &head, id,
+				false, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+	}
+
+	// called after writing length elements
+	void complete(CommTarget& node, uint32_t id, int length) {
+		if(__sync_add_and_fetch(&desc_[id].filled, length) == SEALED) {
+			push_ready(node, id);
+		}
+	}
+
+	// called when the buffer is replaced. length: the reserved size of the buffer
+	void seal(CommTarget& node, uint32_t id, int length) {
+		desc_[id].length = length;
+		if(__sync_add_and_fetch(&desc_[id].filled, SEALED - length) == SEALED) {
+			push_ready(node, id);
+		}
+	}
+
+	// Moves the buffers of the target to send_data. No put() must be running.
+	void collect(CommTarget& node, int target) {
+		uint64_t state = node.state;
+		if(uint32_t(state >> 32) != NO_BUFFER) {
+			seal(node, uint32_t(state >> 32), int(state & 0xFFFFFFFFu));
+			node.state = EMPTY_STATE;
+		}
+		// the list is in the reverse order
+		size_t first = node.send_data.size();
+		for(uint32_t id = node.ready; id != NO_BUFFER; id = desc_[id].next) {
+			Buffer buf = { desc_[id].ptr, desc_[id].length };
+			node.send_data.push_back(buf);
+		}
+		std::reverse(node.send_data.begin() + first, node.send_data.end());
+		node.ready = NO_BUFFER;
+		for(int t = 0; t < max_threads_; ++t) {
+			std::vector<PointerData>& ptrs = thread_ptr_[t * comm_size_ + target];
+			node.send_ptr.insert(node.send_ptr.end(), ptrs.begin(), ptrs.end());
+			ptrs.clear();
+		}
 	}
 };
 
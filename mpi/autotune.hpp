@@ -0,0 +1,126 @@
+/*
+ * autotune.hpp
+ */
+
+#ifndef AUTOTUNE_HPP_
+#define AUTOTUNE_HPP_
+
+#include "utils.hpp"
+#include "runtime_config.hpp"
+
+//-------------------------------------------------------------//
+// Parameter Auto-Tuner
+//-------------------------------------------------------------//
+// Tunes the runtime parameters (runtime_config.hpp) on the constructed graph.
+// The parameters are tuned one by one (coordinate descent): each candidate value is
+// measured with a few BFS runs and the fastest value is kept for the following parameters.
+// The result is written in the configuration file format, so that it can be reused with --config=<file>.
+//
+// Runtime options:
+// AUTOTUNE: output file of the best configuration
+// AUTOTUNE_ROOTS: number of BFS roots for each measurement (default: 4)
+// AUTOTUNE_PASSES: number of passes over all the parameters (default: 1)
+
+namespace autotune {
+
+struct Param {
+	const char* name;
+	const char* values[6]; // terminated with NULL
+};
+
+// PACKET_LENGTH and NUM_BOTTOM_UP_STREAMS are not tuned since they are compile-time parameters.
+// comm_buffer_size is at most twice the default, since the communication buffer pool has fixed size.
+const Param PARAMS[] = {
+#if COMPRESSED_EDGE_ARRAY
+	{ "top_down_send_lb", { "0", NULL } },
+#else
+	{ "top_down_send_lb", { "0", "1", "2", NULL } },
+#endif
+	{ "top_down_pending_width", { "500", "1000", "2000", "4000", NULL } },
+	{ "comm_buffer_size", { "8192", "16384", "32768", "65536", NULL } },
+	{ "bottom_up_overlap_pfs", { "0", "1", NULL } },
+	{ "denom_topdown_to_bottomup", { "500", "1000", "2000", "4000", "8000", NULL } },
+	{ "denom_bottomup_to_topdown", { "4", "8", "16", "32", NULL } },
+	{ "denom_bitmap_to_list", { "1", "2", "4", NULL } },
+};
+
+// returns the max time of all processes to run BFS from the roots
+template <typename BfsType>
+double measure(BfsType* bfs, const int64_t* roots, int num_roots, int64_t* pred)
+{
+	bfs->reconfigure();
+	double time = 0;
+	for(int i = 0; i < num_roots; ++i) {
+		MPI_Barrier(mpi.comm_2d);
+		double start = MPI_Wtime();
+		bfs->run_bfs(roots[i], pred);
+		time += MPI_Wtime() - start;
+	}
+	double max_time;
+	MPI_Allreduce(&time, &max_time, 1, MPI_DOUBLE, MPI_MAX, mpi.comm_2d);
+	return max_time;
+}
+
+} // namespace autotune {
+
+/**
+ * Tunes g_config and writes the best configuration to output_path.
+ * g_config is the best configuration when this function returns.
+ * This is a collective operation. bfs must be prepared (prepare_bfs()).
+ */
+template <typename BfsType>
+void autotune_bfs(BfsType* bfs, const int64_t* roots, int num_roots, int64_t* pred, const char* output_path)
+{
+	using namespace autotune;
+	TRACER(autotune);
+	const char* roots_str = getenv("AUTOTUNE_ROOTS");
+	const char* passes_str = getenv("AUTOTUNE_PASSES");
+	num_roots = std::min(num_roots, roots_str ? std::max(1, atoi(roots_str)) : 4);
+	int num_passes = passes_str ? std::max(1, atoi(passes_str)) : 1;
+	const int num_params = sizeof(PARAMS) / sizeof(PARAMS[0]);
+
+	if(mpi.isMaster()) print_with_prefix("Autotune: %d roots for each measurement, %d passes", num_roots, num_passes);
+
+	double best_time = measure(bfs, roots, num_roots, pred);
+	RuntimeConfig best = g_config;
+	if(mpi.isMaster()) print_with_prefix("Autotune: initial configuration: %f ms", best_time * 1000.0);
+
+	for(int pass = 0; pass < num_passes; ++pass) {
+		for(int p = 0; p < num_params; ++p) {
+			const Param& param = PARAMS[p];
+			for(int v = 0; param.values[v] != NULL; ++v) {
+				g_config = best;
+				if(g_config.set(param.name, param.values[v]) == false) continue;
+				if(memcmp(&g_config, &best, sizeof(best)) == 0) continue; // same as the best
+				double time = measure(bfs, roots, num_roots, pred);
+				bool improved = (time < best_time);
+				if(mpi.isMaster()) print_with_prefix("Autotune: %s = %s: %f ms%s",
+						param.name, param.values[v], time * 1000.0, improved ? " (best)" : "");
+				if(improved) {
+					best_time = time;
+					best = g_config;
+				}
+			}
+		}
+	}
+
+	g_config = best;
+	bfs->reconfigure();
+
+	if(mpi.isMaster()) {
+		print_with_prefix("Autotune: best configuration: %f ms", best_time * 1000.0);
+		g_config.print();
+		FILE* fp = fopen(output_path, "w");
+		if(fp == NULL) {
+			print_with_prefix("Autotune: Cannot write %s", output_path);
+		}
+		else {
+			fprintf(fp, "# generated by the autotune mode: %f ms for %d roots\n", best_time * 1000.0, num_roots);
+			g_config.write(fp);
+			fclose(fp);
+			print_with_prefix("Autotune: the best configuration is written to %s", output_path);
+		}
+	}
+}
+
+#endif /* AUTOTUNE_HPP_ */
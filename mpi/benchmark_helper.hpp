@@ -253,7 +253,8 @@ void generate_graph(EdgeList* edge_list, const GraphGenerator<typename EdgeList:
 		double global_data_size = (double)num_global_edges * 16.0 / 1000000000.0;
 		double local_data_size = global_data_size / mpi.size_2d;
 		print_with_prefix("Graph data size: %f GB ( %f GB per process )", global_data_size, local_data_size);
-		print_with_prefix("Using storage: %s", edge_list->data_is_in_file() ? "yes" : "no");
+		print_with_prefix("Using storage: %s%s", edge_list->data_is_in_file() ? "yes" : "no",
+				edge_list->is_mapped() ? " (mapped)" : "");
 		if(edge_list->data_is_in_file()) {
 			print_with_prefix("Filepath: %s 1 2 ...", edge_list->get_filepath());
 		}
@@ -305,11 +306,22 @@ void generate_graph(EdgeList* edge_list, const GraphGenerator<typename EdgeList:
 	if(mpi.isMaster()) print_with_prefix("Finished generating.");
 }
 
+// The generator of the benchmark graph.
+// generate_graph_spec2010() and the streaming construction generate the same edges with it.
+template <typename EdgeType>
+class Spec2010GraphGenerator : public RmatGraphGenerator<EdgeType, 5700, 1900>
+{
+public:
+	Spec2010GraphGenerator(int scale, int edge_factor)
+		: RmatGraphGenerator<EdgeType, 5700, 1900>(scale, edge_factor, 255,
+				PRM::USERSEED1, PRM::USERSEED2, InitialEdgeType::NONE)
+	{ }
+};
+
 template <typename EdgeList>
 void generate_graph_spec2010(EdgeList* edge_list, int scale, int edge_factor, int max_weight = 0)
 {
-	RmatGraphGenerator<typename EdgeList::edge_type, 5700, 1900> generator(scale, edge_factor, 255,
-			PRM::USERSEED1, PRM::USERSEED2, InitialEdgeType::NONE);
+	Spec2010GraphGenerator<typename EdgeList::edge_type> generator(scale, edge_factor);
 	generate_graph(edge_list, &generator);
 }
 
@@ -321,6 +333,178 @@ void generate_graph_spec2012(EdgeList* edge_list, int scale, int edge_factor, in
 	generate_graph(edge_list, &generator);
 }
 
+//-------------------------------------------------------------//
+// Streaming Edge List
+//-------------------------------------------------------------//
+// Edge list which generates the edges on demand instead of storing them.
+// It has the read interface of EdgeListStorage, so the graph constructor can
+// consume the generated chunks directly and the local edge list is never materialized.
+// Each pass over the list regenerates the edges. While the caller processes a chunk,
+// the next chunk is generated by a helper thread (double buffering), so the generation
+// overlaps the scatter communication of the graph constructor.
+// The helper thread is created by the first beginRead() and reused by the later passes.
+// It generates with a team of
+// half of the OpenMP threads, so that the threads of the helper team and the caller
+// do not double the number of threads on every core.
+
+template <typename EdgeType, int CHUNK_SIZE_>
+class GeneratedEdgeList {
+public:
+	static const int CHUNK_SIZE = CHUNK_SIZE_;
+	typedef EdgeType edge_type;
+
+	GeneratedEdgeList(const GraphGenerator<EdgeType>* generator)
+		: generator_(generator)
+		, num_global_edges_(generator->num_global_edges())
+		, num_iterations_(0)
+		, read_index_(0)
+		, prefetch_index_(0)
+		, prefetch_running_(false)
+		, thread_running_(false)
+		, thread_exit_(false)
+		, num_gen_threads_(std::max(1, omp_get_max_threads() / 2))
+	{
+		const int64_t num_global_chunks = (num_global_edges_ + CHUNK_SIZE - 1) / CHUNK_SIZE;
+		num_iterations_ = (num_global_chunks + mpi.size_2d - 1) / mpi.size_2d;
+		buffer_[0] = buffer_[1] = NULL;
+		buffer_length_[0] = buffer_length_[1] = 0;
+		pthread_mutex_init(&thread_sync_, NULL);
+		pthread_cond_init(&thread_state_, NULL);
+	}
+
+	~GeneratedEdgeList() {
+		endRead();
+		stopThread();
+		pthread_mutex_destroy(&thread_sync_);
+		pthread_cond_destroy(&thread_state_);
+	}
+
+	// returns the number of iterations (the same for all processes)
+	int beginRead(bool release_buffer) {
+		for(int i = 0; i < 2; ++i) {
+			if(buffer_[i] == NULL) {
+				buffer_[i] = static_cast<EdgeType*>(cache_aligned_xmalloc(CHUNK_SIZE*sizeof(EdgeType)));
+			}
+		}
+		read_index_ = 0;
+		if(num_iterations_ > 0) {
+			startThread();
+			startPrefetch(0);
+		}
+		return num_iterations_;
+	}
+
+	int read(EdgeType** pp_buffer) {
+		waitPrefetch();
+		const int index = read_index_++;
+		if(read_index_ < num_iterations_) {
+			startPrefetch(read_index_);
+		}
+		*pp_buffer = buffer_[index & 1];
+		return buffer_length_[index & 1];
+	}
+
+	void endRead() {
+		waitPrefetch();
+		for(int i = 0; i < 2; ++i) {
+			if(buffer_[i] != NULL) { free(buffer_[i]); buffer_[i] = NULL; }
+		}
+	}
+
+	int64_t num_local_edges() { return (num_global_edges_ + mpi.size_2d - 1) / mpi.size_2d; }
+	bool data_is_in_file() { return false; }
+	bool is_mapped() { return false; }
+	const char* get_filepath() { return NULL; }
+
+private:
+	const GraphGenerator<EdgeType>* generator_;
+	int64_t num_global_edges_;
+	int num_iterations_;
+	int read_index_;
+	int prefetch_index_;
+	bool prefetch_running_; // a chunk is requested and not finished yet
+	bool thread_running_;
+	bool thread_exit_;
+	int num_gen_threads_;
+	pthread_t prefetch_thread_;
+	pthread_mutex_t thread_sync_;
+	pthread_cond_t thread_state_;
+	EdgeType* buffer_[2];
+	int buffer_length_[2];
+
+	void startThread() {
+		if(thread_running_) return ;
+		thread_exit_ = false;
+		if(pthread_create(&prefetch_thread_, NULL, prefetch_thread_routine, this) != 0) {
+			throw_exception("Failed to create the edge generation thread");
+		}
+		thread_running_ = true;
+	}
+
+	void stopThread() {
+		if(thread_running_ == false) return ;
+		pthread_mutex_lock(&thread_sync_);
+		thread_exit_ = true;
+		pthread_cond_broadcast(&thread_state_);
+		pthread_mutex_unlock(&thread_sync_);
+		pthread_join(prefetch_thread_, NULL);
+		thread_running_ = false;
+	}
+
+	void startPrefetch(int index) {
+		pthread_mutex_lock(&thread_sync_);
+		prefetch_index_ = index;
+		prefetch_running_ = true;
+		pthread_cond_broadcast(&thread_state_);
+		pthread_mutex_unlock(&thread_sync_);
+	}
+
+	void waitPrefetch() {
+		pthread_mutex_lock(&thread_sync_);
+		while(prefetch_running_) {
+			pthread_cond_wait(&thread_state_, &thread_sync_);
+		}
+		pthread_mutex_unlock(&thread_sync_);
+	}
+
+	static void* prefetch_thread_routine(void* this_) {
+		SET_AFFINITY;
+		static_cast<GeneratedEdgeList*>(this_)->processPrefetch();
+		return NULL;
+	}
+
+	void processPrefetch() {
+		pthread_mutex_lock(&thread_sync_);
+		while(true) {
+			while(prefetch_running_ == false && thread_exit_ == false) {
+				pthread_cond_wait(&thread_state_, &thread_sync_);
+			}
+			if(prefetch_running_ == false) break;
+			pthread_mutex_unlock(&thread_sync_);
+			generateChunk();
+			pthread_mutex_lock(&thread_sync_);
+			prefetch_running_ = false;
+			pthread_cond_broadcast(&thread_state_);
+		}
+		pthread_mutex_unlock(&thread_sync_);
+	}
+
+	// The chunk assignment is the same as generate_graph().
+	void generateChunk() {
+		const int index = prefetch_index_;
+		EdgeType* edge_buffer = buffer_[index & 1];
+		const int64_t start_edge = std::min<int64_t>(
+				(int64_t(mpi.size_2d)*index + mpi.rank_2d) * CHUNK_SIZE, num_global_edges_);
+		const int64_t end_edge = std::min<int64_t>(start_edge + CHUNK_SIZE, num_global_edges_);
+#pragma omp parallel num_threads(num_gen_threads_)
+		{
+			SET_OMP_AFFINITY;
+			generator_->generateRange(edge_buffer, start_edge, end_edge);
+		}
+		buffer_length_[index & 1] = int(end_edge - start_edge);
+	}
+};
+
 // using SFINAE
 // function #1
 template <typename EdgeList>
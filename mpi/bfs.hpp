@@ -22,10 +22,27 @@
 #include "mpi_comm.hpp"
 #include "fjmpi_comm.hpp"
 #include "bottom_up_comm.hpp"
+#include "direction_switch.hpp"
+#include "runtime_config.hpp"
+#include "numa_layout.hpp"
+#include "frontier_codec.hpp"
+#include "level_trace.hpp"
+#include "sssp.hpp"
 
 #include "low_level_func.h"
 
 #define debug(...) debug_print(BFSMN, __VA_ARGS__)
+#if INCREMENTAL_PRED_RESET
+#define MARK_PRED_DIRTY(orig_local) mark_pred_dirty(orig_local)
+#else
+#define MARK_PRED_DIRTY(orig_local)
+#endif
+// the index of pred_ for the local vertex found in the top-down step
+#if PRED_REORDERED
+#define TD_PRED_INDEX(tgt_local) (tgt_local)
+#else
+#define TD_PRED_INDEX(tgt_local) invert_map[tgt_local]
+#endif
 class BfsBase
 {
 	typedef BfsBase ThisType;
@@ -51,6 +68,10 @@ public:
 		BFELL_SORT_IN_BMP = BFELL_SORT / NBPE,
 
 		BU_SUBSTEP = PRM::NUM_BOTTOM_UP_STREAMS,
+
+		// number of bitmap words for each bit of the bottom-up summary
+		LOG_SUMMARY_WORDS = 6,
+		SUMMARY_WORDS = 1 << LOG_SUMMARY_WORDS,
 	};
 
 	class QueuedVertexes {
@@ -84,19 +105,41 @@ public:
 
 	BfsBase()
 		: bottom_up_substep_(NULL)
+		, rma_transport_(false)
+		, a2a_rma_window_(NULL)
 		, top_down_comm_(this)
 		, bottom_up_comm_(this)
 		, td_comm_(mpi.comm_2dc, &top_down_comm_)
 		, bu_comm_(mpi.comm_2dr, &bottom_up_comm_)
-		, denom_to_bottom_up_(DENOM_TOPDOWN_TO_BOTTOMUP)
-		, denom_bitmap_to_list_(DENOM_BITMAP_TO_LIST)
+		, sssp_comm_handler_(this)
+		, sssp_comm_(mpi.comm_2dc, &sssp_comm_handler_)
+		, sssp_pull_comm_(mpi.comm_2dr, &sssp_comm_handler_)
+		, denom_to_bottom_up_(g_config.denom_topdown_to_bottomup)
+		, denom_bitmap_to_list_(g_config.denom_bitmap_to_list)
 		, thread_sync_(omp_get_max_threads())
+		, sssp_row_starts_(NULL)
+		, sssp_light_ends_(NULL)
+		, sssp_edges_(NULL)
+		, sssp_dist_(NULL)
+		, sssp_flags_(NULL)
+		, sssp_queue_(NULL)
+		, sssp_heavy_(NULL)
+		, sssp_send_frontier_(NULL)
+		, sssp_recv_frontier_(NULL)
+		, sssp_rows_(NULL)
+		, sssp_row_edge_offsets_(NULL)
+		, sssp_packets_(NULL)
+		, sssp_col_invert_map_(NULL)
+		, sssp_frontier_dist_(NULL)
+		, sssp_col_dist_(NULL)
+		, sssp_row_dist_(NULL)
 	{
 	}
 
 	virtual ~BfsBase()
 	{
 		delete bottom_up_substep_; bottom_up_substep_ = NULL;
+		end_sssp();
 	}
 
 	template <typename EdgeList>
@@ -114,16 +157,71 @@ public:
 
 	void prepare_bfs() {
 		printInformation();
+		numa_layout_.initialize();
+		if(mpi.isMaster()) numa_layout_.print_information();
+		numa_layout_.place_graph(graph_, get_bitmap_size_local() / BU_SUBSTEP);
+#if BOTTOM_UP_SIMD
+		{
+			const char* simd_str = getenv("BOTTOM_UP_SIMD");
+			const char* kernel_name = "scalar";
+			bottom_up_scan_kernel_ = NULL;
+			// the kernels compute the compact bit index with 32-bit multiplications
+			if((simd_str == NULL || strcmp(simd_str, "0") != 0) &&
+					graph_.num_local_verts_ < (int64_t(1) << 32))
+			{
+				const bool allow_avx512 = (simd_str == NULL || strcmp(simd_str, "avx2") != 0);
+				bottom_up_scan_kernel_ = get_bottom_up_scan_kernel(allow_avx512, &kernel_name);
+			}
+			if(mpi.isMaster()) print_with_prefix("Bottom-up bitmap scan kernel: %s", kernel_name);
+		}
+#endif
+		frontier_codec_.initialize();
+		if(mpi.isMaster() && frontier_codec_.enabled()) print_with_prefix("Frontier compression is enabled.");
+		rma_transport_ = rma_transport_enabled();
+		if(mpi.isMaster() && rma_transport_) print_with_prefix("RMA transport is enabled.");
+		level_trace_.initialize();
+		if(mpi.isMaster() && level_trace_.enabled()) print_with_prefix("Level trace is enabled.");
 		allocate_memory();
+#if PRED_REORDERED
+		make_row_locals();
+#endif
+#if ADAPTIVE_DIRECTION_SWITCH
+		switch_policy_.initialize(graph_.log_orig_global_verts_);
+#else
+		if(mpi.isMaster() && getenv("ADAPTIVE_SWITCH") != NULL) {
+			print_with_prefix("Warning: ADAPTIVE_SWITCH is ignored. Build with ADAPTIVE_DIRECTION_SWITCH=1.");
+		}
+#endif
 	}
 
 	void run_bfs(int64_t root, int64_t* pred);
 
 	void get_pred(int64_t* pred) {
 	//	comm_.release_extra_buffer();
+		// The caller may modify pred after this.
+		invalidate_pred();
+	}
+
+	// Reallocates the buffers to reflect the changes of g_config.
+	// This must be called between prepare_bfs() and end_bfs().
+	void reconfigure() {
+		deallocate_memory();
+		free(top_down_comm_.tmp_rows); top_down_comm_.tmp_rows = NULL;
+		delete bottom_up_substep_; bottom_up_substep_ = NULL;
+		denom_to_bottom_up_ = g_config.denom_topdown_to_bottomup;
+		denom_bitmap_to_list_ = g_config.denom_bitmap_to_list;
+		td_comm_.reset_buffer_size();
+		bu_comm_.reset_buffer_size();
+		allocate_memory();
 	}
 
 	void end_bfs() {
+#if ADAPTIVE_DIRECTION_SWITCH
+		switch_policy_.finalize();
+#endif
+#if PRED_REORDERED
+		free(row_locals_); row_locals_ = NULL;
+#endif
 		deallocate_memory();
 	}
 
@@ -148,6 +246,10 @@ public:
 		ptr = (uint8_t*)ptr + width*sizeof(T)*mpi.size_z;
 	}
 
+	int get_a2a_buffer_size() const {
+		return graph_.num_local_verts_ * sizeof(int32_t) * 50; // TODO: accuracy
+	}
+
 	void allocate_memory()
 	{
 		const int max_threads = omp_get_max_threads();
@@ -170,15 +272,26 @@ public:
 		 * - communication buffer for asynchronous communication:
 		 */
 
-		a2a_comm_buf_.allocate_memory(graph_.num_local_verts_ * sizeof(int32_t) * 50); // TODO: accuracy
+		const int a2a_buffer_size = get_a2a_buffer_size();
+		if(rma_transport_) {
+			// the other processes put the data into the first buffer of the pool
+			a2a_rma_window_ = new RmaAlltoallWindow(mpi.comm_2d, a2a_buffer_size, 2);
+			a2a_comm_buf_.allocate_memory(a2a_buffer_size, a2a_rma_window_->buffer());
+			td_comm_.enable_rma(a2a_rma_window_, 0);
+			bu_comm_.enable_rma(a2a_rma_window_, 1);
+		}
+		else {
+			a2a_comm_buf_.allocate_memory(a2a_buffer_size);
+		}
 
-		top_down_comm_.max_num_rows = graph_.num_local_verts_ * 16 / PRM::TOP_DOWN_PENDING_WIDTH + 1000;
+		top_down_comm_.max_num_rows = graph_.num_local_verts_ * 16 / g_config.top_down_pending_width + 1000;
 		top_down_comm_.tmp_rows = (TopDownRow*)cache_aligned_xmalloc(
 				top_down_comm_.max_num_rows*2*sizeof(TopDownRow)); // for debug
 
 		thread_local_buffer_ = (ThreadLocalBuffer**)cache_aligned_xmalloc(sizeof(thread_local_buffer_[0])*max_threads);
 
-		const int bottom_up_vertex_count_per_thread = (bitmap_width/BU_SUBSTEP + max_threads - 1) / max_threads * NBPE;
+		const int bottom_up_vertex_count_per_thread =
+				NumaLayout::range_width(bitmap_width/BU_SUBSTEP, max_threads) * NBPE;
 		const int packet_buffer_length = std::max(
 				sizeof(LocalPacket) * max_comm_size, // for the top-down and bottom-up list search
 				sizeof(TwodVertex) * 2 * bottom_up_vertex_count_per_thread);
@@ -207,6 +320,7 @@ public:
 		VERVOSE(if(mpi.isMaster()) print_with_prefix("Allocating shared memory: %f GB per node.", to_giga(total_size_of_shared_memory)));
 
 		void* smem_ptr = buffer_.shared_memory_ = shared_malloc(total_size_of_shared_memory);
+		numa_layout_.place_bitmaps(buffer_.shared_memory_, total_size_of_shared_memory);
 
 		get_shared_mem_pointer<BitmapType>(smem_ptr, bitmap_width, (BitmapType**)&new_visited_, NULL);
 		get_shared_mem_pointer<BitmapType>(smem_ptr, bitmap_width, (BitmapType**)&old_visited_, NULL);
@@ -220,9 +334,44 @@ public:
 
 		assert (smem_ptr == (int8_t*)buffer_.shared_memory_ + total_size_of_shared_memory);
 
-		bottom_up_substep_ = new MpiBottomUpSubstepComm(mpi.comm_2dr);
+		if(rma_transport_) {
+			bottom_up_substep_ = new RmaBottomUpSubstepComm(mpi.comm_2dr, mpi.comm_2d,
+					bitmap_width / BU_SUBSTEP * sizeof(BitmapType));
+		}
+		else {
+			bottom_up_substep_ = new MpiBottomUpSubstepComm(mpi.comm_2dr);
+		}
 		bottom_up_substep_->register_memory(buffer_.shared_memory_, total_size_of_shared_memory);
 
+#if BOTTOM_UP_SUMMARY
+		// the summary groups that have no rows never have to be scanned
+		const int64_t row_bitmap_length = bitmap_width * mpi.size_2dc;
+		const int64_t num_groups = (row_bitmap_length + SUMMARY_WORDS - 1) / SUMMARY_WORDS;
+		summary_width_ = (num_groups + NBPE - 1) / NBPE;
+		empty_row_summary_ = (BitmapType*)cache_aligned_xcalloc(summary_width_*sizeof(BitmapType));
+		visited_summary_ = (BitmapType*)cache_aligned_xcalloc(summary_width_*sizeof(BitmapType));
+#pragma omp parallel for
+		for(int64_t word_idx = 0; word_idx < summary_width_; ++word_idx) {
+			BitmapType summary = 0;
+			for(int i = 0; i < NBPE; ++i) {
+				const int64_t grp_start = (word_idx * NBPE + i) * SUMMARY_WORDS;
+				const int64_t grp_end = std::min<int64_t>(grp_start + SUMMARY_WORDS, row_bitmap_length);
+				BitmapType rows = 0;
+				for(int64_t w = grp_start; w < grp_end; ++w) rows |= graph_.row_bitmap_[w];
+				if(rows == 0) summary |= BitmapType(1) << i;
+			}
+			empty_row_summary_[word_idx] = summary;
+		}
+#endif
+
+#if INCREMENTAL_PRED_RESET
+		pred_dirty_ = (uint8_t*)cache_aligned_xmalloc(get_pred_block_count()*sizeof(uint8_t));
+		pred_clean_ = NULL;
+#endif
+#if PRED_REORDERED
+		reordered_pred_ = (int64_t*)cache_aligned_xmalloc(graph_.pred_size()*sizeof(int64_t));
+#endif
+
 		cq_list_ = NULL;
 		global_nq_size_ = max_nq_size_ = nq_size_ = cq_size_ = 0;
 		bitmap_or_list_ = false;
@@ -234,10 +383,85 @@ public:
 	{
 		free(buffer_.thread_local_); buffer_.thread_local_ = NULL;
 		shared_free(buffer_.shared_memory_); buffer_.shared_memory_ = NULL;
+		frontier_codec_.release_buffer();
 		free(thread_local_buffer_); thread_local_buffer_ = NULL;
+		td_comm_.disable_rma();
+		bu_comm_.disable_rma();
 		a2a_comm_buf_.deallocate_memory();
+		delete a2a_rma_window_; a2a_rma_window_ = NULL;
+#if BOTTOM_UP_SUMMARY
+		free(empty_row_summary_); empty_row_summary_ = NULL;
+		free(visited_summary_); visited_summary_ = NULL;
+#endif
+#if INCREMENTAL_PRED_RESET
+		free(pred_dirty_); pred_dirty_ = NULL;
+		pred_clean_ = NULL;
+#endif
+#if PRED_REORDERED
+		free(reordered_pred_); reordered_pred_ = NULL;
+#endif
+	}
+
+#if INCREMENTAL_PRED_RESET
+	int64_t get_pred_block_count() {
+		return (graph_.pred_size() >> PRED_RESET_BLOCK_BITS) + 1;
+	}
+
+	// Records the block of the predecessor array written in the current BFS.
+	void mark_pred_dirty(int64_t orig_local) {
+		uint8_t* flag = pred_dirty_ + (orig_local >> PRED_RESET_BLOCK_BITS);
+		// read first to avoid the false sharing of the flags which are already set
+		if(*flag == 0) *flag = 1;
+	}
+#endif
+
+	// The predecessor array has to be cleared entirely when it is modified out of run_bfs()
+	// (e.g., run_sssp() writes into the same array) or handed out to the caller.
+	// With PRED_REORDERED, the BFS writes into reordered_pred_ which is not exposed.
+	void invalidate_pred() {
+#if INCREMENTAL_PRED_RESET && !PRED_REORDERED
+		pred_clean_ = NULL;
+#endif
+	}
+
+#if PRED_REORDERED
+	// The bottom-up step sends the reordered local vertex of the row instead of orig_vertexes_
+	// so that the receiver writes reordered_pred_ directly.
+	void make_row_locals() {
+		const int64_t L = graph_.num_local_verts_;
+		const int64_t row_bitmap_length = get_bitmap_size_local() * mpi.size_2dc;
+		const int64_t non_zero_rows = graph_.row_sums_[row_bitmap_length];
+		const BitmapType* row_bitmap = graph_.row_bitmap_;
+		const TwodVertex* row_sums = graph_.row_sums_;
+		LocalVertex* row_locals = row_locals_ = (LocalVertex*)
+				cache_aligned_xmalloc(std::max<int64_t>(non_zero_rows, 1)*sizeof(LocalVertex));
+#pragma omp parallel for
+		for(int64_t word_idx = 0; word_idx < row_bitmap_length; ++word_idx) {
+			BitmapType row_bmp_i = row_bitmap[word_idx];
+			TwodVertex non_zero_idx = row_sums[word_idx];
+			while(row_bmp_i != BitmapType(0)) {
+				const int bit_idx = __builtin_ctzl(row_bmp_i);
+				row_bmp_i &= row_bmp_i - 1;
+				// compact index = (source column) * L + local
+				row_locals[non_zero_idx++] = (word_idx * NBPE + bit_idx) % L;
+			}
+		}
 	}
 
+	// Converts reordered_pred_ to the original vertex order.
+	// This is a part of the BFS: run_bfs() calls this before it returns.
+	void write_pred(int64_t* pred) {
+		TRACER(write_pred);
+		const int64_t num_orig_local_vertices = graph_.pred_size();
+		const LocalVertex* reorder_map = graph_.reorder_map_;
+		const int64_t* reordered_pred = reordered_pred_;
+#pragma omp parallel for
+		for(int64_t i = 0; i < num_orig_local_vertices; ++i) {
+			pred[i] = reordered_pred[reorder_map[i]];
+		}
+	}
+#endif
+
 	void initialize_memory(int64_t* pred)
 	{
 		int64_t num_orig_local_vertices = graph_.pred_size();
@@ -250,13 +474,47 @@ public:
 		BitmapType* visited = (BitmapType*)new_visited_;
 		BitmapType* shared_visited = shared_visited_;
 
+#if INCREMENTAL_PRED_RESET
+		// Only the blocks written in the previous BFS are cleared
+		// if the array is not modified after the previous BFS.
+		const bool incremental = (pred == pred_clean_);
+		const int64_t num_pred_blocks = get_pred_block_count();
+		uint8_t* pred_dirty = pred_dirty_;
+		pred_clean_ = pred;
+#endif
+
 #pragma omp parallel
 		{
 #if !INIT_PRED_ONCE	// Only Spec2010 needs this initialization
+#if INCREMENTAL_PRED_RESET
+			if(incremental) {
+#pragma omp for nowait
+				for(int64_t b = 0; b < num_pred_blocks; ++b) {
+					if(pred_dirty[b]) {
+						const int64_t i_end = std::min<int64_t>(num_orig_local_vertices, (b + 1) << PRED_RESET_BLOCK_BITS);
+						for(int64_t i = b << PRED_RESET_BLOCK_BITS; i < i_end; ++i) {
+							pred[i] = -1;
+						}
+						pred_dirty[b] = 0;
+					}
+				}
+			}
+			else {
+#pragma omp for nowait
+				for(int64_t i = 0; i < num_orig_local_vertices; ++i) {
+					pred[i] = -1;
+				}
+#pragma omp for nowait
+				for(int64_t b = 0; b < num_pred_blocks; ++b) {
+					pred_dirty[b] = 0;
+				}
+			}
+#else
 #pragma omp for nowait
 			for(int64_t i = 0; i < num_orig_local_vertices; ++i) {
 				pred[i] = -1;
 			}
+#endif
 #endif
 			// clear NQ and visited
 #pragma omp for nowait
@@ -268,6 +526,12 @@ public:
 			for(int64_t i = 0; i < shared_vis_block; ++i) {
 				shared_visited[shared_vis_off + i] = 0;
 			}
+#if BOTTOM_UP_SUMMARY
+#pragma omp for nowait
+			for(int64_t i = 0; i < summary_width_; ++i) {
+				visited_summary_[i] = empty_row_summary_[i];
+			}
+#endif
 		}
 
 		assert (nq_.stack_.size() == 0);
@@ -281,26 +545,31 @@ public:
 
 	class CommBufferPool {
 	public:
-		void allocate_memory(int size) {
-			first_buffer_ = cache_aligned_xmalloc(size);
+		// first_buffer: the memory for the first buffer (e.g., the RMA window) or NULL to allocate it
+		void allocate_memory(int size, void* first_buffer = NULL) {
+			own_first_buffer_ = (first_buffer == NULL);
+			first_buffer_ = own_first_buffer_ ? cache_aligned_xmalloc(size) : first_buffer;
 			second_buffer_ = cache_aligned_xmalloc(size);
 			current_index_ = 0;
 			pool_buffer_size_ = size;
-			num_buffers_ = size / PRM::COMM_BUFFER_SIZE;
+			buffer_size_ = g_config.comm_buffer_size;
+			num_buffers_ = size / buffer_size_;
 		}
 
 		void deallocate_memory() {
-			free(first_buffer_); first_buffer_ = NULL;
+			if(own_first_buffer_) free(first_buffer_);
+			first_buffer_ = NULL;
 			free(second_buffer_); second_buffer_ = NULL;
 		}
 
 		void* get_next() {
-			int idx = current_index_++;
+			// called concurrently by the sending threads
+			int idx = __sync_fetch_and_add(&current_index_, 1);
 			if(num_buffers_ <= idx) {
 				fprintf(IMD_OUT, "num_buffers_ <= idx (num_buffers=%d)\n", num_buffers_);
 				throw "Error: buffer size not enough";
 			}
-			return (uint8_t*)first_buffer_ + PRM::COMM_BUFFER_SIZE * idx;
+			return (uint8_t*)first_buffer_ + buffer_size_ * idx;
 		}
 
 		void* clear_buffers() {
@@ -316,18 +585,24 @@ public:
 			return pool_buffer_size_;
 		}
 
+		// size of each buffer returned by get_next()
+		int buffer_size() {
+			return buffer_size_;
+		}
+
 	protected:
 		int pool_buffer_size_;
+		int buffer_size_;
 		void* first_buffer_;
+		bool own_first_buffer_;
 		void* second_buffer_;
-		int current_index_;
+		volatile int current_index_;
 		int num_buffers_;
 	};
 
 	template <typename T>
 	class CommHandlerBase : public AlltoallBufferHandler {
 	public:
-		enum { BUF_SIZE = PRM::COMM_BUFFER_SIZE / sizeof(T) };
 		CommHandlerBase(ThisType* this__)
 			: this_(this__)
 			, pool_(&this__->a2a_comm_buf_)
@@ -338,7 +613,7 @@ public:
 		}
 		virtual void add(void* buffer, void* ptr__, int offset, int length) {
 			assert (offset >= 0);
-			assert (offset + length <= BUF_SIZE);
+			assert (offset + length <= buffer_length());
 			memcpy((T*)buffer + offset, ptr__, length*sizeof(T));
 		}
 		virtual void* clear_buffers() {
@@ -351,7 +626,7 @@ public:
 			return this->pool_->pool_buffer_size();
 		}
 		virtual int buffer_length() {
-			return BUF_SIZE;
+			return g_config.comm_buffer_size / sizeof(T);
 		}
 		virtual MPI_Datatype data_type() {
 			return MpiTypeOf<T>::type;
@@ -429,6 +704,32 @@ public:
 		}
 	};
 
+	class SsspCommHandler : public CommHandlerBase<SsspUpdate> {
+	public:
+		SsspCommHandler(ThisType* this__)
+			: CommHandlerBase<SsspUpdate>(this__)
+			, received_(NULL)
+			  { }
+
+		~SsspCommHandler() {
+			delete [] received_; received_ = NULL;
+		}
+
+		virtual void received(void* buf, int offset, int length, int src) {
+			SsspUpdate* updates = (SsspUpdate*)buf + offset;
+			this->this_->sssp_relax(updates, length);
+			// the predecessors are written after all the updates are applied
+			received_[src].ptr = updates;
+			received_[src].length = length;
+		}
+
+		struct ReceivedData {
+			SsspUpdate* ptr;
+			int length;
+		};
+		ReceivedData* received_; // Index: rank in comm_2dc (push) or comm_2dr (pull)
+	};
+
 	/*
 	void do_in_parallel(Runnable* main, Runnable* sub, bool inverse) {
 		if(inverse) {
@@ -495,7 +796,13 @@ public:
 						root_c, mpi.comm_2dr);
 
 				// update pred
+#if PRED_REORDERED
+				pred_[reordered] = root;
+				MARK_PRED_DIRTY(reordered);
+#else
 				pred_[root_local] = root;
+				MARK_PRED_DIRTY(root_local);
+#endif
 
 				// update visited
 				int64_t word_idx = reordered >> LOG_NBPE;
@@ -528,21 +835,30 @@ public:
 			// TODO: asymmetric size for z. (MPI_Allgather -> MPI_Allgatherv or MpiCol::allgatherv ?)
 			int shared_bitmap_width = bitmap_width * mpi.size_z;
 #if ENABLE_MY_ALLGATHER
+			// the codec gathers the bitmap on the same communicator as MY_ALLGATHER
 			if(mpi.isYdimAvailable()) {
-				if(mpi.isMaster()) print_with_prefix("Error: MY_ALLGATHER does not support shared memory Y dimension.");
+				throw_exception("MY_ALLGATHER does not support shared memory Y dimension.");
+			}
+#endif
+			int64_t comm_bytes;
+			if(frontier_codec_.enabled() && frontier_codec_.allgather(bitmap, shared_bitmap_width,
+					recv_buffer, mpi.comm_c, mpi.comm_y, &comm_bytes))
+			{
+				VERVOSE(g_expand_bitmap_comm += comm_bytes);
 			}
+			else {
 #if ENABLE_MY_ALLGATHER == 1
-		MpiCol::my_allgather(bitmap, shared_bitmap_width, recv_buffer, mpi.comm_c);
-#else
-		my_allgather_2d(bitmap, shared_bitmap_width, recv_buffer, mpi.comm_c);
-#endif // #if ENABLE_MY_ALLGATHER == 1
+				MpiCol::my_allgather(bitmap, shared_bitmap_width, recv_buffer, mpi.comm_c);
+#elif ENABLE_MY_ALLGATHER
+				my_allgather_2d(bitmap, shared_bitmap_width, recv_buffer, mpi.comm_c);
 #else
-			MPI_Allgather(bitmap, shared_bitmap_width, get_mpi_type(bitmap[0]),
-					recv_buffer, shared_bitmap_width, get_mpi_type(bitmap[0]), mpi.comm_y);
+				MPI_Allgather(bitmap, shared_bitmap_width, get_mpi_type(bitmap[0]),
+						recv_buffer, shared_bitmap_width, get_mpi_type(bitmap[0]), mpi.comm_y);
 #endif
 #if VERVOSE_MODE
-			g_expand_bitmap_comm += shared_bitmap_width * mpi.size_y * sizeof(BitmapType);
+				g_expand_bitmap_comm += shared_bitmap_width * mpi.size_y * sizeof(BitmapType);
 #endif
+			}
 		}
 		if(mpi.isYdimAvailable()) s_.sync->barrier();
 	}
@@ -554,14 +870,22 @@ public:
 		BitmapType* const bitmap = (BitmapType*)new_visited_;
 		BitmapType* recv_buffer = shared_visited_;
 #if ENABLE_MY_ALLGATHER
+		// the codec gathers the bitmap on the same communicator as MY_ALLGATHER
 		if(mpi.isYdimAvailable()) {
-			if(mpi.isMaster()) print_with_prefix("Error: MY_ALLGATHER does not support shared memory Y dimension.");
+			throw_exception("MY_ALLGATHER does not support shared memory Y dimension.");
+		}
+#endif
+		int64_t comm_bytes;
+		if(frontier_codec_.enabled() && frontier_codec_.allgather(bitmap, bitmap_width,
+				recv_buffer, mpi.comm_r, mpi.comm_2dr, &comm_bytes))
+		{
+			VERVOSE(g_expand_bitmap_comm += comm_bytes);
+			return ;
 		}
 #if ENABLE_MY_ALLGATHER == 1
-	MpiCol::my_allgather(bitmap, bitmap_width, recv_buffer, mpi.comm_r);
-#else
-	my_allgather_2d(bitmap, bitmap_width, recv_buffer, mpi.comm_r);
-#endif // #if ENABLE_MY_ALLGATHER == 1
+		MpiCol::my_allgather(bitmap, bitmap_width, recv_buffer, mpi.comm_r);
+#elif ENABLE_MY_ALLGATHER
+		my_allgather_2d(bitmap, bitmap_width, recv_buffer, mpi.comm_r);
 #else
 		MPI_Allgather(bitmap, bitmap_width, get_mpi_type(bitmap[0]),
 				recv_buffer, bitmap_width, get_mpi_type(bitmap[0]), mpi.comm_2dr);
@@ -959,18 +1283,21 @@ public:
 		assert(start == end);
 	}
 
+	// SEND_LB: TOP_DOWN_SEND_LB (see parameters.h)
+	template <int SEND_LB>
 	void top_down_parallel_section(bool bitmap_or_list) {
 		TRACER(td_par_sec);
 		PROF(profiling::TimeKeeper tk_all);
 		bool clear_packet_buffer = packet_buffer_is_dirty_;
 		packet_buffer_is_dirty_ = false;
 
-#if TOP_DOWN_SEND_LB == 2
-#define IF_LARGE_EDGE if(e_end - e_start > PRM::TOP_DOWN_PENDING_WIDTH/10)
-#define ELSE else
+		// SEND_LB is a constant. The compiler removes unused paths.
+#if COMPRESSED_EDGE_ARRAY
+		// top_down_send_large() passes pointers into the edge array, which must not be compressed.
+#define IF_LARGE_EDGE if(false)
 #else
-#define IF_LARGE_EDGE
-#define ELSE
+		const int64_t large_edge_width = g_config.top_down_pending_width / 10;
+#define IF_LARGE_EDGE if(SEND_LB == 1 || (SEND_LB == 2 && e_end - e_start > large_edge_width))
 #endif
 
 		debug("begin parallel");
@@ -979,10 +1306,10 @@ public:
 			SET_OMP_AFFINITY;
 			PROF(profiling::TimeKeeper tk_all);
 			PROF(profiling::TimeSpan ts_commit);
-			VERVOSE(int64_t num_edge_relax = 0);
+			EDGE_COUNT(int64_t num_edge_relax = 0);
 			VERVOSE(int64_t num_large_edge = 0);
 			//int max_threads = omp_get_num_threads();
-			int64_t* edge_array = graph_.edge_array_;
+			EdgeArrayRef edge_array = graph_.edge_array();
 			LocalPacket* packet_array =
 					thread_local_buffer_[omp_get_thread_num()]->fold_packet;
 			if(clear_packet_buffer) {
@@ -1004,57 +1331,60 @@ public:
 			if(bitmap_or_list) {
 				BitmapType* cq_bitmap = shared_visited_;
 				int64_t bitmap_size = get_bitmap_size_local() * mpi.size_2dc;
-	#pragma omp for
-				for(int64_t word_idx = 0; word_idx < bitmap_size; ++word_idx) {
-					BitmapType cq_bit_i = cq_bitmap[word_idx];
-					if(cq_bit_i == BitmapType(0)) continue;
-
-					BitmapType row_bitmap_i = graph_.row_bitmap_[word_idx];
-					BitmapType bit_flags = cq_bit_i & row_bitmap_i;
-					TwodVertex bmp_row_sums = graph_.row_sums_[word_idx];
-					while(bit_flags != BitmapType(0)) {
-						BitmapType cq_bit = bit_flags & (-bit_flags);
-						BitmapType low_mask = cq_bit - 1;
-						bit_flags &= ~cq_bit;
-						int bit_idx = __builtin_popcountl(low_mask);
-						TwodVertex compact = word_idx * NBPE + bit_idx;
-						TwodVertex src_c = word_idx / get_bitmap_size_local(); // TODO:
-						TwodVertex non_zero_off = bmp_row_sums + __builtin_popcountl(row_bitmap_i & low_mask);
-						int64_t src_orig =
-								int64_t(graph_.orig_vertexes_[non_zero_off]) * P + src_c * R + r;
+				// With the NUMA layout, each thread scans the ranges of the graph placed on its node.
+				int64_t region_width = numa_layout_.enabled() ?
+						get_bitmap_size_local() / BU_SUBSTEP : bitmap_size;
+				int tid = omp_get_thread_num();
+				int num_threads = omp_get_num_threads();
+				for(int64_t region_off = 0; region_off < bitmap_size; region_off += region_width) {
+					int64_t range_start, range_end;
+					NumaLayout::thread_range(region_width, tid, num_threads, &range_start, &range_end);
+					for(int64_t word_idx = region_off + range_start; word_idx < region_off + range_end; ++word_idx) {
+						BitmapType cq_bit_i = cq_bitmap[word_idx];
+						if(cq_bit_i == BitmapType(0)) continue;
+
+						BitmapType row_bitmap_i = graph_.row_bitmap_[word_idx];
+						BitmapType bit_flags = cq_bit_i & row_bitmap_i;
+						TwodVertex bmp_row_sums = graph_.row_sums_[word_idx];
+						while(bit_flags != BitmapType(0)) {
+							BitmapType cq_bit = bit_flags & (-bit_flags);
+							BitmapType low_mask = cq_bit - 1;
+							bit_flags &= ~cq_bit;
+							TwodVertex src_c = word_idx / get_bitmap_size_local(); // TODO:
+							TwodVertex non_zero_off = bmp_row_sums + __builtin_popcountl(row_bitmap_i & low_mask);
+							int64_t src_orig =
+									int64_t(graph_.orig_vertexes_[non_zero_off]) * P + src_c * R + r;
 	#if ISOLATE_FIRST_EDGE
-						top_down_send(graph_.isolated_edges_[non_zero_off], lgl,
-								r_mask, packet_array, src_orig
+							top_down_send(graph_.isolated_edges_[non_zero_off], lgl,
+									r_mask, packet_array, src_orig
 	#if PROFILING_MODE
-						, ts_commit
+							, ts_commit
 	#endif
-							);
+								);
 	#endif // #if ISOLATE_FIRST_EDGE
-						int64_t e_start = graph_.row_starts_[non_zero_off];
-						int64_t e_end = graph_.row_starts_[non_zero_off+1];
-						IF_LARGE_EDGE
-#if TOP_DOWN_SEND_LB > 0
-						{
-							top_down_send_large(edge_array, e_start, e_end, lgl, r_mask, src_orig);
-							VERVOSE(num_large_edge += e_end - e_start);
-						}
-#endif // #if TOP_DOWN_SEND_LB > 0
-						ELSE
-#if TOP_DOWN_SEND_LB != 1
-						{
-							for(int64_t e = e_start; e < e_end; ++e) {
-								top_down_send(edge_array[e], lgl,
-										r_mask, packet_array, src_orig
+							int64_t e_start = graph_.row_starts_[non_zero_off];
+							int64_t e_end = graph_.row_starts_[non_zero_off+1];
+							IF_LARGE_EDGE
+							{
+								top_down_send_large(graph_.edge_array_, e_start, e_end, lgl, r_mask, src_orig);
+								VERVOSE(num_large_edge += e_end - e_start);
+							}
+							else
+							{
+								for(int64_t e = e_start; e < e_end; ++e) {
+									top_down_send(edge_array[e], lgl,
+											r_mask, packet_array, src_orig
 #if PROFILING_MODE
-								, ts_commit
+									, ts_commit
 #endif
-									);
+										);
+								}
 							}
-						}
-#endif // #if TOP_DOWN_SEND_LB != 1
-						VERVOSE(num_edge_relax += e_end - e_start + 1);
-					} // while(bit_flags != BitmapType(0)) {
-				} // #pragma omp for // implicit barrier
+							EDGE_COUNT(num_edge_relax += e_end - e_start + 1);
+						} // while(bit_flags != BitmapType(0)) {
+					} // for(int64_t word_idx
+				} // for(int64_t region_off
+	#pragma omp barrier
 			}
 			else {
 				TwodVertex* cq_list = (TwodVertex*)cq_list_;
@@ -1084,14 +1414,11 @@ public:
 						int64_t e_start = graph_.row_starts_[non_zero_off];
 						int64_t e_end = graph_.row_starts_[non_zero_off+1];
 						IF_LARGE_EDGE
-#if TOP_DOWN_SEND_LB > 0
 						{
-							top_down_send_large(edge_array, e_start, e_end, lgl, r_mask, src_orig);
+							top_down_send_large(graph_.edge_array_, e_start, e_end, lgl, r_mask, src_orig);
 							VERVOSE(num_large_edge += e_end - e_start);
 						}
-#endif // #if TOP_DOWN_SEND_LB > 0
-						ELSE
-#if TOP_DOWN_SEND_LB != 1
+						else
 						{
 							for(int64_t e = e_start; e < e_end; ++e) {
 								top_down_send(edge_array[e], lgl,
@@ -1102,8 +1429,7 @@ public:
 									);
 							}
 						}
-#endif // #if TOP_DOWN_SEND_LB != 1
-						VERVOSE(num_edge_relax += e_end - e_start + 1);
+						EDGE_COUNT(num_edge_relax += e_end - e_start + 1);
 					} // if(row_bitmap_i & mask) {
 				} // #pragma omp for // implicit barrier
 			}
@@ -1127,15 +1453,26 @@ public:
 			PROF(profiling::TimeSpan ts_all; ts_all += tk_all; ts_all -= ts_commit);
 			PROF(extract_edge_time_ += ts_all);
 			PROF(commit_time_ += ts_commit);
-			VERVOSE(__sync_fetch_and_add(&num_edge_top_down_, num_edge_relax));
+			EDGE_COUNT(__sync_fetch_and_add(&num_edge_top_down_, num_edge_relax));
 			VERVOSE(__sync_fetch_and_add(&num_td_large_edge_, num_large_edge));
 		} // #pragma omp parallel reduction(+:num_edge_relax)
 #undef IF_LARGE_EDGE
-#undef ELSE
 		PROF(parallel_reg_time_ += tk_all);
 		debug("finished parallel");
 	}
 
+	void top_down_parallel_section(bool bitmap_or_list) {
+#if COMPRESSED_EDGE_ARRAY
+		top_down_parallel_section<0>(bitmap_or_list);
+#else
+		switch(g_config.top_down_send_lb) {
+		case 0: top_down_parallel_section<0>(bitmap_or_list); break;
+		case 1: top_down_parallel_section<1>(bitmap_or_list); break;
+		default: top_down_parallel_section<2>(bitmap_or_list); break;
+		}
+#endif
+	}
+
 	void top_down_search() {
 		TRACER(td);
 
@@ -1184,7 +1521,9 @@ public:
 			if(buf == NULL) buf = nq_empty_buffer_.get();
 			BitmapType* visited = (BitmapType*)new_visited_;
 			int64_t* restrict const pred = pred_;
+#if !PRED_REORDERED
 			LocalVertex* invert_map = graph_.invert_map_;
+#endif
 
 			// for id converter //
 			int lgl = graph_.local_bits_;
@@ -1216,9 +1555,10 @@ public:
 							const BitmapType mask = BitmapType(1) << bit_idx;
 							if((visited[word_idx] & mask) == 0) { // if this vertex has not visited
 								if((__sync_fetch_and_or(&visited[word_idx], mask) & mask) == 0) {
-									LocalVertex tgt_orig = invert_map[tgt_local];
-									assert (pred[tgt_orig] == -1);
-									pred[tgt_orig] = pred_v;
+									LocalVertex tgt_idx = TD_PRED_INDEX(tgt_local);
+									assert (pred[tgt_idx] == -1);
+									pred[tgt_idx] = pred_v;
+									MARK_PRED_DIRTY(tgt_idx);
 									if(buf->full()) {
 										nq_.push(buf); buf = nq_empty_buffer_.get();
 									}
@@ -1227,9 +1567,10 @@ public:
 							}
 						}
 						else {
-							LocalVertex tgt_orig = invert_map[tgt_local];
-							if(pred[tgt_orig] == -1) {
-								if(__sync_bool_compare_and_swap(&pred[tgt_orig], -1, pred_v)) {
+							LocalVertex tgt_idx = TD_PRED_INDEX(tgt_local);
+							if(pred[tgt_idx] == -1) {
+								if(__sync_bool_compare_and_swap(&pred[tgt_idx], -1, pred_v)) {
+									MARK_PRED_DIRTY(tgt_idx);
 									if(buf->full()) {
 										nq_.push(buf); buf = nq_empty_buffer_.get();
 									}
@@ -1256,8 +1597,11 @@ public:
 		BitmapType* visited = (BitmapType*)new_visited_;
 		int64_t* restrict const pred = pred_;
 		const int cur_level = current_level_;
+		const int pending_width = g_config.top_down_pending_width;
 		int64_t pred_v = -1;
+#if !PRED_REORDERED
 		LocalVertex* invert_map = graph_.invert_map_;
+#endif
 
 		// for id converter //
 		int lgl = graph_.local_bits_;
@@ -1272,7 +1616,7 @@ public:
 				if(v & 0x40000000u) {
 					int length_i = stream[i+2];
 #if TOP_DOWN_RECV_LB
-					if(length_i < PRM::TOP_DOWN_PENDING_WIDTH)
+					if(length_i < pending_width)
 #endif // #if TOP_DOWN_RECV_LB
 					{
 						assert (pred_v != -1);
@@ -1286,9 +1630,10 @@ public:
 								const BitmapType mask = BitmapType(1) << bit_idx;
 								if((visited[word_idx] & mask) == 0) { // if this vertex has not visited
 									if((__sync_fetch_and_or(&visited[word_idx], mask) & mask) == 0) {
-										LocalVertex tgt_orig = invert_map[tgt_local];
-										assert (pred[tgt_orig] == -1);
-										pred[tgt_orig] = pred_v;
+										LocalVertex tgt_idx = TD_PRED_INDEX(tgt_local);
+										assert (pred[tgt_idx] == -1);
+										pred[tgt_idx] = pred_v;
+										MARK_PRED_DIRTY(tgt_idx);
 										if(buf->full()) {
 											nq_.push(buf); buf = nq_empty_buffer_.get();
 										}
@@ -1297,9 +1642,10 @@ public:
 								}
 							}
 							else {
-								LocalVertex tgt_orig = invert_map[tgt_local];
-								if(pred[tgt_orig] == -1) {
-									if(__sync_bool_compare_and_swap(&pred[tgt_orig], -1, pred_v)) {
+								LocalVertex tgt_idx = TD_PRED_INDEX(tgt_local);
+								if(pred[tgt_idx] == -1) {
+									if(__sync_bool_compare_and_swap(&pred[tgt_idx], -1, pred_v)) {
+										MARK_PRED_DIRTY(tgt_idx);
 										if(buf->full()) {
 											nq_.push(buf); buf = nq_empty_buffer_.get();
 										}
@@ -1336,9 +1682,10 @@ public:
 					const BitmapType mask = BitmapType(1) << bit_idx;
 					if((visited[word_idx] & mask) == 0) { // if this vertex has not visited
 						if((__sync_fetch_and_or(&visited[word_idx], mask) & mask) == 0) {
-							LocalVertex tgt_orig = invert_map[tgt_local];
-							assert (pred[tgt_orig] == -1);
-							pred[tgt_orig] = pred_v;
+							LocalVertex tgt_idx = TD_PRED_INDEX(tgt_local);
+							assert (pred[tgt_idx] == -1);
+							pred[tgt_idx] = pred_v;
+							MARK_PRED_DIRTY(tgt_idx);
 							if(buf->full()) {
 								nq_.push(buf); buf = nq_empty_buffer_.get();
 							}
@@ -1347,9 +1694,10 @@ public:
 					}
 				}
 				else {
-					LocalVertex tgt_orig = invert_map[tgt_local];
-					if(pred[tgt_orig] == -1) {
-						if(__sync_bool_compare_and_swap(&pred[tgt_orig], -1, pred_v)) {
+					LocalVertex tgt_idx = TD_PRED_INDEX(tgt_local);
+					if(pred[tgt_idx] == -1) {
+						if(__sync_bool_compare_and_swap(&pred[tgt_idx], -1, pred_v)) {
+							MARK_PRED_DIRTY(tgt_idx);
 							if(buf->full()) {
 								nq_.push(buf); buf = nq_empty_buffer_.get();
 							}
@@ -1440,7 +1788,7 @@ public:
 
 	void flush_bottom_up_send_buffer(LocalPacket* buffer, int target_rank) {
 		TRACER(flush);
-		int bulk_send_size = BottomUpCommHandler::BUF_SIZE;
+		int bulk_send_size = bottom_up_comm_.buffer_length();
 		for(int offset = 0; offset < buffer->length; offset += bulk_send_size) {
 			int length = std::min(buffer->length - offset, bulk_send_size);
 			bu_comm_.put(buffer->data.b + offset, length, target_rank);
@@ -1461,7 +1809,7 @@ public:
 		};
 		int target_rank = phase_bmp_off / half_bitmap_width / 2;
 		int visited_count = 0;
-		VERVOSE(int tmp_edge_relax = 0);
+		EDGE_COUNT(int tmp_edge_relax = 0);
 		PROF(profiling::TimeKeeper tk_all);
 		PROF(profiling::TimeSpan ts_commit);
 		ThreadLocalBuffer* tlb = thread_local_buffer_[omp_get_thread_num()];
@@ -1559,12 +1907,12 @@ public:
 							buf->append_nocheck(src[s], blk_vertex_base + orig);
 #endif // #if STREAM_UPDATE
 							// end this row
-							VERVOSE(tmp_edge_relax += c + 1);
+							EDGE_COUNT(tmp_edge_relax += c + 1);
 							cur_rows[s] = rows[--num_active_rows];
 						}
 						else if(cur_rows[s].sorted >= next_col_len) {
 							// end this row
-							VERVOSE(tmp_edge_relax += c + 1);
+							EDGE_COUNT(tmp_edge_relax += c + 1);
 							cur_rows[s] = rows[--num_active_rows];
 						}
 					}
@@ -1607,12 +1955,12 @@ public:
 							buf->append_nocheck(src[s], blk_vertex_base + orig);
 #endif // #if STREAM_UPDATE
 							// end this row
-							VERVOSE(tmp_edge_relax += c + 1);
+							EDGE_COUNT(tmp_edge_relax += c + 1);
 							cur_rows[s] = rows[--num_active_rows];
 						}
 						else if(cur_rows[s].sorted >= next_col_len) {
 							// end this row
-							VERVOSE(tmp_edge_relax += c + 1);
+							EDGE_COUNT(tmp_edge_relax += c + 1);
 							cur_rows[s] = rows[--num_active_rows];
 						}
 					}
@@ -1643,12 +1991,12 @@ public:
 						buf->append_nocheck(src, blk_vertex_base + orig);
 #endif // #if STREAM_UPDATE
 						// end this row
-						VERVOSE(tmp_edge_relax += c + 1);
+						EDGE_COUNT(tmp_edge_relax += c + 1);
 						rows[i] = rows[--num_active_rows];
 					}
 					else if(row >= next_col_len) {
 						// end this row
-						VERVOSE(tmp_edge_relax += c + 1);
+						EDGE_COUNT(tmp_edge_relax += c + 1);
 						rows[i] = rows[--num_active_rows];
 					}
 				}
@@ -1673,7 +2021,7 @@ public:
 			visited_count += nq_.stack_[i]->length;
 		}
 #endif
-		VERVOSE(__sync_fetch_and_add(&num_edge_bottom_up_, tmp_edge_relax));
+		EDGE_COUNT(__sync_fetch_and_add(&num_edge_bottom_up_, tmp_edge_relax));
 		USER_END(bu_bmp_step);
 		thread_sync_.barrier();
 		return visited_count;
@@ -1783,12 +2131,12 @@ public:
 						buf->append_nocheck(src, blk_vertex_base + orig);
 #endif
 						// end this row
-						VERVOSE(tmp_edge_relax += c + 1);
+						EDGE_COUNT(tmp_edge_relax += c + 1);
 						rows[i] = rows[--num_active_rows];
 					}
 					else if(row >= next_col_len) {
 						// end this row
-						VERVOSE(tmp_edge_relax += c + 1);
+						EDGE_COUNT(tmp_edge_relax += c + 1);
 						rows[i] = rows[--num_active_rows];
 						++num_enabled;
 					}
@@ -1829,7 +2177,7 @@ public:
 		PROF(extract_edge_time_ += ts_all);
 		PROF(commit_time_ += ts_commit);
 		VERVOSE(__sync_fetch_and_add(&num_blocks, tmp_num_blocks));
-		VERVOSE(__sync_fetch_and_add(&num_edge_bottom_up_, tmp_edge_relax));
+		EDGE_COUNT(__sync_fetch_and_add(&num_edge_bottom_up_, tmp_edge_relax));
 		thread_sync_.barrier();
 		return phase_size - th_offset[max_threads];
 	}
@@ -1843,7 +2191,7 @@ public:
 			int phase_bmp_off,
 			LocalPacket* buffer)
 	{
-		VERVOSE(int tmp_edge_relax = 0);
+		EDGE_COUNT(int tmp_edge_relax = 0);
 
 		int lgl = graph_.local_bits_;
 		TwodVertex L = graph_.num_local_verts_;
@@ -1855,53 +2203,128 @@ public:
 		const TwodVertex* __restrict__ row_sums = graph_.row_sums_;
 		const int64_t* __restrict__ isolated_edges = graph_.isolated_edges_;
 		const int64_t* __restrict__ row_starts = graph_.row_starts_;
+#if PRED_REORDERED
+		const LocalVertex* __restrict__ orig_vertexes = row_locals_;
+#else
 		const LocalVertex* __restrict__ orig_vertexes = graph_.orig_vertexes_;
-		const int64_t* __restrict__ edge_array = graph_.edge_array_;
+#endif
+		const EdgeArrayRef edge_array = graph_.edge_array();
 
 		//TwodVertex lmask = (TwodVertex(1) << lgl) - 1;
 		int num_send = 0;
 #if CONSOLIDATE_IFE_PROC
-		for(int64_t blk_bmp_off = off_start; blk_bmp_off < off_end; ++blk_bmp_off) {
-			BitmapType row_bmp_i = *(row_bitmap + phase_bmp_off + blk_bmp_off);
-			BitmapType visited_i = *(phase_bitmap + blk_bmp_off);
-			TwodVertex bmp_row_sums = *(row_sums + phase_bmp_off + blk_bmp_off);
-			BitmapType bit_flags = (~visited_i) & row_bmp_i;
-			while(bit_flags != BitmapType(0)) {
-				BitmapType vis_bit = bit_flags & (-bit_flags);
-				BitmapType mask = vis_bit - 1;
-				bit_flags &= ~vis_bit;
-				int idx = __builtin_popcountl(mask);
-				TwodVertex non_zero_idx = bmp_row_sums + __builtin_popcountl(row_bmp_i & mask);
-				LocalVertex tgt_orig = orig_vertexes[non_zero_idx];
-				// short cut
-				int64_t src = isolated_edges[non_zero_idx];
-				TwodVertex bit_idx = SeparatedId(SeparatedId(src).low(r_bits + lgl)).compact(lgl, L);
-				if(shared_visited[bit_idx >> PRM::LOG_NBPE] & (BitmapType(1) << (bit_idx & PRM::NBPE_MASK))) {
-					// add to next queue
-					visited_i |= vis_bit;
-					buffer->data.b[num_send++] = ((src >> lgl) << orig_lgl) | tgt_orig;
-					// end this row
-					VERVOSE(tmp_edge_relax += 1);
-					continue;
-				}
-				int64_t e_start = row_starts[non_zero_idx];
-				int64_t e_end = row_starts[non_zero_idx+1];
-				for(int64_t e = e_start; e < e_end; ++e) {
-					int64_t src = edge_array[e];
-					TwodVertex bit_idx = SeparatedId(SeparatedId(src).low(r_bits + lgl)).compact(lgl, L);
-					if(shared_visited[bit_idx >> PRM::LOG_NBPE] & (BitmapType(1) << (bit_idx & PRM::NBPE_MASK))) {
-						// add to next queue
-						visited_i |= vis_bit;
-						buffer->data.b[num_send++] = ((src >> lgl) << orig_lgl) | tgt_orig;
-						// end this row
-						VERVOSE(tmp_edge_relax += e - e_start + 1);
-						break;
-					}
-				}
-			} // while(bit_flags != BitmapType(0)) {
-			// write back
-			*(phase_bitmap + blk_bmp_off) = visited_i;
-		} // #pragma omp for
+#if BOTTOM_UP_SIMD
+		BottomUpScanArgs scan_args;
+		if(bottom_up_scan_kernel_ != NULL) {
+			scan_args.lgl = lgl;
+			scan_args.r_bits = r_bits;
+			scan_args.orig_lgl = orig_lgl;
+			scan_args.L = L;
+			scan_args.phase_bmp_off = phase_bmp_off;
+			scan_args.phase_bitmap = phase_bitmap;
+			scan_args.row_bitmap = row_bitmap;
+			scan_args.shared_visited = shared_visited;
+			scan_args.row_sums = row_sums;
+			scan_args.isolated_edges = isolated_edges;
+			scan_args.row_starts = row_starts;
+			scan_args.orig_vertexes = orig_vertexes;
+			scan_args.edge_array = edge_array;
+			scan_args.send_buffer = buffer->data.b;
+			scan_args.num_send = 0;
+			scan_args.edge_relax = 0;
+		}
+#endif
+#if BOTTOM_UP_SUMMARY
+		// The blocks are scanned by the groups of SUMMARY_WORDS words.
+		// Since the visited bitmap only grows in a BFS, a group which has no unvisited row
+		// is skipped in the following levels.
+		for(int64_t grp_start = off_start; grp_start < off_end; ) {
+			const int64_t grp_idx = (phase_bmp_off + grp_start) >> LOG_SUMMARY_WORDS;
+			const int64_t grp_end = std::min<int64_t>(off_end,
+					((grp_idx + 1) << LOG_SUMMARY_WORDS) - phase_bmp_off);
+			const BitmapType grp_bit = BitmapType(1) << (grp_idx & NBPE_MASK);
+			if(visited_summary_[grp_idx >> LOG_NBPE] & grp_bit) {
+				grp_start = grp_end;
+				continue;
+			}
+			const int64_t scan_start = grp_start;
+			const int64_t scan_end = grp_end;
+			BitmapType unvisited_rows = 0;
+#else
+		{
+			const int64_t scan_start = off_start;
+			const int64_t scan_end = off_end;
+#endif
+#if BOTTOM_UP_SIMD
+			if(bottom_up_scan_kernel_ != NULL) {
+#if BOTTOM_UP_SUMMARY
+				unvisited_rows = bottom_up_scan_kernel_(&scan_args, scan_start, scan_end);
+#else
+				bottom_up_scan_kernel_(&scan_args, scan_start, scan_end);
+#endif
+			}
+			else
+#endif
+			{
+				for(int64_t blk_bmp_off = scan_start; blk_bmp_off < scan_end; ++blk_bmp_off) {
+					BitmapType row_bmp_i = *(row_bitmap + phase_bmp_off + blk_bmp_off);
+					BitmapType visited_i = *(phase_bitmap + blk_bmp_off);
+					TwodVertex bmp_row_sums = *(row_sums + phase_bmp_off + blk_bmp_off);
+					BitmapType bit_flags = (~visited_i) & row_bmp_i;
+					while(bit_flags != BitmapType(0)) {
+						BitmapType vis_bit = bit_flags & (-bit_flags);
+						BitmapType mask = vis_bit - 1;
+						bit_flags &= ~vis_bit;
+						int idx = __builtin_popcountl(mask);
+						TwodVertex non_zero_idx = bmp_row_sums + __builtin_popcountl(row_bmp_i & mask);
+						LocalVertex tgt_orig = orig_vertexes[non_zero_idx];
+						// short cut
+						int64_t src = isolated_edges[non_zero_idx];
+						TwodVertex bit_idx = SeparatedId(SeparatedId(src).low(r_bits + lgl)).compact(lgl, L);
+						if(shared_visited[bit_idx >> PRM::LOG_NBPE] & (BitmapType(1) << (bit_idx & PRM::NBPE_MASK))) {
+							// add to next queue
+							visited_i |= vis_bit;
+							buffer->data.b[num_send++] = ((src >> lgl) << orig_lgl) | tgt_orig;
+							// end this row
+							EDGE_COUNT(tmp_edge_relax += 1);
+							continue;
+						}
+						int64_t e_start = row_starts[non_zero_idx];
+						int64_t e_end = row_starts[non_zero_idx+1];
+						for(int64_t e = e_start; e < e_end; ++e) {
+							int64_t src = edge_array[e];
+							TwodVertex bit_idx = SeparatedId(SeparatedId(src).low(r_bits + lgl)).compact(lgl, L);
+							if(shared_visited[bit_idx >> PRM::LOG_NBPE] & (BitmapType(1) << (bit_idx & PRM::NBPE_MASK))) {
+								// add to next queue
+								visited_i |= vis_bit;
+								buffer->data.b[num_send++] = ((src >> lgl) << orig_lgl) | tgt_orig;
+								// end this row
+								EDGE_COUNT(tmp_edge_relax += e - e_start + 1);
+								break;
+							}
+						}
+					} // while(bit_flags != BitmapType(0)) {
+					// write back
+					*(phase_bitmap + blk_bmp_off) = visited_i;
+#if BOTTOM_UP_SUMMARY
+					unvisited_rows |= (~visited_i) & row_bmp_i;
+#endif
+				} // #pragma omp for
+			}
+#if BOTTOM_UP_SUMMARY
+			// only the whole group can be marked
+			if(unvisited_rows == 0 && grp_end - grp_start == SUMMARY_WORDS) {
+				__sync_fetch_and_or(&visited_summary_[grp_idx >> LOG_NBPE], grp_bit);
+			}
+			grp_start = grp_end;
+#endif
+		}
+#if BOTTOM_UP_SIMD
+		if(bottom_up_scan_kernel_ != NULL) {
+			num_send = scan_args.num_send;
+			EDGE_COUNT(tmp_edge_relax = scan_args.edge_relax);
+		}
+#endif
 
 #else // #if CONSOLIDATE_IFE_PROC
 		for(int64_t blk_bmp_off = off_start; blk_bmp_off < off_end; ++blk_bmp_off) {
@@ -1963,7 +2386,7 @@ public:
 #endif // #if CONSOLIDATE_IFE_PROC
 
 		buffer->length = num_send;
-		VERVOSE(__sync_fetch_and_add(&num_edge_bottom_up_, tmp_edge_relax));
+		EDGE_COUNT(__sync_fetch_and_add(&num_edge_bottom_up_, tmp_edge_relax));
 	}
 
 	// returns the number of vertices found in this step.
@@ -1993,13 +2416,11 @@ public:
 		int tid = omp_get_thread_num();
 		int num_threads = omp_get_num_threads();
 
-#if 1 // dynamic partitioning
 		int visited_count = 0;
-		int block_width = step_bitmap_width / 40 + 1;
-		while(true) {
-			int off_start = __sync_fetch_and_add(process_counter, block_width);
-			if(off_start >= step_bitmap_width) break; // finish
-			int off_end = std::min(step_bitmap_width, off_start + block_width);
+		if(numa_layout_.enabled()) {
+			// static partitioning: the same ranges as the graph placement
+			int64_t off_start, off_end;
+			NumaLayout::thread_range(step_bitmap_width, tid, num_threads, &off_start, &off_end);
 
 			bottom_up_search_bitmap_process_block(phase_bitmap,
 					off_start, off_end, phase_bmp_off, buffer);
@@ -2015,20 +2436,35 @@ public:
 
 			PROF(commit_time_ += tk_all);
 		}
-#else // static partitioning
-		int width_per_thread = (step_bitmap_width + num_threads - 1) / num_threads;
-		int off_start = std::min(step_bitmap_width, width_per_thread * tid);
-		int off_end = std::min(step_bitmap_width, off_start + width_per_thread);
+		else {
+			// dynamic partitioning
+			int block_width = step_bitmap_width / 40 + 1;
+#if BOTTOM_UP_SUMMARY
+			// align the blocks to the summary groups
+			if(step_bitmap_width % SUMMARY_WORDS == 0) {
+				block_width = roundup<int>(block_width, SUMMARY_WORDS);
+			}
+#endif
+			while(true) {
+				int off_start = __sync_fetch_and_add(process_counter, block_width);
+				if(off_start >= step_bitmap_width) break; // finish
+				int off_end = std::min(step_bitmap_width, off_start + block_width);
 
-		bottom_up_search_bitmap_process_block(phase_bitmap,
-				off_start, off_end, phase_bmp_off, buffer);
-		PROF(extract_edge_time_ += tk_all);
+				bottom_up_search_bitmap_process_block(phase_bitmap,
+						off_start, off_end, phase_bmp_off, buffer);
+				PROF(extract_edge_time_ += tk_all);
 
-		int visited_count = buffer->length / 2;
-		flush_bottom_up_send_buffer(buffer, target_rank);
+				if(tid == 0) {
+					// process async communication
+					bottom_up_substep_->probe();
+				}
 
-		PROF(commit_time_ += tk_all);
-#endif
+				visited_count += buffer->length;
+				flush_bottom_up_send_buffer(buffer, target_rank);
+
+				PROF(commit_time_ += tk_all);
+			}
+		}
 		USER_END(bu_bmp_step);
 
 		thread_sync_.barrier();
@@ -2060,7 +2496,7 @@ public:
 		int orig_lgl = graph_.orig_local_bits_;
 		//TwodVertex phase_vertex_off = L / BU_SUBSTEP * (data.tag.region_id % BU_SUBSTEP);
 		VERVOSE(int tmp_num_blocks = 0);
-		VERVOSE(int tmp_edge_relax = 0);
+		EDGE_COUNT(int tmp_edge_relax = 0);
 		PROF(profiling::TimeKeeper tk_all);
 		PROF(profiling::TimeSpan ts_commit);
 		int tid = omp_get_thread_num();
@@ -2068,6 +2504,7 @@ public:
 		LocalPacket* buffer = tlb->fold_packet;
 		assert (buffer->length == 0);
 		int num_send = 0;
+		const EdgeArrayRef edge_array = graph_.edge_array();
 
 		int64_t begin, end;
 		get_partition(data.tag.length, phase_list, LOG_BFELL_SORT, max_threads, tid, begin, end);
@@ -2089,7 +2526,11 @@ public:
 				if(row_bitmap_i & vis_bit) { // I have edges for this vertex ?
 					TwodVertex non_zero_idx = phase_row_sums[word_idx] +
 							__builtin_popcountl(row_bitmap_i & (vis_bit-1));
+#if PRED_REORDERED
+					LocalVertex tgt_orig = row_locals_[non_zero_idx];
+#else
 					LocalVertex tgt_orig = graph_.orig_vertexes_[non_zero_idx];
+#endif
 #if ISOLATE_FIRST_EDGE
 					int64_t src = graph_.isolated_edges_[non_zero_idx];
 					TwodVertex bit_idx = SeparatedId(SeparatedId(src).low(r_bits + lgl)).compact(lgl, L);
@@ -2098,21 +2539,21 @@ public:
 						vertex_enabled[i] = 0; --num_enabled;
 						buffer->data.b[num_send++] = ((src >> lgl) << orig_lgl) | tgt_orig;
 						// end this row
-						VERVOSE(tmp_edge_relax += 1);
+						EDGE_COUNT(tmp_edge_relax += 1);
 						continue;
 					}
 #endif // #if ISOLATE_FIRST_EDGE
 					int64_t e_start = graph_.row_starts_[non_zero_idx];
 					int64_t e_end = graph_.row_starts_[non_zero_idx+1];
 					for(int64_t e = e_start; e < e_end; ++e) {
-						int64_t src = graph_.edge_array_[e];
+						int64_t src = edge_array[e];
 						TwodVertex bit_idx = SeparatedId(SeparatedId(src).low(r_bits + lgl)).compact(lgl, L);
 						if(shared_visited_[bit_idx >> LOG_NBPE] & (BitmapType(1) << (bit_idx & NBPE_MASK))) {
 							// add to next queue
 							vertex_enabled[i] = 0; --num_enabled;
 							buffer->data.b[num_send++] = ((src >> lgl) << orig_lgl) | tgt_orig;
 							// end this row
-							VERVOSE(tmp_edge_relax += e - e_start + 1);
+							EDGE_COUNT(tmp_edge_relax += e - e_start + 1);
 							break;
 						}
 					}
@@ -2151,7 +2592,7 @@ public:
 		flush_bottom_up_send_buffer(buffer, target_rank);
 		PROF(commit_time_ += tk_all);
 		VERVOSE(__sync_fetch_and_add(&num_blocks, tmp_num_blocks));
-		VERVOSE(__sync_fetch_and_add(&num_edge_bottom_up_, tmp_edge_relax));
+		EDGE_COUNT(__sync_fetch_and_add(&num_edge_bottom_up_, tmp_edge_relax));
 		thread_sync_.barrier();
 		return data.tag.length - th_offset[max_threads];
 	}
@@ -2479,6 +2920,9 @@ public:
 						cshifted + (pred_dst & r_mask)) | levelshifted;
 				assert (this_->pred_[tgt_local] == -1);
 				pred[tgt_local] = pred_v;
+#if INCREMENTAL_PRED_RESET
+				this_->mark_pred_dirty(tgt_local);
+#endif
 			}
 
 			PROF(this_->recv_proc_thread_time_ += tk_all);
@@ -2522,9 +2966,7 @@ public:
 		PRINT_VAL("%d", BFELL);
 
 		PRINT_VAL("%d", VERTEX_REORDERING);
-		PRINT_VAL("%d", TOP_DOWN_SEND_LB);
 		PRINT_VAL("%d", TOP_DOWN_RECV_LB);
-		PRINT_VAL("%d", BOTTOM_UP_OVERLAP_PFS);
 
 		PRINT_VAL("%d", ISOLATE_FIRST_EDGE);
 		PRINT_VAL("%d", CONSOLIDATE_IFE_PROC);
@@ -2538,18 +2980,16 @@ public:
 		PRINT_VAL("%d", PRINT_BT_SIGNAL);
 #endif
 		PRINT_VAL("%d", PACKET_LENGTH);
-		PRINT_VAL("%d", COMM_BUFFER_SIZE);
 		PRINT_VAL("%d", SEND_BUFFER_LIMIT);
 		PRINT_VAL("%d", BOTTOM_UP_BUFFER);
 		PRINT_VAL("%d", NBPE);
 		PRINT_VAL("%d", BFELL_SORT);
-		PRINT_VAL("%f", DENOM_TOPDOWN_TO_BOTTOMUP);
-		PRINT_VAL("%f", DEMON_BOTTOMUP_TO_TOPDOWN);
-		PRINT_VAL("%f", DENOM_BITMAP_TO_LIST);
+		PRINT_VAL("%d", ADAPTIVE_DIRECTION_SWITCH);
 
 		PRINT_VAL("%d", VALIDATION_LEVEL);
 		PRINT_VAL("%d", SGI_OMPLACE_BUG);
 #undef PRINT_VAL
+		g_config.print();
 
 		if(NUM_BFS_ROOTS == 64 && VALIDATION_LEVEL == 2)
 			print_with_prefix("===== Benchmark Mode OK ====");
@@ -2566,17 +3006,96 @@ public:
 				diff_percent(max[idx], sum[idx], mpi.size_2d));
 	}
 #endif
-	void prepare_sssp() { }
-	void run_sssp(int64_t root, int64_t* pred) { }
-	void end_sssp() { }
+
+	//-------------------------------------------------------------//
+	// SSSP (delta-stepping)
+	//-------------------------------------------------------------//
+	// The vertices are processed in buckets of width delta (SSSP_DELTA).
+	// Light phase: the light edges (weight < delta) of the vertices in the current bucket
+	//   whose distances are updated are relaxed until no vertex enters the bucket.
+	// Heavy phase: the heavy edges of the vertices settled in the bucket are relaxed once.
+	// In each phase, the frontier (vertex, distance) is gathered along the processor row and
+	// (target, distance, parent) updates are sent to the owners of the targets with sssp_comm_.
+	// The relaxations are sent in rounds so that the updates fit into the communication buffer.
+	// When the frontier is large compared with the unsettled vertices, the phase pulls instead:
+	// the distances of the frontier are gathered along the processor column, each process scans
+	// the edges of its rows whose distances can be improved and sends the best (distance, parent)
+	// of each row to the owner of the row with sssp_pull_comm_.
+	// prepare_sssp() uses a2a_comm_buf_, so this must not be used together with prepare_bfs().
+
+	enum {
+		SSSP_CHANGED = 1, // the distance is updated and the edges are not relaxed with it
+		SSSP_QUEUED = 2, // in sssp_queue_ (the next light phase)
+		SSSP_HEAVY = 4, // in sssp_heavy_ (the heavy phase of the current bucket)
+
+		SSSP_PACKET_LENGTH = PRM::PACKET_LENGTH / sizeof(SsspUpdate),
+	};
+
+	struct SsspEdge {
+		TwodVertex tgt; // (rank in comm_2dc << local_bits_) | reordered local vertex
+		float weight;
+		bool operator<(const SsspEdge& o) const { return weight < o.weight; }
+	};
+
+	// the frontier row of this process
+	struct SsspRow {
+		int64_t edge_begin; // Index: sssp_edges_
+		int64_t src; // original vertex id
+		float dist;
+	};
+
+	struct SsspPacket {
+		int length;
+		SsspUpdate data[SSSP_PACKET_LENGTH];
+	};
+
+	void prepare_sssp();
+	/**
+	 * @param root [in] UNSWIZZLED and ORIGINAL vertex id
+	 * @param pred [out] original vertex id of the predecessor or -1 if not reached
+	 * @param dist [out] distance from the root or -1 if not reached
+	 */
+	void run_sssp(int64_t root, int64_t* pred, float* dist);
+	void end_sssp();
+
+	void sssp_construct_graph();
+	bool sssp_next_bucket();
+	int64_t sssp_relax_phase(bool light);
+	void sssp_send_relaxations(int64_t edge_begin, int64_t edge_end, int num_rows);
+	void sssp_pull_phase(bool light, int num_send);
+	void sssp_pull_relaxations(bool light, float frontier_min, int64_t word_begin, int64_t word_end);
+	void sssp_relax(SsspUpdate* updates, int length);
+	void sssp_write_pred(int num_src);
+
+	// Finds the light or heavy edges of the row in sssp_edges_.
+	// Returns false if the row has no such edges in this process.
+	bool sssp_row_range(TwodVertex compact, bool light, TwodVertex* non_zero_off, int64_t* begin, int64_t* end) {
+		const int64_t word_idx = compact >> LOG_NBPE;
+		const BitmapType row_bits = graph_.row_bitmap_[word_idx];
+		const BitmapType mask = BitmapType(1) << (compact & NBPE_MASK);
+		if((row_bits & mask) == 0) return false;
+		const TwodVertex off = graph_.row_sums_[word_idx] + __builtin_popcountl(row_bits & (mask - 1));
+		*non_zero_off = off;
+		*begin = light ? sssp_row_starts_[off] : sssp_light_ends_[off];
+		*end = light ? sssp_light_ends_[off] : sssp_row_starts_[off + 1];
+		return *begin < *end;
+	}
 
 	// members
 	MpiBottomUpSubstepComm* bottom_up_substep_;
+	bool rma_transport_;
+#if BOTTOM_UP_SIMD
+	BottomUpScanKernel bottom_up_scan_kernel_;
+#endif
+	RmaAlltoallWindow* a2a_rma_window_;
 	CommBufferPool a2a_comm_buf_;
 	TopDownCommHandler top_down_comm_;
 	BottomUpCommHandler bottom_up_comm_;
 	AsyncAlltoallManager td_comm_;
 	AsyncAlltoallManager bu_comm_;
+	SsspCommHandler sssp_comm_handler_;
+	AsyncAlltoallManager sssp_comm_;
+	AsyncAlltoallManager sssp_pull_comm_;
 	ThreadLocalBuffer** thread_local_buffer_;
 	memory::ConcurrentPool<QueuedVertexes> nq_empty_buffer_;
 	memory::ConcurrentStack<QueuedVertexes*> nq_;
@@ -2584,6 +3103,12 @@ public:
 	// switch parameters
 	double denom_to_bottom_up_; // alpha
 	double denom_bitmap_to_list_; // gamma
+#if ADAPTIVE_DIRECTION_SWITCH
+	DirectionSwitchPolicy switch_policy_;
+#endif
+	NumaLayout numa_layout_;
+	LevelTrace level_trace_;
+	FrontierCodec frontier_codec_;
 
 	// cq_list_ is a pointer to work_buf_ or work_extra_buf_
 	TwodVertex* cq_list_;
@@ -2612,9 +3137,23 @@ public:
 	int64_t work_extra_buf_size_;
 
 	BitmapType* shared_visited_; // shared memory
+#if BOTTOM_UP_SUMMARY
+	// 1 bit for each SUMMARY_WORDS words of the row bitmap
+	BitmapType* empty_row_summary_; // the group has no rows
+	BitmapType* visited_summary_; // the group has no unvisited rows in the current BFS
+	int64_t summary_width_;
+#endif
 	TwodVertex* nq_recv_buf_; // shared memory (memory space is shared with work_buf_)
 
 	int64_t* pred_; // passed from main method
+#if INCREMENTAL_PRED_RESET
+	uint8_t* pred_dirty_; // one flag per (1 << PRED_RESET_BLOCK_BITS) elements of pred_
+	int64_t* pred_clean_; // the array which has -1 except the dirty blocks
+#endif
+#if PRED_REORDERED
+	int64_t* reordered_pred_; // Index: reordered local vertex, converted by write_pred() in run_bfs()
+	LocalVertex* row_locals_; // Index: CSI, the reordered local vertex of the row
+#endif
 
 	struct SharedDataSet {
 		memory::SpinBarrier *sync;
@@ -2628,9 +3167,9 @@ public:
 	bool packet_buffer_is_dirty_;
 	memory::SpinBarrier thread_sync_;
 
-	VERVOSE(int64_t num_edge_top_down_);
+	EDGE_COUNT(int64_t num_edge_top_down_);
 	VERVOSE(int64_t num_td_large_edge_);
-	VERVOSE(int64_t num_edge_bottom_up_);
+	EDGE_COUNT(int64_t num_edge_bottom_up_);
 	struct {
 		void* thread_local_;
 		void* shared_memory_;
@@ -2646,6 +3185,37 @@ public:
 	PROF(profiling::TimeSpan recv_proc_thread_time_);
 	PROF(profiling::TimeSpan recv_proc_thread_large_time_);
 	PROF(profiling::TimeSpan gather_nq_time_);
+
+	// SSSP
+	// sorted by the weight in each row, Index: CSI
+	int64_t* sssp_row_starts_;
+	int64_t* sssp_light_ends_; // the first heavy edge of each row
+	SsspEdge* sssp_edges_;
+	float sssp_delta_;
+	float sssp_upper_; // the end of the current bucket
+	int64_t sssp_round_edges_; // max number of edges relaxed in one round of sssp_comm_
+	// Index: reordered local vertex
+	float* sssp_dist_;
+	uint8_t* sssp_flags_;
+	// reordered local vertices
+	TwodVertex* sssp_queue_;
+	TwodVertex* sssp_heavy_;
+	volatile int sssp_queue_size_;
+	volatile int sssp_heavy_size_;
+	SsspVertex* sssp_send_frontier_;
+	SsspVertex* sssp_recv_frontier_; // gathered along the processor row
+	SsspRow* sssp_rows_;
+	int64_t* sssp_row_edge_offsets_; // exclusive prefix sum of the edges of sssp_rows_
+	SsspPacket* sssp_packets_; // max_threads * max(size_2dr, size_2dc)
+	bool sssp_pull_enabled_;
+	int64_t sssp_pull_round_rows_; // max number of rows updated in one round of sssp_pull_comm_
+	int64_t sssp_unsettled_; // global number of the vertices whose distances are not settled
+	LocalVertex* sssp_col_invert_map_; // invert_map_ of the processor column
+	float* sssp_frontier_dist_; // the distances of the frontier (SSSP_UNREACHED for the others)
+	float* sssp_col_dist_; // sssp_frontier_dist_ gathered along the processor column
+	float* sssp_row_dist_; // sssp_dist_ gathered along the processor row
+	VERVOSE(int64_t sssp_num_relax_);
+	VERVOSE(int sssp_num_pull_phases_);
 };
 
 void BfsBase::run_bfs(int64_t root, int64_t* pred)
@@ -2656,6 +3226,11 @@ void BfsBase::run_bfs(int64_t root, int64_t* pred)
 	start_collection("initialize");
 #endif
 	TRACER(run_bfs);
+#if PRED_REORDERED
+	// the result is converted into pred at the end
+	int64_t* const output_pred = pred;
+	pred = reordered_pred_;
+#endif
 	pred_ = pred;
 #if VERVOSE_MODE
 	double tmp = MPI_Wtime();
@@ -2667,6 +3242,7 @@ void BfsBase::run_bfs(int64_t root, int64_t* pred)
 	int64_t total_edge_bottom_up = 0;
 #endif
 
+	if(level_trace_.enabled()) level_trace_.begin_bfs(root);
 	initialize_memory(pred);
 
 #if VERVOSE_MODE
@@ -2685,7 +3261,14 @@ void BfsBase::run_bfs(int64_t root, int64_t* pred)
 	forward_or_backward_ = next_forward_or_backward;
 	bitmap_or_list_ = next_bitmap_or_list;
 	growing_or_shrinking_ = true;
+#if ADAPTIVE_DIRECTION_SWITCH
+	if(switch_policy_.enabled()) switch_policy_.begin_bfs();
+#endif
+	double trace_expand_begin = 0, trace_expand_end = 0;
+	LevelTraceRecord trace_rec;
+	if(level_trace_.enabled()) trace_expand_begin = level_trace_.get_time();
 	first_expand(root);
+	if(level_trace_.enabled()) trace_expand_end = level_trace_.get_time();
 
 #if VERVOSE_MODE
 	tmp = MPI_Wtime();
@@ -2701,11 +3284,9 @@ void BfsBase::run_bfs(int64_t root, int64_t* pred)
 
 	while(true) {
 		++current_level_;
-#if VERVOSE_MODE
-		num_edge_top_down_ = 0;
-		num_td_large_edge_ = 0;
-		num_edge_bottom_up_ = 0;
-#endif // #if VERVOSE_MODE
+		EDGE_COUNT(num_edge_top_down_ = 0);
+		EDGE_COUNT(num_edge_bottom_up_ = 0);
+		VERVOSE(num_td_large_edge_ = 0);
 #if ENABLE_FUJI_PROF
 		fapp_start(prof_mes[(int)forward_or_backward_], 0, 0);
 		start_collection(prof_mes[(int)forward_or_backward_]);
@@ -2735,6 +3316,30 @@ void BfsBase::run_bfs(int64_t root, int64_t* pred)
 		}
 
 		global_visited_vertices += global_nq_size_;
+#if ADAPTIVE_DIRECTION_SWITCH
+		if(switch_policy_.enabled()) {
+			// this must be done before the edge counters are reduced for the profiling
+			switch_policy_.end_search(current_level_, forward_or_backward_,
+					num_edge_top_down_, num_edge_bottom_up_, prev_global_nq_size,
+					graph_.num_global_verts_ - global_visited_vertices + global_nq_size_);
+		}
+#endif
+		if(level_trace_.enabled()) {
+			// the edge counters are reduced for the profiling below
+			trace_rec.level = current_level_;
+			trace_rec.forward = forward_or_backward_;
+			trace_rec.bitmap = bitmap_or_list_;
+			trace_rec.begin = trace_expand_begin;
+			trace_rec.expand_time = trace_expand_end - trace_expand_begin;
+			trace_rec.fold_time = level_trace_.get_time() - trace_expand_end;
+			trace_rec.nq_local = nq_size_;
+			trace_rec.nq_global = global_nq_size_;
+			trace_rec.unvisited_global = graph_.num_global_verts_ - global_visited_vertices;
+			trace_rec.edge_relax = -1;
+			EDGE_COUNT(trace_rec.edge_relax = forward_or_backward_ ? num_edge_top_down_ : num_edge_bottom_up_);
+			trace_rec.a2a_send = -1;
+			VERVOSE(trace_rec.a2a_send = (forward_or_backward_ ? td_comm_ : bu_comm_).get_last_send_size());
+		}
 
 #if VERVOSE_MODE
 		tmp = MPI_Wtime();
@@ -2784,6 +3389,7 @@ void BfsBase::run_bfs(int64_t root, int64_t* pred)
 		num_edge_bottom_up_ = recv_num_edges[2];
 #endif // #if PROFILING_MODE
 #endif // #if VERVOSE_MODE
+		if(level_trace_.enabled()) level_trace_.submit_level(trace_rec);
 #if ENABLE_FUJI_PROF
 		stop_collection(prof_mes[(int)forward_or_backward_]);
 		fapp_stop(prof_mes[(int)forward_or_backward_], 0, 0);
@@ -2797,19 +3403,35 @@ void BfsBase::run_bfs(int64_t root, int64_t* pred)
 		start_collection("expand");
 #endif
 		int64_t global_unvisited_vertices = graph_.num_global_verts_ - global_visited_vertices;
+#if ADAPTIVE_DIRECTION_SWITCH
+		int64_t list_bytes = int64_t(max_nq_size_) * sizeof(TwodVertex);
+		int64_t bitmap_bytes = get_bitmap_size_local() * sizeof(BitmapType);
+#endif
 		next_bitmap_or_list = !forward_or_backward_;
 		if(growing_or_shrinking_ && global_nq_size_ > prev_global_nq_size) { // growing
-			if(forward_or_backward_ // forward ?
-				&& global_nq_size_ > graph_.num_global_verts_ / denom_to_bottom_up_ // NQ is large ?
-				) { // switch to backward
+			bool to_bottom_up = forward_or_backward_ // forward ?
+				&& global_nq_size_ > graph_.num_global_verts_ / denom_to_bottom_up_; // NQ is large ?
+#if ADAPTIVE_DIRECTION_SWITCH
+			if(forward_or_backward_) {
+				to_bottom_up = switch_policy_.to_bottom_up(to_bottom_up, current_level_ + 1,
+						global_nq_size_, global_unvisited_vertices, list_bytes, bitmap_bytes);
+			}
+#endif
+			if(to_bottom_up) { // switch to backward
 				next_forward_or_backward = false;
 				packet_buffer_is_dirty_ = true;
 			}
 		}
 		else { // shrinking
-			if(!forward_or_backward_  // backward ?
-				&& global_unvisited_vertices < int64_t(graph_.num_global_verts_ / DEMON_BOTTOMUP_TO_TOPDOWN) // NQ is small ?
-				) { // switch to topdown
+			bool to_top_down = !forward_or_backward_  // backward ?
+				&& global_unvisited_vertices < int64_t(graph_.num_global_verts_ / g_config.denom_bottomup_to_topdown); // NQ is small ?
+#if ADAPTIVE_DIRECTION_SWITCH
+			if(!forward_or_backward_) {
+				to_top_down = switch_policy_.to_top_down(to_top_down, current_level_ + 1,
+						global_nq_size_, global_unvisited_vertices, list_bytes, bitmap_bytes);
+			}
+#endif
+			if(to_top_down) { // switch to topdown
 				next_forward_or_backward = true;
 				growing_or_shrinking_ = false;
 
@@ -2820,6 +3442,9 @@ void BfsBase::run_bfs(int64_t root, int64_t* pred)
 				int bitmap_width = get_bitmap_size_local();
 				double threashold = bitmap_width*sizeof(BitmapType)/sizeof(TwodVertex)/denom_bitmap_to_list_;
 				next_bitmap_or_list = (max_nq_size_ >= threashold);
+#if ADAPTIVE_DIRECTION_SWITCH
+				next_bitmap_or_list = switch_policy_.bitmap_or_list(next_bitmap_or_list, list_bytes, bitmap_bytes);
+#endif
 			}
 		}
 		if(next_forward_or_backward == false) {
@@ -2886,6 +3511,12 @@ void BfsBase::run_bfs(int64_t root, int64_t* pred)
 		}
 #endif
 		// expand //
+		if(level_trace_.enabled()) trace_expand_begin = level_trace_.get_time();
+#if ADAPTIVE_DIRECTION_SWITCH
+		if(switch_policy_.enabled()) {
+			switch_policy_.begin_expand(next_bitmap_or_list, next_bitmap_or_list ? bitmap_bytes : list_bytes);
+		}
+#endif
 		if(next_forward_or_backward == forward_or_backward_) {
 			if(forward_or_backward_)
 				top_down_expand();
@@ -2898,6 +3529,10 @@ void BfsBase::run_bfs(int64_t root, int64_t* pred)
 				bottom_up_switch_expand(next_bitmap_or_list);
 		}
 		clear_nq_stack(); // currently, this is required only in the top-down phase
+#if ADAPTIVE_DIRECTION_SWITCH
+		if(switch_policy_.enabled()) switch_policy_.end_expand();
+#endif
+		if(level_trace_.enabled()) trace_expand_end = level_trace_.get_time();
 
 #if ENABLE_FUJI_PROF
 		stop_collection("expand");
@@ -2910,6 +3545,10 @@ void BfsBase::run_bfs(int64_t root, int64_t* pred)
 #endif
 	} // while(true) {
 	clear_nq_stack();
+#if PRED_REORDERED
+	write_pred(output_pred);
+#endif
+	if(level_trace_.enabled()) level_trace_.end_bfs(current_level_, global_visited_vertices);
 #if VERVOSE_MODE
 	if(mpi.isMaster()) print_with_prefix("Time of BFS: %f ms", (MPI_Wtime() - start_time) * 1000.0);
 	int64_t total_edge_relax = total_edge_top_down + total_edge_bottom_up;
@@ -2935,9 +3574,656 @@ void BfsBase::run_bfs(int64_t root, int64_t* pred)
 		printCounter("Avg top-down traversed edges: %f MiB, %f %%+", sum_cnt, max_cnt, 6);
 		printCounter("Avg bottom-up traversed edges: %f MiB, %f %%+", sum_cnt, max_cnt, 7);
 		printCounter("Avg total relaxed traversed: %f MiB, %f %%+", sum_cnt, max_cnt, 8);
+		if(frontier_codec_.enabled()) {
+			const int64_t* num_streams = frontier_codec_.num_streams();
+			print_with_prefix("Compressed frontier streams received (rank 0): raw %" PRId64 ", wah %" PRId64 ", delta %" PRId64,
+					num_streams[FrontierCodec::RAW], num_streams[FrontierCodec::WAH], num_streams[FrontierCodec::DELTA]);
+		}
+	}
+#endif
+}
+
+//-------------------------------------------------------------//
+// SSSP (delta-stepping)
+//-------------------------------------------------------------//
+
+void BfsBase::prepare_sssp()
+{
+	const int max_threads = omp_get_max_threads();
+	const int64_t L = graph_.num_local_verts_;
+	SsspUpdate::initialize();
+	SsspVertex::initialize();
+
+	// delta: 1 / (average degree) * SSSP_DELTA_DEGREE by default
+	int64_t num_edges[2] = { graph_.row_starts_[graph_.row_sums_[get_bitmap_size_tgt()]], 0 };
+#if ISOLATE_FIRST_EDGE
+	num_edges[0] += graph_.row_sums_[get_bitmap_size_tgt()];
+#endif
+	MPI_Allreduce(&num_edges[0], &num_edges[1], 1, MpiTypeOf<int64_t>::type, MPI_SUM, mpi.comm_2d);
+	const double avg_degree = (double)num_edges[1] / std::max<int64_t>(1, graph_.num_global_verts_);
+	const char* delta_str = getenv("SSSP_DELTA");
+	sssp_delta_ = (delta_str != NULL) ? atof(delta_str) :
+			std::min(1.0, SSSP_DELTA_DEGREE / std::max(1.0, avg_degree));
+	if(sssp_delta_ <= 0) {
+		fprintf(IMD_OUT, "Invalid SSSP_DELTA: %s\n", delta_str);
+		throw "Invalid SSSP_DELTA";
+	}
+
+	sssp_construct_graph();
+
+	// The relaxations are sent with MPI_Alltoallv even if the RMA transport is enabled.
+	a2a_comm_buf_.allocate_memory(get_a2a_buffer_size());
+	sssp_comm_.reset_buffer_size();
+	sssp_pull_comm_.reset_buffer_size();
+	const int max_comm_size = std::max(mpi.size_2dr, mpi.size_2dc);
+	sssp_comm_handler_.received_ = new SsspCommHandler::ReceivedData[max_comm_size];
+
+	// The updates of a round must fit into the pool of the sender and the receive buffer.
+	// sender: the buffers are sealed with at most SSSP_PACKET_LENGTH - 1 free elements and
+	//         each target and each thread have one more buffer.
+	// receiver: receives the updates of size_2dr senders (size_2dc senders in the pull phase).
+	const int64_t capacity = a2a_comm_buf_.pool_buffer_size() / sizeof(SsspUpdate);
+	const int64_t buffer_length = a2a_comm_buf_.buffer_size() / sizeof(SsspUpdate);
+	const int64_t num_buffers = capacity / buffer_length;
+	sssp_round_edges_ = std::min<int64_t>(capacity / mpi.size_2dr,
+			(num_buffers - mpi.size_2dr - max_threads - 1) * (buffer_length - SSSP_PACKET_LENGTH));
+	if(sssp_round_edges_ < buffer_length) {
+		fprintf(IMD_OUT, "Insufficient communication buffer for SSSP (%d buffers)\n", (int)num_buffers);
+		throw "Insufficient communication buffer for SSSP";
+	}
+	sssp_pull_round_rows_ = std::min<int64_t>(capacity / mpi.size_2dc,
+			(num_buffers - mpi.size_2dc - max_threads - 1) * (buffer_length - SSSP_PACKET_LENGTH));
+	const char* pull_str = getenv("SSSP_PULL");
+	sssp_pull_enabled_ = (pull_str == NULL || atoi(pull_str) != 0);
+	if(sssp_pull_round_rows_ < std::max<int64_t>(buffer_length, NBPE)) {
+		// the rows of each bitmap word are updated in the same round
+		sssp_pull_enabled_ = false;
+	}
+
+	sssp_dist_ = (float*)cache_aligned_xmalloc(L*sizeof(float));
+	sssp_flags_ = (uint8_t*)cache_aligned_xmalloc(L*sizeof(uint8_t));
+	sssp_queue_ = (TwodVertex*)cache_aligned_xmalloc(L*sizeof(TwodVertex));
+	sssp_heavy_ = (TwodVertex*)cache_aligned_xmalloc(L*sizeof(TwodVertex));
+	sssp_send_frontier_ = (SsspVertex*)cache_aligned_xmalloc(L*sizeof(SsspVertex));
+	sssp_recv_frontier_ = (SsspVertex*)cache_aligned_xmalloc(L*mpi.size_2dc*sizeof(SsspVertex));
+	sssp_rows_ = (SsspRow*)cache_aligned_xmalloc(L*mpi.size_2dc*sizeof(SsspRow));
+	sssp_row_edge_offsets_ = (int64_t*)cache_aligned_xmalloc((L*mpi.size_2dc + 1)*sizeof(int64_t));
+	sssp_packets_ = (SsspPacket*)cache_aligned_xmalloc(max_threads*max_comm_size*sizeof(SsspPacket));
+	if(sssp_pull_enabled_) {
+		sssp_frontier_dist_ = (float*)cache_aligned_xmalloc(L*sizeof(float));
+		sssp_col_dist_ = (float*)cache_aligned_xmalloc(L*mpi.size_2dr*sizeof(float));
+		sssp_row_dist_ = (float*)cache_aligned_xmalloc(L*mpi.size_2dc*sizeof(float));
+	}
+
+	if(mpi.isMaster()) print_with_prefix("SSSP delta: %f (average degree %f), max relaxations per round: %" PRId64 ", pull: %s",
+			sssp_delta_, avg_degree, sssp_round_edges_, sssp_pull_enabled_ ? "enabled" : "disabled");
+}
+
+void BfsBase::sssp_construct_graph()
+{
+	TRACER(sssp_construct);
+	const int64_t L = graph_.num_local_verts_;
+	const int lgl = graph_.local_bits_;
+	const int r_mask = (1 << graph_.r_bits_) - 1;
+	const int64_t lmask = (int64_t(1) << lgl) - 1;
+	const int P = mpi.size_2d;
+	const int R = mpi.size_2dr;
+	const int r = mpi.rank_2dr;
+	const int c = mpi.rank_2dc;
+	const int64_t local_bitmap_width = get_bitmap_size_local();
+	const int64_t bitmap_size = get_bitmap_size_tgt();
+	const int64_t num_rows = graph_.row_sums_[bitmap_size];
+	const EdgeArrayRef edge_array = graph_.edge_array();
+	const float delta = sssp_delta_;
+
+	// The weights are computed from the original ids and the targets are in the processor column.
+	// This is also used for the parents of the pull phase.
+	LocalVertex* col_invert_map = sssp_col_invert_map_ = static_cast<LocalVertex*>(
+			cache_aligned_xmalloc(L*mpi.size_2dr*sizeof(LocalVertex)));
+	MPI_Allgather(graph_.invert_map_, L, MpiTypeOf<LocalVertex>::type,
+			col_invert_map, L, MpiTypeOf<LocalVertex>::type, mpi.comm_2dc);
+
+	// the first edge of each row is included
+	sssp_row_starts_ = (int64_t*)cache_aligned_xmalloc((num_rows + 1)*sizeof(int64_t));
+	sssp_row_starts_[0] = 0;
+	for(int64_t i = 0; i < num_rows; ++i) {
+		sssp_row_starts_[i+1] = sssp_row_starts_[i] + ISOLATE_FIRST_EDGE +
+				graph_.row_starts_[i+1] - graph_.row_starts_[i];
+	}
+	const int64_t num_edges = sssp_row_starts_[num_rows];
+	sssp_edges_ = (SsspEdge*)cache_aligned_xmalloc(num_edges*sizeof(SsspEdge));
+	sssp_light_ends_ = (int64_t*)cache_aligned_xmalloc(std::max<int64_t>(1, num_rows)*sizeof(int64_t));
+
+#define ADD_EDGE(e) do { \
+		int64_t tgt_r = ((e) >> lgl) & r_mask; \
+		int64_t tgt_local = (e) & lmask; \
+		int64_t tgt_orig = int64_t(col_invert_map[tgt_r * L + tgt_local]) * P + c * R + tgt_r; \
+		row[n].tgt = (tgt_r << lgl) | tgt_local; \
+		row[n].weight = sssp_edge_weight(src_orig, tgt_orig); \
+		++n; \
+	} while(false)
+
+#pragma omp parallel for schedule(dynamic, 64)
+	for(int64_t word_idx = 0; word_idx < bitmap_size; ++word_idx) {
+		const int64_t src_c = word_idx / local_bitmap_width;
+		TwodVertex non_zero_off = graph_.row_sums_[word_idx];
+		for(BitmapType bit_flags = graph_.row_bitmap_[word_idx];
+				bit_flags != BitmapType(0); bit_flags &= bit_flags - 1, ++non_zero_off)
+		{
+			int64_t src_orig = int64_t(graph_.orig_vertexes_[non_zero_off]) * P + src_c * R + r;
+			SsspEdge* row = sssp_edges_ + sssp_row_starts_[non_zero_off];
+			int64_t n = 0;
+#if ISOLATE_FIRST_EDGE
+			ADD_EDGE(graph_.isolated_edges_[non_zero_off]);
+#endif
+			for(int64_t e = graph_.row_starts_[non_zero_off]; e < graph_.row_starts_[non_zero_off+1]; ++e) {
+				ADD_EDGE(edge_array[e]);
+			}
+			std::sort(row, row + n);
+			SsspEdge light_end = { 0, delta };
+			sssp_light_ends_[non_zero_off] = sssp_row_starts_[non_zero_off] +
+					(std::lower_bound(row, row + n, light_end) - row);
+		}
+	}
+#undef ADD_EDGE
+
+	VERVOSE(if(mpi.isMaster()) print_with_prefix("SSSP graph: %f MB per process",
+			to_mega(num_edges*sizeof(SsspEdge) + num_rows*2*sizeof(int64_t))));
+}
+
+void BfsBase::end_sssp()
+{
+	if(sssp_dist_ == NULL) return ;
+	free(sssp_row_starts_); sssp_row_starts_ = NULL;
+	free(sssp_light_ends_); sssp_light_ends_ = NULL;
+	free(sssp_edges_); sssp_edges_ = NULL;
+	free(sssp_dist_); sssp_dist_ = NULL;
+	free(sssp_flags_); sssp_flags_ = NULL;
+	free(sssp_queue_); sssp_queue_ = NULL;
+	free(sssp_heavy_); sssp_heavy_ = NULL;
+	free(sssp_send_frontier_); sssp_send_frontier_ = NULL;
+	free(sssp_recv_frontier_); sssp_recv_frontier_ = NULL;
+	free(sssp_rows_); sssp_rows_ = NULL;
+	free(sssp_row_edge_offsets_); sssp_row_edge_offsets_ = NULL;
+	free(sssp_packets_); sssp_packets_ = NULL;
+	free(sssp_col_invert_map_); sssp_col_invert_map_ = NULL;
+	free(sssp_frontier_dist_); sssp_frontier_dist_ = NULL;
+	free(sssp_col_dist_); sssp_col_dist_ = NULL;
+	free(sssp_row_dist_); sssp_row_dist_ = NULL;
+	delete [] sssp_comm_handler_.received_; sssp_comm_handler_.received_ = NULL;
+	a2a_comm_buf_.deallocate_memory();
+	SsspUpdate::uninitialize();
+	SsspVertex::uninitialize();
+}
+
+void BfsBase::run_sssp(int64_t root, int64_t* pred, float* dist)
+{
+	SET_AFFINITY;
+	TRACER(run_sssp);
+	pred_ = pred;
+	invalidate_pred();
+	const int64_t L = graph_.num_local_verts_;
+	const int64_t num_orig_local_vertices = graph_.pred_size();
+#if VERVOSE_MODE
+	double start_time = MPI_Wtime();
+	sssp_num_relax_ = 0;
+	sssp_num_pull_phases_ = 0;
+#endif
+
+#pragma omp parallel
+	{
+#pragma omp for nowait
+		for(int64_t i = 0; i < num_orig_local_vertices; ++i) {
+			pred[i] = -1;
+			dist[i] = -1;
+		}
+#pragma omp for nowait
+		for(int64_t i = 0; i < L; ++i) {
+			sssp_dist_[i] = SSSP_UNREACHED;
+			sssp_flags_[i] = 0;
+		}
 	}
+	sssp_queue_size_ = 0;
+	sssp_heavy_size_ = 0;
+
+	if(vertex_owner(root) == mpi.rank_2d) {
+		int64_t root_local = vertex_local(root);
+		int64_t reordered = graph_.reorder_map_[root_local];
+		pred[root_local] = root;
+		sssp_dist_[reordered] = 0;
+		sssp_flags_[reordered] = SSSP_CHANGED;
+	}
+
+	int num_buckets = 0, num_phases = 0;
+	while(sssp_next_bucket()) {
+		++num_buckets;
+		// The heavy phase can move vertices into the current bucket only by rounding errors.
+		while(true) {
+			++num_phases;
+			if(sssp_relax_phase(true) > 0) continue;
+			if(sssp_relax_phase(false) == 0) break;
+		}
+	}
+
+	const LocalVertex* invert_map = graph_.invert_map_;
+#pragma omp parallel for
+	for(int64_t i = 0; i < L; ++i) {
+		if(sssp_dist_[i] != SSSP_UNREACHED) {
+			dist[invert_map[i]] = sssp_dist_[i];
+		}
+	}
+
+#if VERVOSE_MODE
+	int64_t num_relax = sssp_num_relax_;
+	MPI_Allreduce(MPI_IN_PLACE, &num_relax, 1, MpiTypeOf<int64_t>::type, MPI_SUM, mpi.comm_2d);
+	if(mpi.isMaster()) print_with_prefix("Time of SSSP: %f ms, %d buckets, %d phases (%d pull), %" PRId64 " relaxations",
+			(MPI_Wtime() - start_time) * 1000.0, num_buckets, num_phases, sssp_num_pull_phases_, num_relax);
 #endif
 }
+
+// Finds the vertices of the next bucket and puts them into sssp_queue_.
+// Returns false if there is no vertex to be relaxed.
+bool BfsBase::sssp_next_bucket()
+{
+	TRACER(sssp_next_bucket);
+	const int64_t L = graph_.num_local_verts_;
+	float min_dist = SSSP_UNREACHED;
+#pragma omp parallel for reduction(min:min_dist)
+	for(int64_t i = 0; i < L; ++i) {
+		if((sssp_flags_[i] & SSSP_CHANGED) && sssp_dist_[i] < min_dist) {
+			min_dist = sssp_dist_[i];
+		}
+	}
+	MPI_Allreduce(MPI_IN_PLACE, &min_dist, 1, MpiTypeOf<float>::type, MPI_MIN, mpi.comm_2d);
+	if(min_dist == SSSP_UNREACHED) {
+		return false;
+	}
+
+	if(sssp_pull_enabled_) {
+		// the vertices whose distances are less than min_dist are settled
+		int64_t num_settled = 0;
+#pragma omp parallel for reduction(+:num_settled)
+		for(int64_t i = 0; i < L; ++i) {
+			if(sssp_dist_[i] < min_dist) ++num_settled;
+		}
+		MPI_Allreduce(MPI_IN_PLACE, &num_settled, 1, MpiTypeOf<int64_t>::type, MPI_SUM, mpi.comm_2d);
+		sssp_unsettled_ = graph_.num_global_verts_ - num_settled;
+	}
+
+	double upper = (floor(min_dist / sssp_delta_) + 1) * sssp_delta_;
+	while(float(upper) <= min_dist) upper += sssp_delta_;
+	const float upper_f = sssp_upper_ = float(upper);
+
+#pragma omp parallel for
+	for(int64_t i = 0; i < L; ++i) {
+		if((sssp_flags_[i] & SSSP_CHANGED) && sssp_dist_[i] < upper_f) {
+			sssp_flags_[i] |= SSSP_QUEUED;
+			sssp_queue_[__sync_fetch_and_add(&sssp_queue_size_, 1)] = i;
+		}
+	}
+	return true;
+}
+
+// Relaxes the light edges of the vertices in sssp_queue_ or the heavy edges of the vertices
+// in sssp_heavy_. Returns the global number of the vertices.
+int64_t BfsBase::sssp_relax_phase(bool light)
+{
+	TRACER(sssp_phase);
+	const int64_t L = graph_.num_local_verts_;
+	const int P = mpi.size_2d;
+	const int R = mpi.size_2dr;
+	const int r = mpi.rank_2dr;
+	SsspVertex* send_frontier = sssp_send_frontier_;
+
+	int num_send;
+	if(light) {
+		num_send = sssp_queue_size_;
+#pragma omp parallel for
+		for(int i = 0; i < num_send; ++i) {
+			TwodVertex v = sssp_queue_[i];
+			uint8_t flags = sssp_flags_[v];
+			// the heavy edges are relaxed at the end of the bucket
+			sssp_flags_[v] = (flags & ~(SSSP_CHANGED | SSSP_QUEUED)) | SSSP_HEAVY;
+			if((flags & SSSP_HEAVY) == 0) {
+				sssp_heavy_[__sync_fetch_and_add(&sssp_heavy_size_, 1)] = v;
+			}
+			send_frontier[i].local = v;
+			send_frontier[i].dist = sssp_dist_[v];
+		}
+		sssp_queue_size_ = 0;
+	}
+	else {
+		num_send = sssp_heavy_size_;
+#pragma omp parallel for
+		for(int i = 0; i < num_send; ++i) {
+			TwodVertex v = sssp_heavy_[i];
+			sssp_flags_[v] &= ~SSSP_HEAVY;
+			send_frontier[i].local = v;
+			send_frontier[i].dist = sssp_dist_[v];
+		}
+		sssp_heavy_size_ = 0;
+	}
+
+	int64_t global_size = num_send;
+	MPI_Allreduce(MPI_IN_PLACE, &global_size, 1, MpiTypeOf<int64_t>::type, MPI_SUM, mpi.comm_2d);
+	if(global_size == 0) {
+		return 0;
+	}
+	// the same decision is made on all the processes
+	if(sssp_pull_enabled_ && global_size * SSSP_DENOM_PUSH_TO_PULL > sssp_unsettled_) {
+		sssp_pull_phase(light, num_send);
+		return global_size;
+	}
+
+	// gather the frontier along the processor row
+	int recv_counts[mpi.size_2dc], recv_offsets[mpi.size_2dc + 1];
+	MPI_Allgather(&num_send, 1, MPI_INT, recv_counts, 1, MPI_INT, mpi.comm_2dr);
+	recv_offsets[0] = 0;
+	for(int i = 0; i < mpi.size_2dc; ++i) {
+		recv_offsets[i + 1] = recv_offsets[i] + recv_counts[i];
+	}
+	SsspVertex* recv_frontier = sssp_recv_frontier_;
+	MPI_Allgatherv(send_frontier, num_send, MpiTypeOf<SsspVertex>::type,
+			recv_frontier, recv_counts, recv_offsets, MpiTypeOf<SsspVertex>::type, mpi.comm_2dr);
+	const int num_recv = recv_offsets[mpi.size_2dc];
+
+	// make the list of the rows and the prefix sum of their edges
+	const int max_threads = omp_get_max_threads();
+	int64_t thread_rows[max_threads + 1], thread_edges[max_threads + 1];
+	int num_threads = 1;
+#pragma omp parallel
+	{
+		const int tid = omp_get_thread_num();
+		for(int b = 0; b < mpi.size_2dc; ++b) {
+#pragma omp for nowait
+			for(int i = recv_offsets[b]; i < recv_offsets[b + 1]; ++i) {
+				recv_frontier[i].local += b * L; // compact vertex of the processor row
+			}
+		}
+#pragma omp barrier
+		int64_t num_rows = 0, num_edges = 0;
+		TwodVertex non_zero_off;
+		int64_t begin, end;
+#pragma omp for schedule(static)
+		for(int i = 0; i < num_recv; ++i) {
+			if(sssp_row_range(recv_frontier[i].local, light, &non_zero_off, &begin, &end)) {
+				++num_rows;
+				num_edges += end - begin;
+			}
+		}
+		thread_rows[tid + 1] = num_rows;
+		thread_edges[tid + 1] = num_edges;
+#pragma omp barrier
+#pragma omp master
+		{
+			num_threads = omp_get_num_threads();
+			thread_rows[0] = thread_edges[0] = 0;
+			for(int i = 0; i < num_threads; ++i) {
+				thread_rows[i + 1] += thread_rows[i];
+				thread_edges[i + 1] += thread_edges[i];
+			}
+		}
+#pragma omp barrier
+		int64_t row_idx = thread_rows[tid];
+		int64_t edge_offset = thread_edges[tid];
+#pragma omp for schedule(static)
+		for(int i = 0; i < num_recv; ++i) {
+			TwodVertex compact = recv_frontier[i].local;
+			if(sssp_row_range(compact, light, &non_zero_off, &begin, &end)) {
+				SsspRow& row = sssp_rows_[row_idx];
+				row.edge_begin = begin;
+				row.src = int64_t(graph_.orig_vertexes_[non_zero_off]) * P + (compact / L) * R + r;
+				row.dist = recv_frontier[i].dist;
+				sssp_row_edge_offsets_[row_idx] = edge_offset;
+				++row_idx;
+				edge_offset += end - begin;
+			}
+		}
+	}
+	const int num_rows = thread_rows[num_threads];
+	const int64_t num_edges = thread_edges[num_threads];
+	sssp_row_edge_offsets_[num_rows] = num_edges;
+
+	// all the processes of the column have to call sssp_comm_ the same number of times
+	int64_t num_rounds = (num_edges + sssp_round_edges_ - 1) / sssp_round_edges_;
+	MPI_Allreduce(MPI_IN_PLACE, &num_rounds, 1, MpiTypeOf<int64_t>::type, MPI_MAX, mpi.comm_2dc);
+	for(int64_t i = 0; i < num_rounds; ++i) {
+		int64_t edge_begin = std::min(num_edges, i * sssp_round_edges_);
+		int64_t edge_end = std::min(num_edges, edge_begin + sssp_round_edges_);
+		sssp_send_relaxations(edge_begin, edge_end, num_rows);
+	}
+	return global_size;
+}
+
+// Sends the relaxations of the edges [edge_begin, edge_end) of sssp_rows_ and applies the received ones.
+void BfsBase::sssp_send_relaxations(int64_t edge_begin, int64_t edge_end, int num_rows)
+{
+	TRACER(sssp_send);
+	const int lgl = graph_.local_bits_;
+	const TwodVertex lmask = (TwodVertex(1) << lgl) - 1;
+	const int64_t* row_edge_offsets = sssp_row_edge_offsets_;
+	sssp_comm_.prepare();
+#pragma omp parallel
+	{
+		const int tid = omp_get_thread_num();
+		const int num_threads = omp_get_num_threads();
+		SsspPacket* packets = sssp_packets_ + tid * mpi.size_2dr;
+		for(int i = 0; i < mpi.size_2dr; ++i) {
+			packets[i].length = 0;
+		}
+		// the edges are equally divided among the threads
+		const int64_t width = edge_end - edge_begin;
+		const int64_t e_start = edge_begin + width * tid / num_threads;
+		const int64_t e_end = edge_begin + width * (tid + 1) / num_threads;
+		int64_t e = e_start;
+		if(e < e_end) {
+			int64_t row_idx = std::upper_bound(row_edge_offsets, row_edge_offsets + num_rows + 1, e)
+					- row_edge_offsets - 1;
+			for( ; e < e_end; ++row_idx) {
+				const SsspRow& row = sssp_rows_[row_idx];
+				const SsspEdge* edges = sssp_edges_ + row.edge_begin - row_edge_offsets[row_idx];
+				const int64_t row_end = std::min(e_end, row_edge_offsets[row_idx + 1]);
+				for( ; e < row_end; ++e) {
+					const SsspEdge edge = edges[e];
+					const int dest = edge.tgt >> lgl;
+					SsspPacket& pk = packets[dest];
+					SsspUpdate& upd = pk.data[pk.length++];
+					upd.parent = row.src;
+					upd.local = edge.tgt & lmask;
+					upd.dist = row.dist + edge.weight;
+					if(pk.length == SSSP_PACKET_LENGTH) {
+						sssp_comm_.put(pk.data, pk.length, dest);
+						pk.length = 0;
+					}
+				}
+			}
+		}
+		for(int i = 0; i < mpi.size_2dr; ++i) {
+			if(packets[i].length > 0) {
+				sssp_comm_.put(packets[i].data, packets[i].length, i);
+			}
+		}
+		VERVOSE(__sync_fetch_and_add(&sssp_num_relax_, e_end - e_start));
+	}
+	sssp_comm_.run();
+	sssp_write_pred(mpi.size_2dr);
+}
+
+// Relaxes the edges between the frontier in send_frontier_ and the rows of this process
+// from the side of the rows.
+void BfsBase::sssp_pull_phase(bool light, int num_send)
+{
+	TRACER(sssp_pull);
+	const int64_t L = graph_.num_local_verts_;
+	const SsspVertex* send_frontier = sssp_send_frontier_;
+	float* frontier_dist = sssp_frontier_dist_;
+	float frontier_min = SSSP_UNREACHED;
+#pragma omp parallel
+	{
+#pragma omp for
+		for(int64_t i = 0; i < L; ++i) {
+			frontier_dist[i] = SSSP_UNREACHED;
+		}
+#pragma omp for reduction(min:frontier_min)
+		for(int i = 0; i < num_send; ++i) {
+			frontier_dist[send_frontier[i].local] = send_frontier[i].dist;
+			frontier_min = std::min(frontier_min, send_frontier[i].dist);
+		}
+	}
+	MPI_Allreduce(MPI_IN_PLACE, &frontier_min, 1, MpiTypeOf<float>::type, MPI_MIN, mpi.comm_2d);
+	// the distances of the targets and the rows
+	MPI_Allgather(frontier_dist, L, MpiTypeOf<float>::type,
+			sssp_col_dist_, L, MpiTypeOf<float>::type, mpi.comm_2dc);
+	MPI_Allgather(sssp_dist_, L, MpiTypeOf<float>::type,
+			sssp_row_dist_, L, MpiTypeOf<float>::type, mpi.comm_2dr);
+	VERVOSE(++sssp_num_pull_phases_);
+
+	// Each round updates the rows of the bitmap words [word_begin, word_end).
+	// All the processes of the row have to call sssp_pull_comm_ the same number of times.
+	const int64_t bitmap_size = get_bitmap_size_tgt();
+	const TwodVertex* row_sums = graph_.row_sums_;
+	int64_t num_rounds = 0;
+	for(int64_t w = 0; w < bitmap_size; ++num_rounds) {
+		w = std::upper_bound(row_sums + w, row_sums + bitmap_size + 1,
+				row_sums[w] + sssp_pull_round_rows_) - row_sums - 1;
+	}
+	MPI_Allreduce(MPI_IN_PLACE, &num_rounds, 1, MpiTypeOf<int64_t>::type, MPI_MAX, mpi.comm_2dr);
+	int64_t word_begin = 0;
+	for(int64_t i = 0; i < num_rounds; ++i) {
+		int64_t word_end = (word_begin == bitmap_size) ? bitmap_size :
+				std::upper_bound(row_sums + word_begin, row_sums + bitmap_size + 1,
+						row_sums[word_begin] + sssp_pull_round_rows_) - row_sums - 1;
+		sssp_pull_relaxations(light, frontier_min, word_begin, word_end);
+		word_begin = word_end;
+	}
+}
+
+// Finds the best relaxation of each row of the bitmap words [word_begin, word_end),
+// sends it to the owner of the row and applies the received ones.
+void BfsBase::sssp_pull_relaxations(bool light, float frontier_min, int64_t word_begin, int64_t word_end)
+{
+	TRACER(sssp_pull_send);
+	const int64_t L = graph_.num_local_verts_;
+	const int lgl = graph_.local_bits_;
+	const TwodVertex lmask = (TwodVertex(1) << lgl) - 1;
+	const int P = mpi.size_2d;
+	const int R = mpi.size_2dr;
+	const int c = mpi.rank_2dc;
+	const int64_t local_bitmap_width = get_bitmap_size_local();
+	const float* col_dist = sssp_col_dist_;
+	const float* row_dist = sssp_row_dist_;
+	const LocalVertex* col_invert_map = sssp_col_invert_map_;
+	sssp_pull_comm_.prepare();
+#pragma omp parallel
+	{
+		const int tid = omp_get_thread_num();
+		SsspPacket* packets = sssp_packets_ + tid * mpi.size_2dc;
+		for(int i = 0; i < mpi.size_2dc; ++i) {
+			packets[i].length = 0;
+		}
+		VERVOSE(int64_t num_relax = 0);
+#pragma omp for schedule(dynamic, 64)
+		for(int64_t word_idx = word_begin; word_idx < word_end; ++word_idx) {
+			const int src_c = word_idx / local_bitmap_width;
+			const BitmapType row_bitmap = graph_.row_bitmap_[word_idx];
+			TwodVertex non_zero_off = graph_.row_sums_[word_idx];
+			for(BitmapType bit_flags = row_bitmap; bit_flags != BitmapType(0);
+					bit_flags &= bit_flags - 1, ++non_zero_off)
+			{
+				const TwodVertex compact = word_idx * NBPE + __builtin_ctzl(bit_flags);
+				// no frontier vertex can improve the row
+				float best = row_dist[compact];
+				if(best <= frontier_min) continue;
+				const int64_t begin = light ? sssp_row_starts_[non_zero_off] : sssp_light_ends_[non_zero_off];
+				const int64_t end = light ? sssp_light_ends_[non_zero_off] : sssp_row_starts_[non_zero_off + 1];
+				int64_t best_idx = -1;
+				// the edges are sorted by weight
+				for(int64_t e = begin; e < end; ++e) {
+					const SsspEdge edge = sssp_edges_[e];
+					if(frontier_min + edge.weight >= best) break;
+					const TwodVertex tgt_idx = ((edge.tgt >> lgl) * L) | (edge.tgt & lmask);
+					const float d = col_dist[tgt_idx] + edge.weight;
+					if(d < best) {
+						best = d;
+						best_idx = tgt_idx;
+					}
+				}
+				VERVOSE(num_relax += end - begin);
+				if(best_idx == -1) continue;
+				SsspPacket& pk = packets[src_c];
+				SsspUpdate& upd = pk.data[pk.length++];
+				const int64_t tgt_r = best_idx / L;
+				upd.parent = int64_t(col_invert_map[best_idx]) * P + c * R + tgt_r;
+				upd.local = compact - src_c * L;
+				upd.dist = best;
+				if(pk.length == SSSP_PACKET_LENGTH) {
+					sssp_pull_comm_.put(pk.data, pk.length, src_c);
+					pk.length = 0;
+				}
+			}
+		}
+		for(int i = 0; i < mpi.size_2dc; ++i) {
+			if(packets[i].length > 0) {
+				sssp_pull_comm_.put(packets[i].data, packets[i].length, i);
+			}
+		}
+		VERVOSE(__sync_fetch_and_add(&sssp_num_relax_, num_relax));
+	}
+	sssp_pull_comm_.run();
+	sssp_write_pred(mpi.size_2dc);
+}
+
+// Called by sssp_comm_ and sssp_pull_comm_ for the updates from each source process.
+void BfsBase::sssp_relax(SsspUpdate* updates, int length)
+{
+	const float upper = sssp_upper_;
+	for(int i = 0; i < length; ++i) {
+		const TwodVertex v = updates[i].local;
+		const float new_dist = updates[i].dist;
+		// atomic min: the non-negative floats are ordered like their bit patterns
+		int32_t* dist_ptr = reinterpret_cast<int32_t*>(sssp_dist_ + v);
+		int32_t new_bits;
+		memcpy(&new_bits, &new_dist, sizeof(new_bits));
+		int32_t cur_bits = *dist_ptr;
+		bool updated = false;
+		while(new_bits < cur_bits) {
+			int32_t old_bits = __sync_val_compare_and_swap(dist_ptr, cur_bits, new_bits);
+			if(old_bits == cur_bits) {
+				updated = true;
+				break;
+			}
+			cur_bits = old_bits;
+		}
+		if(updated) {
+			const uint8_t flags = (new_dist < upper) ? (SSSP_CHANGED | SSSP_QUEUED) : SSSP_CHANGED;
+			const uint8_t old_flags = __sync_fetch_and_or(&sssp_flags_[v], flags);
+			if(flags & ~old_flags & SSSP_QUEUED) {
+				sssp_queue_[__sync_fetch_and_add(&sssp_queue_size_, 1)] = v;
+			}
+		}
+	}
+}
+
+// The predecessor is the source of the update which has the final distance of the round.
+void BfsBase::sssp_write_pred(int num_src)
+{
+	const LocalVertex* invert_map = graph_.invert_map_;
+	const SsspCommHandler::ReceivedData* received = sssp_comm_handler_.received_;
+	int64_t* restrict pred = pred_;
+#pragma omp parallel
+	for(int src = 0; src < num_src; ++src) {
+		const SsspUpdate* updates = received[src].ptr;
+#pragma omp for nowait
+		for(int i = 0; i < received[src].length; ++i) {
+			const TwodVertex v = updates[i].local;
+			if(updates[i].dist == sssp_dist_[v]) {
+				pred[invert_map[v]] = updates[i].parent;
+			}
+		}
+	}
+}
 #undef debug
+#undef MARK_PRED_DIRTY
+#undef TD_PRED_INDEX
 
 #endif /* BFS_HPP_ */
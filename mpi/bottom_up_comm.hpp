@@ -11,6 +11,7 @@
 #include "parameters.h"
 #include "abstract_comm.hpp"
 #include "utils.hpp"
+#include "runtime_config.hpp"
 
 #define debug(...) debug_print(BUCOM, __VA_ARGS__)
 
@@ -223,7 +224,7 @@ protected:
 		return tag;
 	}
 
-	void next_recv_probe(bool blocking) {
+	virtual void next_recv_probe(bool blocking) {
 		if(is_active) {
 			MPI_Status status[4];
 			if(blocking) {
@@ -271,9 +272,127 @@ protected:
 		send_pair[2] = send_pair[0];
 		send_pair[3] = send_pair[1];
 		is_active = true;
-#if !BOTTOM_UP_OVERLAP_PFS // if overlapping is disabled
+		if(!g_config.bottom_up_overlap_pfs) { // if overlapping is disabled
+			next_recv_probe(true);
+		}
+	}
+};
+
+// The substep communication with the one-sided puts (rma_comm.hpp).
+// Each process has NSLOT landing slots for each neighbor in the window.
+// The window is created on window_comm, which includes all the processes (see RmaAlltoallWindow).
+// The sender waits until the receiver consumes the slot, puts the tag and the data
+// into the slot and notifies the receiver. The receiver copies the data to the receive
+// buffer and notifies the sender that the slot is consumed.
+// The n-th message for a neighbor uses the slot (n % NSLOT).
+class RmaBottomUpSubstepComm : public MpiBottomUpSubstepComm {
+	typedef MpiBottomUpSubstepComm super__;
+public:
+	// max_bytes: the maximum size of a message in bytes
+	RmaBottomUpSubstepComm(MPI_Comm mpi_comm__, MPI_Comm window_comm, int64_t max_bytes)
+		: super__(mpi_comm__)
+		, counters_(window_comm, NUM_COUNTERS)
+		, completed_steps_(0)
+	{
+		int comm_size;
+		MPI_Comm_size(mpi_comm__, &comm_size);
+		std::vector<int> window_ranks(comm_size);
+		rma_translate_ranks(mpi_comm__, window_comm, &window_ranks[0]);
+		for(int i = 0; i < 2; ++i) {
+			window_rank_[i] = window_ranks[nodes_[i].rank];
+		}
+		slot_bytes_ = roundup<int64_t>(sizeof(BottomUpSubstepTag), CACHE_LINE) +
+				roundup<int64_t>(max_bytes, CACHE_LINE);
+		max_bytes_ = max_bytes;
+		MPI_Win_allocate(slot_bytes_ * NSLOT * 2, 1, MPI_INFO_NULL, window_comm, &window_, &win_);
+		MPI_Win_lock_all(MPI_MODE_NOCHECK, win_);
+		sent_[0] = sent_[1] = 0;
+	}
+	virtual ~RmaBottomUpSubstepComm() {
+		MPI_Win_unlock_all(win_);
+		MPI_Win_free(&win_);
+	}
+protected:
+	enum {
+		NSLOT = 2,
+		// counters: [source] the arrived messages, [ACK_COUNTER + target] the consumed slots
+		ACK_COUNTER = 2,
+		NUM_COUNTERS = 4,
+	};
+	RmaNotificationCounters counters_;
+	MPI_Win win_;
+	uint8_t* window_;
+	int64_t slot_bytes_;
+	int64_t max_bytes_;
+	int window_rank_[2]; // the ranks of the neighbors in the window
+	int64_t sent_[2];
+	int64_t completed_steps_;
+	BottomUpSubstepTag send_tag_[2]; // kept until the put is completed
+
+	// The slot for the n-th message from the source (0: left, 1: right)
+	int64_t slot_offset(int source, int64_t n) {
+		return (source * NSLOT + n % NSLOT) * slot_bytes_;
+	}
+	int64_t data_offset(int source, int64_t n) {
+		return slot_offset(source, n) + roundup<int64_t>(sizeof(BottomUpSubstepTag), CACHE_LINE);
+	}
+
+	// The message for nodes_[target] arrives at the slot of the source (1 - target).
+	void put(BottomUpSubstepData& data, int target) {
+		const int rank = window_rank_[target];
+		const int source = 1 - target;
+		const int64_t bytes = data.tag.length * element_size;
+		if(bytes > max_bytes_) {
+			fprintf(IMD_OUT, "Error: message size (%" PRId64 " bytes) > slot size (%" PRId64 " bytes)\n",
+					bytes, max_bytes_);
+			throw "Error: buffer size not enough";
+		}
+		const int64_t n = sent_[target]++;
+		counters_.wait(ACK_COUNTER + target, n - NSLOT + 1);
+		send_tag_[target] = data.tag;
+		MPI_Put(&send_tag_[target], sizeof(BottomUpSubstepTag), MPI_BYTE, rank,
+				slot_offset(source, n), sizeof(BottomUpSubstepTag), MPI_BYTE, win_);
+		MPI_Put(data.data, bytes, MPI_BYTE, rank, data_offset(source, n), bytes, MPI_BYTE, win_);
+		MPI_Win_flush(rank, win_);
+		counters_.notify(rank, source);
+		free_buffer(data.data);
+	}
+
+	virtual void next_recv_probe(bool blocking) {
+		if(is_active) {
+			const int64_t n = completed_steps_;
+			for(int s = 0; s < 2; ++s) {
+				if(blocking) {
+					counters_.wait(s, n + 1);
+				}
+				else if(counters_.read(s) < n + 1) {
+					return ;
+				}
+			}
+			MPI_Win_sync(win_);
+			for(int s = 0; s < 2; ++s) {
+				BottomUpSubstepData& recv_data = recv_pair[recv_filled++ % NBUF];
+				recv_data.tag = *reinterpret_cast<BottomUpSubstepTag*>(window_ + slot_offset(s, n));
+				recv_data.data = get_buffer();
+				memcpy(recv_data.data, window_ + data_offset(s, n), recv_data.tag.length * element_size);
+				// the message from nodes_[s] was sent to its (1 - s) side
+				counters_.notify(window_rank_[s], ACK_COUNTER + 1 - s);
+			}
+			completed_steps_ = n + 1;
+			is_active = false;
+		}
+	}
+	virtual void send_recv() {
+		VERVOSE(compute_time_.push_back(tk_.getSpanAndReset()));
 		next_recv_probe(true);
-#endif
+		VERVOSE(comm_wait_time_.push_back(tk_.getSpanAndReset()));
+		// send_pair[0] goes to the right and send_pair[1] goes to the left
+		put(send_pair[0], 1);
+		put(send_pair[1], 0);
+		is_active = true;
+		if(!g_config.bottom_up_overlap_pfs) { // if overlapping is disabled
+			next_recv_probe(true);
+		}
 	}
 };
 
@@ -0,0 +1,316 @@
+/*
+ * direction_switch.hpp
+ */
+
+#ifndef DIRECTION_SWITCH_HPP_
+#define DIRECTION_SWITCH_HPP_
+
+#include "utils.hpp"
+
+//-------------------------------------------------------------//
+// Adaptive Direction Switch
+//-------------------------------------------------------------//
+// Estimates the time of the next level in both directions and chooses the cheaper one.
+//   top-down : (cost per edge) * NQ * (edges per frontier vertex) + (cost per byte) * (NQ list bytes)
+//   bottom-up: (cost per edge) * Unvisited * (edges per unvisited vertex) + (cost per byte) * (bitmap bytes)
+// The costs are measured at every level and the edges per vertex are measured for each level number,
+// since the level structure is almost the same for all roots of a Kronecker graph.
+// The fixed thresholds (DENOM_*) are used until both directions are measured.
+//
+// Runtime options:
+// ADAPTIVE_SWITCH: enable this policy
+// ADAPTIVE_SWITCH_FILE: file to load the calibration from and to save it to (optional)
+
+class DirectionSwitchPolicy
+{
+public:
+	enum {
+		MAX_LEVELS = 64,
+		CALIBRATION_VERSION = 1,
+	};
+
+	// time (or edges) and its amount accumulated with exponential decay,
+	// so that the recent measurements have more weight.
+	struct CostSample {
+		double value;
+		double amount;
+
+		void add(double v, double a) {
+			const double decay = 0.9;
+			value = value * decay + v;
+			amount = amount * decay + a;
+		}
+		bool valid() const { return amount > 0 && value > 0; }
+		double rate() const { return valid() ? value / amount : 0; }
+	};
+
+	struct Calibration {
+		CostSample td_edge; // seconds per edge
+		CostSample bu_edge; // seconds per edge
+		CostSample list_byte; // seconds per byte of the NQ list expand
+		CostSample bitmap_byte; // seconds per byte of the NQ bitmap expand
+		CostSample td_fanout; // edges per frontier vertex
+		CostSample bu_fanout; // edges per unvisited vertex
+		CostSample td_level_fanout[MAX_LEVELS];
+		CostSample bu_level_fanout[MAX_LEVELS];
+	};
+
+	DirectionSwitchPolicy()
+		: enabled_(false)
+		, file_path_(NULL)
+		, scale_(0)
+		, expand_bitmap_or_list_(false)
+		, expand_bytes_(0)
+		, expand_time_(0)
+		, search_start_time_(0)
+	{
+		memset(&calib_, 0x00, sizeof(calib_));
+	}
+
+	void initialize(int scale) {
+		// the setting of the master is used: all processes have to call end_search()
+		int enabled = (getenv("ADAPTIVE_SWITCH") != NULL);
+		MPI_Bcast(&enabled, 1, MPI_INT, 0, mpi.comm_2d);
+		enabled_ = (enabled != 0);
+		file_path_ = getenv("ADAPTIVE_SWITCH_FILE");
+		scale_ = scale;
+		memset(&calib_, 0x00, sizeof(calib_));
+		if(enabled_ == false || file_path_ == NULL) return ;
+
+		int loaded = 0;
+		if(mpi.isMaster()) {
+			loaded = load(file_path_);
+			print_with_prefix("Adaptive direction switch: %s %s", file_path_,
+					loaded ? "is loaded" : "is not available. Use the fixed thresholds until calibrated.");
+		}
+		MPI_Bcast(&loaded, 1, MPI_INT, 0, mpi.comm_2d);
+		if(loaded) {
+			MPI_Bcast(&calib_, sizeof(calib_), MPI_BYTE, 0, mpi.comm_2d);
+		}
+	}
+
+	void finalize() {
+		if(enabled_ && file_path_ != NULL && mpi.isMaster()) {
+			if(save(file_path_) == false) {
+				print_with_prefix("Adaptive direction switch: Cannot write %s", file_path_);
+			}
+		}
+	}
+
+	bool enabled() const { return enabled_; }
+
+	void begin_bfs() {
+		expand_time_ = 0;
+		expand_bytes_ = 0;
+		search_start_time_ = MPI_Wtime();
+	}
+
+	void begin_expand(bool bitmap_or_list, int64_t bytes) {
+		expand_bitmap_or_list_ = bitmap_or_list;
+		expand_bytes_ = bytes;
+		expand_time_ = MPI_Wtime();
+	}
+
+	void end_expand() {
+		double now = MPI_Wtime();
+		expand_time_ = now - expand_time_;
+		search_start_time_ = now;
+	}
+
+	/**
+	 * Record the measurements of the search phase which has just finished
+	 * and the expand phase before it. All processes must call this function.
+	 * @param num_edge_top_down local number of edges relaxed in the top-down search
+	 * @param num_edge_bottom_up local number of edges relaxed in the bottom-up search
+	 * @param frontier global number of vertices in the frontier of this level
+	 * @param unvisited global number of unvisited vertices at the beginning of this level
+	 */
+	void end_search(int level, bool forward_or_backward,
+			int64_t num_edge_top_down, int64_t num_edge_bottom_up,
+			int64_t frontier, int64_t unvisited)
+	{
+		double send[4] = { (double)num_edge_top_down, (double)num_edge_bottom_up,
+				MPI_Wtime() - search_start_time_, expand_time_ };
+		double recv[4];
+		MPI_Allreduce(send, recv, 4, MPI_DOUBLE, MPI_SUM, mpi.comm_2d);
+		double search_time = recv[2] / mpi.size_2d;
+		double expand_time = recv[3] / mpi.size_2d;
+
+		if(forward_or_backward) {
+			add_sample(calib_.td_edge, calib_.td_fanout, calib_.td_level_fanout,
+					level, search_time, recv[0], frontier);
+		}
+		else {
+			add_sample(calib_.bu_edge, calib_.bu_fanout, calib_.bu_level_fanout,
+					level, search_time, recv[1], unvisited);
+		}
+		if(expand_bytes_ > 0) {
+			if(expand_bitmap_or_list_)
+				calib_.bitmap_byte.add(expand_time, expand_bytes_);
+			else
+				calib_.list_byte.add(expand_time, expand_bytes_);
+		}
+		expand_bytes_ = 0;
+	}
+
+	/**
+	 * @param fixed_decision the decision with the fixed threshold
+	 * @param level the number of the next level
+	 * @param frontier global NQ size
+	 * @param unvisited global number of unvisited vertices
+	 * @param list_bytes NQ list size in bytes (max of all processes)
+	 * @param bitmap_bytes local bitmap size in bytes
+	 * The top-down expand makes the NQ list in a buffer of bitmap_bytes bytes.
+	 * All processes must call these functions: the decision of the master is used.
+	 */
+	bool to_bottom_up(bool fixed_decision, int level,
+			int64_t frontier, int64_t unvisited, int64_t list_bytes, int64_t bitmap_bytes)
+	{
+		if(!calibrated()) return fixed_decision;
+		// the NQ list does not fit the buffer of the top-down expand
+		if(list_bytes > bitmap_bytes) return true;
+		double td = estimate_top_down(level, frontier, list_bytes);
+		double bu = estimate_bottom_up(level, unvisited, bitmap_bytes);
+		VERVOSE(print_estimate(td, bu));
+		return bcast_decision(bu < td);
+	}
+
+	bool to_top_down(bool fixed_decision, int level,
+			int64_t frontier, int64_t unvisited, int64_t list_bytes, int64_t bitmap_bytes)
+	{
+		if(!calibrated()) return fixed_decision;
+		double td = estimate_top_down(level, frontier, list_bytes);
+		double bu = estimate_bottom_up(level, unvisited, bitmap_bytes);
+		VERVOSE(print_estimate(td, bu));
+		bool decision = (td < bu);
+		// The BFS does not return to the bottom-up after this switch, so the NQ lists of
+		// the following levels have to fit the buffer of the top-down expand.
+		// Switch earlier than the fixed threshold only if all the unvisited vertices fit.
+		if(decision && !fixed_decision && unvisited * int64_t(sizeof(TwodVertex)) > bitmap_bytes) {
+			decision = false;
+		}
+		return bcast_decision(decision);
+	}
+
+	// returns true when the NQ should be expanded with the bitmap format
+	bool bitmap_or_list(bool fixed_decision, int64_t list_bytes, int64_t bitmap_bytes) {
+		if(!enabled_ || !calib_.list_byte.valid() || !calib_.bitmap_byte.valid()) return fixed_decision;
+		return bcast_decision(calib_.bitmap_byte.rate() * bitmap_bytes < calib_.list_byte.rate() * list_bytes);
+	}
+
+private:
+	bool enabled_;
+	const char* file_path_;
+	int scale_;
+	Calibration calib_;
+
+	bool expand_bitmap_or_list_;
+	int64_t expand_bytes_;
+	double expand_time_;
+	double search_start_time_;
+
+	// The estimates are computed from the same reduced measurements on all processes
+	// but the decision is taken from the master so that the processes never disagree.
+	static bool bcast_decision(bool decision) {
+		int value = decision;
+		MPI_Bcast(&value, 1, MPI_INT, 0, mpi.comm_2d);
+		return value != 0;
+	}
+
+	bool calibrated() const {
+		return enabled_ && calib_.td_edge.valid() && calib_.bu_edge.valid() &&
+				calib_.td_fanout.valid() && calib_.bu_fanout.valid();
+	}
+
+	static void add_sample(CostSample& edge_cost, CostSample& fanout, CostSample* level_fanout,
+			int level, double time, double edges, int64_t vertices)
+	{
+		if(edges <= 0 || vertices <= 0) return ;
+		edge_cost.add(time, edges);
+		fanout.add(edges, vertices);
+		if(level < MAX_LEVELS) level_fanout[level].add(edges, vertices);
+	}
+
+	static double get_fanout(const CostSample& fanout, const CostSample* level_fanout, int level) {
+		if(level < MAX_LEVELS && level_fanout[level].valid()) return level_fanout[level].rate();
+		return fanout.rate();
+	}
+
+	double estimate_top_down(int level, int64_t frontier, int64_t list_bytes) const {
+		double edges = frontier * get_fanout(calib_.td_fanout, calib_.td_level_fanout, level);
+		return calib_.td_edge.rate() * edges + calib_.list_byte.rate() * list_bytes;
+	}
+
+	double estimate_bottom_up(int level, int64_t unvisited, int64_t bitmap_bytes) const {
+		double edges = unvisited * get_fanout(calib_.bu_fanout, calib_.bu_level_fanout, level);
+		return calib_.bu_edge.rate() * edges + calib_.bitmap_byte.rate() * bitmap_bytes;
+	}
+
+	void print_estimate(double td, double bu) {
+		if(mpi.isMaster()) print_with_prefix("Estimated time of the next level: top-down %f ms, bottom-up %f ms",
+				td * 1000.0, bu * 1000.0);
+	}
+
+	// The file is a text file. Each line is "<name> <value> <amount>" or "<name> <level> <value> <amount>".
+	bool save(const char* path) {
+		FILE* fp = fopen(path, "w");
+		if(fp == NULL) return false;
+		fprintf(fp, "version %d\n", CALIBRATION_VERSION);
+		fprintf(fp, "scale %d\n", scale_);
+		fprintf(fp, "processes %d\n", mpi.size_2d);
+#define SAVE_SAMPLE(name) fprintf(fp, #name " %.17g %.17g\n", calib_.name.value, calib_.name.amount)
+		SAVE_SAMPLE(td_edge);
+		SAVE_SAMPLE(bu_edge);
+		SAVE_SAMPLE(list_byte);
+		SAVE_SAMPLE(bitmap_byte);
+		SAVE_SAMPLE(td_fanout);
+		SAVE_SAMPLE(bu_fanout);
+#undef SAVE_SAMPLE
+		for(int i = 0; i < MAX_LEVELS; ++i) {
+			const CostSample& td = calib_.td_level_fanout[i];
+			const CostSample& bu = calib_.bu_level_fanout[i];
+			if(td.valid()) fprintf(fp, "td_level_fanout %d %.17g %.17g\n", i, td.value, td.amount);
+			if(bu.valid()) fprintf(fp, "bu_level_fanout %d %.17g %.17g\n", i, bu.value, bu.amount);
+		}
+		return fclose(fp) == 0;
+	}
+
+	// returns false if the file does not exist or was written for another configuration
+	bool load(const char* path) {
+		FILE* fp = fopen(path, "r");
+		if(fp == NULL) return false;
+		Calibration c;
+		memset(&c, 0x00, sizeof(c));
+		int version = -1, scale = -1, processes = -1;
+		char name[64];
+		while(fscanf(fp, "%63s", name) == 1) {
+			int level;
+			CostSample s;
+			if(strcmp(name, "version") == 0) { if(fscanf(fp, "%d", &version) != 1) break; }
+			else if(strcmp(name, "scale") == 0) { if(fscanf(fp, "%d", &scale) != 1) break; }
+			else if(strcmp(name, "processes") == 0) { if(fscanf(fp, "%d", &processes) != 1) break; }
+			else if(strcmp(name, "td_level_fanout") == 0 || strcmp(name, "bu_level_fanout") == 0) {
+				if(fscanf(fp, "%d %lf %lf", &level, &s.value, &s.amount) != 3) break;
+				if(level < 0 || level >= MAX_LEVELS) continue;
+				(name[0] == 't' ? c.td_level_fanout : c.bu_level_fanout)[level] = s;
+			}
+			else {
+				if(fscanf(fp, "%lf %lf", &s.value, &s.amount) != 2) break;
+#define LOAD_SAMPLE(sname) if(strcmp(name, #sname) == 0) c.sname = s
+				LOAD_SAMPLE(td_edge);
+				LOAD_SAMPLE(bu_edge);
+				LOAD_SAMPLE(list_byte);
+				LOAD_SAMPLE(bitmap_byte);
+				LOAD_SAMPLE(td_fanout);
+				LOAD_SAMPLE(bu_fanout);
+#undef LOAD_SAMPLE
+			}
+		}
+		fclose(fp);
+		if(version != CALIBRATION_VERSION || scale != scale_ || processes != mpi.size_2d) return false;
+		calib_ = c;
+		return true;
+	}
+};
+
+#endif /* DIRECTION_SWITCH_HPP_ */
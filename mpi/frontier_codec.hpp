@@ -0,0 +1,377 @@
+/*
+ * frontier_codec.hpp
+ */
+
+#ifndef FRONTIER_CODEC_HPP_
+#define FRONTIER_CODEC_HPP_
+
+#include "utils.hpp"
+
+//-------------------------------------------------------------//
+// Compressed Frontier Exchange
+//-------------------------------------------------------------//
+// The allgather of the frontier (NQ or visited) bitmaps with the adaptive encoding.
+// At every level, each sender estimates the sizes of the formats below from the number of
+// the set bits and the literal words, and encodes its bitmap only in the smallest one:
+//  RAW   : the bitmap words
+//  WAH   : word-aligned hybrid: (fill word run, literal words) pairs.
+//          The fill words are all-zero or all-one words.
+//  DELTA : the differences of the positions of the set bits
+// The run lengths and the differences are stored with the variable length quantity (vlq).
+// The bitmap is divided into the chunks, which are encoded and decoded in parallel.
+// The encoded streams are exchanged only if they are much smaller than the raw bitmaps,
+// since decoding is not free. Otherwise, the caller exchanges the raw bitmaps.
+// A dense bitmap is neither encoded nor copied unless the other streams are small enough.
+//
+// Stream format (int64_t words):
+//  [0] format | (number of chunks << 8)
+//  RAW: the bitmap words follow.
+//  WAH, DELTA: the byte offsets of the chunks (number of chunks + 1 words) and the data follow.
+//
+// Runtime options:
+// FRONTIER_COMPRESSION: 1 = enable
+
+class FrontierCodec
+{
+public:
+	typedef uint64_t BitmapType;
+
+	enum FORMAT {
+		RAW = 0,
+		WAH = 1,
+		DELTA = 2,
+		NUM_FORMATS = 3,
+	};
+
+	FrontierCodec()
+		: enabled_(false)
+		, send_buf_(NULL)
+		, recv_buf_(NULL)
+		, send_capacity_(0)
+		, recv_capacity_(0)
+		, send_format_(RAW)
+		, chunk_bytes_(NULL)
+		, chunk_capacity_(0)
+		, recv_count_(NULL)
+		, recv_offset_(NULL)
+		, comm_capacity_(0)
+	{
+		memset(num_streams_, 0, sizeof(num_streams_));
+	}
+
+	~FrontierCodec() {
+		release_buffer();
+	}
+
+	void initialize() {
+		const char* str = getenv("FRONTIER_COMPRESSION");
+		enabled_ = (str != NULL && atoi(str) != 0);
+		memset(num_streams_, 0, sizeof(num_streams_));
+	}
+
+	bool enabled() const { return enabled_; }
+
+	void release_buffer() {
+		free(send_buf_); send_buf_ = NULL; send_capacity_ = 0;
+		free(recv_buf_); recv_buf_ = NULL; recv_capacity_ = 0;
+		free(chunk_bytes_); chunk_bytes_ = NULL; chunk_capacity_ = 0;
+		free(recv_count_); recv_count_ = NULL;
+		free(recv_offset_); recv_offset_ = NULL; comm_capacity_ = 0;
+	}
+
+	/**
+	 * Gathers the bitmaps of width words of all the processes of the communicator to recv_buffer
+	 * in the rank order, like MPI_Allgather. comm is used by MY_ALLGATHER and mpi_comm is used otherwise.
+	 * Returns false without exchanging the bitmaps if the encoded streams are not small enough.
+	 * The result is the same on all the processes. This is a collective operation.
+	 * comm_bytes: the number of bytes received.
+	 */
+	bool allgather(const BitmapType* bitmap, int64_t width, BitmapType* recv_buffer,
+			COMM_2D comm, MPI_Comm mpi_comm, int64_t* comm_bytes)
+	{
+		TRACER(frontier_codec);
+#if ENABLE_MY_ALLGATHER
+		MPI_Comm count_comm = comm.comm;
+#else
+		MPI_Comm count_comm = mpi_comm;
+#endif
+		int size; MPI_Comm_size(count_comm, &size);
+		int rank; MPI_Comm_rank(count_comm, &rank);
+
+		int stream_words = encode(bitmap, width);
+		if(comm_capacity_ < size) {
+			free(recv_count_);
+			free(recv_offset_);
+			comm_capacity_ = size;
+			recv_count_ = static_cast<int*>(cache_aligned_xmalloc(comm_capacity_*sizeof(int)));
+			recv_offset_ = static_cast<int*>(cache_aligned_xmalloc((comm_capacity_+1)*sizeof(int)));
+		}
+		int* recv_count = recv_count_;
+		int* recv_offset = recv_offset_;
+		MPI_Allgather(&stream_words, 1, MPI_INT, recv_count, 1, MPI_INT, count_comm);
+		recv_offset[0] = 0;
+		for(int i = 0; i < size; ++i) {
+			recv_offset[i+1] = recv_offset[i] + recv_count[i];
+		}
+		const int64_t total_words = recv_offset[size];
+		if(total_words * 4 >= width * size * 3) {
+			// not small enough
+			return false;
+		}
+		if(send_format_ == RAW) {
+			reserve_send_buffer(stream_words);
+			send_buf_[0] = RAW;
+			memcpy(send_buf_ + 1, bitmap, width * sizeof(BitmapType));
+		}
+
+		if(recv_capacity_ < total_words) {
+			free(recv_buf_);
+			recv_capacity_ = total_words;
+			recv_buf_ = static_cast<int64_t*>(cache_aligned_xmalloc(recv_capacity_*sizeof(int64_t)));
+		}
+#if ENABLE_MY_ALLGATHER == 1
+		MpiCol::my_allgatherv(send_buf_, stream_words, recv_buf_, recv_count, recv_offset, comm);
+#elif ENABLE_MY_ALLGATHER == 2
+		my_allgatherv_2d(send_buf_, stream_words, recv_buf_, recv_count, recv_offset, comm);
+#else
+		MPI_Allgatherv(send_buf_, stream_words, MpiTypeOf<int64_t>::type,
+				recv_buf_, recv_count, recv_offset, MpiTypeOf<int64_t>::type, mpi_comm);
+#endif
+
+		// the number of the tasks of each stream is the max number of chunks
+		int max_chunks = 1;
+		for(int i = 0; i < size; ++i) {
+			int64_t head = recv_buf_[recv_offset[i]];
+			++num_streams_[head & 0xFF];
+			max_chunks = std::max<int>(max_chunks, head >> 8);
+		}
+		const int num_tasks = size * max_chunks;
+#pragma omp parallel for schedule(dynamic)
+		for(int task = 0; task < num_tasks; ++task) {
+			const int src = task / max_chunks;
+			const int chunk = task % max_chunks;
+			BitmapType* dst = recv_buffer + width * src;
+			const int64_t* stream = recv_buf_ + recv_offset[src];
+			const int format = stream[0] & 0xFF;
+			const int num_chunks = stream[0] >> 8;
+			if(src == rank || format == RAW) {
+				// split the copy into the tasks
+				const BitmapType* src_bitmap = (src == rank) ? bitmap : (const BitmapType*)(stream + 1);
+				int64_t begin, end;
+				chunk_range(width, max_chunks, chunk, &begin, &end);
+				memcpy(dst + begin, src_bitmap + begin, (end - begin) * sizeof(BitmapType));
+			}
+			else if(chunk < num_chunks) {
+				const int64_t* chunk_offset = stream + 1;
+				const uint8_t* data = (const uint8_t*)(chunk_offset + num_chunks + 1);
+				const uint8_t* ptr = data + chunk_offset[chunk];
+				const uint8_t* ptr_end = data + chunk_offset[chunk + 1];
+				int64_t begin, end;
+				chunk_range(width, num_chunks, chunk, &begin, &end);
+				if(format == WAH) decode_wah(ptr, ptr_end, dst, begin, end);
+				else decode_delta(ptr, ptr_end, dst, begin, end);
+			}
+		}
+
+		*comm_bytes = total_words * sizeof(int64_t);
+		return true;
+	}
+
+	// the number of the received streams of each format
+	const int64_t* num_streams() const { return num_streams_; }
+
+private:
+	bool enabled_;
+	int64_t* send_buf_;
+	int64_t* recv_buf_;
+	int64_t send_capacity_;
+	int64_t recv_capacity_;
+	int send_format_; // RAW: send_buf_ is written only if the streams are exchanged
+	int64_t* chunk_bytes_;
+	int chunk_capacity_;
+	int* recv_count_;
+	int* recv_offset_;
+	int comm_capacity_;
+	int64_t num_streams_[NUM_FORMATS];
+
+	static void chunk_range(int64_t width, int num_chunks, int chunk, int64_t* begin, int64_t* end) {
+		const int64_t chunk_width = (width + num_chunks - 1) / num_chunks;
+		*begin = std::min(width, chunk_width * chunk);
+		*end = std::min(width, *begin + chunk_width);
+	}
+
+	static int vlq_size(uint32_t v) {
+		return v < 128 ? 1 : v < 128*128 ? 2 : v < 128*128*128 ? 3 : v < 128*128*128*128 ? 4 : 5;
+	}
+
+	template <bool WRITE>
+	static int64_t put_vlq(uint8_t* ptr, uint32_t v) {
+		if(WRITE) {
+			int len;
+			VARINT_ENCODE_MACRO_32(ptr, v, len);
+			return len;
+		}
+		return vlq_size(v);
+	}
+
+	// returns the number of bytes. Only computes the size if WRITE is false.
+	template <bool WRITE>
+	static int64_t encode_wah(const BitmapType* bitmap, int64_t begin, int64_t end, uint8_t* out) {
+		int64_t pos = 0;
+		int64_t i = begin;
+		while(i < end) {
+			uint32_t run = 0;
+			uint32_t fill_bit = 0;
+			if(bitmap[i] == BitmapType(0) || bitmap[i] == ~BitmapType(0)) {
+				const BitmapType fill = bitmap[i];
+				fill_bit = (fill != BitmapType(0));
+				for( ; i < end && bitmap[i] == fill; ++i) ++run;
+			}
+			const int64_t lit_start = i;
+			for( ; i < end && bitmap[i] != BitmapType(0) && bitmap[i] != ~BitmapType(0); ++i) ;
+			const uint32_t num_literals = i - lit_start;
+			pos += put_vlq<WRITE>(out + pos, (run << 1) | fill_bit);
+			pos += put_vlq<WRITE>(out + pos, num_literals);
+			if(WRITE) memcpy(out + pos, bitmap + lit_start, num_literals * sizeof(BitmapType));
+			pos += num_literals * sizeof(BitmapType);
+		}
+		return pos;
+	}
+
+	template <bool WRITE>
+	static int64_t encode_delta(const BitmapType* bitmap, int64_t begin, int64_t end, uint8_t* out) {
+		int64_t pos = 0;
+		int64_t prev = begin * PRM::NBPE;
+		for(int64_t i = begin; i < end; ++i) {
+			BitmapType bmp_val = bitmap[i];
+			while(bmp_val != BitmapType(0)) {
+				const int64_t bit = i * PRM::NBPE + __builtin_ctzl(bmp_val);
+				pos += put_vlq<WRITE>(out + pos, bit - prev);
+				prev = bit;
+				bmp_val &= bmp_val - 1;
+			}
+		}
+		return pos;
+	}
+
+	static void decode_wah(const uint8_t* ptr, const uint8_t* ptr_end,
+			BitmapType* dst, int64_t begin, int64_t end)
+	{
+		int64_t i = begin;
+		while(ptr < ptr_end) {
+			uint32_t token, num_literals;
+			int len;
+			VARINT_DECODE_MACRO_32(ptr, token, len); ptr += len;
+			VARINT_DECODE_MACRO_32(ptr, num_literals, len); ptr += len;
+			const uint32_t run = token >> 1;
+			memset(dst + i, (token & 1) ? 0xFF : 0, run * sizeof(BitmapType));
+			i += run;
+			memcpy(dst + i, ptr, num_literals * sizeof(BitmapType));
+			ptr += num_literals * sizeof(BitmapType);
+			i += num_literals;
+		}
+		assert (i == end);
+	}
+
+	static void decode_delta(const uint8_t* ptr, const uint8_t* ptr_end,
+			BitmapType* dst, int64_t begin, int64_t end)
+	{
+		memset(dst + begin, 0, (end - begin) * sizeof(BitmapType));
+		int64_t bit = begin * PRM::NBPE;
+		while(ptr < ptr_end) {
+			uint32_t diff;
+			int len;
+			VARINT_DECODE_MACRO_32(ptr, diff, len); ptr += len;
+			bit += diff;
+			dst[bit >> PRM::LOG_NBPE] |= BitmapType(1) << (bit & PRM::NBPE_MASK);
+		}
+		assert (bit < end * PRM::NBPE || bit == begin * PRM::NBPE);
+	}
+
+	void reserve_send_buffer(int64_t words) {
+		if(send_capacity_ < words) {
+			free(send_buf_);
+			send_capacity_ = words;
+			send_buf_ = static_cast<int64_t*>(cache_aligned_xmalloc(send_capacity_*sizeof(int64_t)));
+		}
+	}
+
+	// Estimates the sizes of WAH and DELTA from the number of the set bits and the literal words
+	// (neither all-zero nor all-one) and returns the smaller one, or RAW if it is not expected
+	// to pass the threshold of allgather(). The bitmap is scanned once without encoding.
+	static int choose_format(const BitmapType* bitmap, int64_t width) {
+		int64_t num_bits = 0, num_literals = 0;
+#pragma omp parallel for reduction(+:num_bits, num_literals)
+		for(int64_t i = 0; i < width; ++i) {
+			const BitmapType bmp_val = bitmap[i];
+			num_bits += __builtin_popcountl(bmp_val);
+			num_literals += (bmp_val != BitmapType(0) && bmp_val != ~BitmapType(0));
+		}
+		// DELTA: one vlq of the average difference for each set bit
+		const int64_t avg_diff = width * PRM::NBPE / std::max<int64_t>(1, num_bits);
+		const int64_t delta_bytes = num_bits * vlq_size(uint32_t(std::min<int64_t>(avg_diff, UINT32_MAX)));
+		// WAH: the literal words and at most two vlq bytes for each of them
+		const int64_t wah_bytes = num_literals * (sizeof(BitmapType) + 2);
+		const int64_t bytes = std::min(delta_bytes, wah_bytes);
+		if(bytes * 4 >= width * int64_t(sizeof(BitmapType)) * 3) return RAW;
+		return (delta_bytes <= wah_bytes) ? DELTA : WAH;
+	}
+
+	// encodes the bitmap to send_buf_ and returns the number of words.
+	// The RAW stream is not written here (see allgather()).
+	int encode(const BitmapType* bitmap, int64_t width) {
+		const int raw_words = 1 + width;
+		const int format = choose_format(bitmap, width);
+		send_format_ = RAW;
+		if(format == RAW) return raw_words;
+
+		const int num_chunks = omp_get_max_threads();
+		if(chunk_capacity_ < num_chunks + 1) {
+			free(chunk_bytes_);
+			chunk_capacity_ = num_chunks + 1;
+			chunk_bytes_ = static_cast<int64_t*>(cache_aligned_xmalloc(chunk_capacity_*sizeof(int64_t)));
+		}
+		int64_t* chunk_bytes = chunk_bytes_;
+
+#pragma omp parallel for
+		for(int c = 0; c < num_chunks; ++c) {
+			int64_t begin, end;
+			chunk_range(width, num_chunks, c, &begin, &end);
+			chunk_bytes[c] = (format == WAH) ?
+					encode_wah<false>(bitmap, begin, end, NULL) :
+					encode_delta<false>(bitmap, begin, end, NULL);
+		}
+
+		// prefix sum to get the offsets
+		int64_t sum = 0;
+		for(int c = 0; c < num_chunks; ++c) {
+			int64_t bytes = chunk_bytes[c];
+			chunk_bytes[c] = sum;
+			sum += bytes;
+		}
+		chunk_bytes[num_chunks] = sum;
+		const int64_t header_words = 1 + num_chunks + 1;
+		const int64_t words = header_words + (sum + sizeof(int64_t) - 1) / sizeof(int64_t);
+		if(words >= raw_words) return raw_words;
+
+		reserve_send_buffer(words);
+		send_format_ = format;
+		send_buf_[0] = format | (int64_t(num_chunks) << 8);
+		int64_t* chunk_offset = send_buf_ + 1;
+		uint8_t* data = (uint8_t*)(chunk_offset + num_chunks + 1);
+		for(int c = 0; c <= num_chunks; ++c) {
+			chunk_offset[c] = chunk_bytes[c];
+		}
+		send_buf_[words - 1] = 0; // padding
+#pragma omp parallel for
+		for(int c = 0; c < num_chunks; ++c) {
+			int64_t begin, end;
+			chunk_range(width, num_chunks, c, &begin, &end);
+			if(format == WAH) encode_wah<true>(bitmap, begin, end, data + chunk_offset[c]);
+			else encode_delta<true>(bitmap, begin, end, data + chunk_offset[c]);
+		}
+		return words;
+	}
+};
+
+#endif /* FRONTIER_CODEC_HPP_ */
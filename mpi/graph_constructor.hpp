@@ -10,6 +10,9 @@
 
 #include "parameters.h"
 #include "limits.h"
+#include "radix_sort.hpp"
+
+#include <sys/mman.h>
 
 //-------------------------------------------------------------//
 // 2D partitioning
@@ -21,6 +24,28 @@ int inline edge_owner(int64_t v0, int64_t v1) { return vertex_owner_r(v0) + vert
 int inline vertex_owner(int64_t v) { return v % mpi.size_2d; }
 int64_t inline vertex_local(int64_t v) { return v / mpi.size_2d; }
 
+#if COMPRESSED_EDGE_ARRAY
+// Edge array with fixed-width bit-packing. The edge e occupies the bits [e*bits, (e+1)*bits)
+// of the little-endian bit stream. An edge is decoded with one unaligned 64-bit load,
+// so bits must be at most 57 and the stream has one word of padding at the end.
+struct PackedEdgeArray
+{
+	const uint8_t* data;
+	int bits;
+	uint64_t mask;
+
+	int64_t operator[](int64_t e) const {
+		const int64_t bit_offset = e * bits;
+		uint64_t word;
+		memcpy(&word, data + (bit_offset >> 3), sizeof(word));
+		return (word >> (bit_offset & 7)) & mask;
+	}
+};
+typedef PackedEdgeArray EdgeArrayRef;
+#else
+typedef const int64_t* EdgeArrayRef;
+#endif
+
 class Graph2DCSR
 {
 	enum {
@@ -33,8 +58,10 @@ public:
 	, row_sums_(NULL)
 	, has_edge_bitmap_(NULL)
 	, reorder_map_(NULL)
+	, invert_map_(NULL)
 	, orig_vertexes_(NULL)
 	, edge_array_(NULL)
+	, edge_bits_(0)
 	, row_starts_(NULL)
 	, isolated_edges_(NULL)
 	, log_orig_global_verts_(0)
@@ -42,6 +69,8 @@ public:
 	, max_weight_(0)
 	, num_global_edges_(0)
 	, num_global_verts_(0)
+	, mapped_region_(NULL)
+	, mapped_size_(0)
 	{ }
 	~Graph2DCSR()
 	{
@@ -50,6 +79,15 @@ public:
 
 	void clean()
 	{
+		if(mapped_region_ != NULL) {
+			// all arrays point into the snapshot mapping
+			munmap(mapped_region_, mapped_size_);
+			mapped_region_ = NULL; mapped_size_ = 0;
+			row_bitmap_ = NULL; row_sums_ = NULL; reorder_map_ = NULL; invert_map_ = NULL;
+			orig_vertexes_ = NULL; has_edge_bitmap_ = NULL; edge_array_ = NULL;
+			row_starts_ = NULL; isolated_edges_ = NULL;
+			return ;
+		}
 		free(row_bitmap_); row_bitmap_ = NULL;
 		free(row_sums_); row_sums_ = NULL;
 		free(reorder_map_); reorder_map_ = NULL;
@@ -63,6 +101,26 @@ public:
 
 	int pred_size() { return num_orig_local_verts_; }
 
+	// Use this to read the edge array since it may be compressed.
+	EdgeArrayRef edge_array() const {
+#if COMPRESSED_EDGE_ARRAY
+		PackedEdgeArray packed = { reinterpret_cast<const uint8_t*>(edge_array_),
+				edge_bits_, (uint64_t(1) << edge_bits_) - 1 };
+		return packed;
+#else
+		return edge_array_;
+#endif
+	}
+
+	// number of int64_t words of edge_array_ for num_edges edges
+	int64_t edge_array_words(int64_t num_edges) const {
+#if COMPRESSED_EDGE_ARRAY
+		return (num_edges * edge_bits_ + 63) / 64 + 1; // one word padding for the decoder
+#else
+		return num_edges;
+#endif
+	}
+
 	int log_orig_global_verts() const { return log_orig_global_verts_; }
 
 	// Reference Functions
@@ -124,7 +182,8 @@ public:
 	LocalVertex* invert_map_; // Index: Reordered Pred
 	LocalVertex* orig_vertexes_; // Index: CSI
 
-	int64_t* edge_array_;
+	int64_t* edge_array_; // bit-packed with edge_bits_ bits per edge if COMPRESSED_EDGE_ARRAY
+	int edge_bits_;
 	int64_t* row_starts_; // Index: CSI
 	int64_t* isolated_edges_; // Index: CSI
 
@@ -140,6 +199,10 @@ public:
 	int orig_local_bits_; // local bits for original vertex id
 	int r_bits_;
 	int64_t num_local_verts_; // number of local vertices for computation
+
+	// not NULL when the graph is loaded from a snapshot file (see graph_snapshot.hpp)
+	void* mapped_region_;
+	int64_t mapped_size_;
 };
 
 namespace detail {
@@ -191,6 +254,8 @@ struct DegreeCalculation {
 	enum {
 		LOG_BLOCK_SIZE = LOG_EDGE_PART_SIZE - 5,
 		BLOCK_SIZE = 1 << LOG_BLOCK_SIZE,
+		// VERTEX_REORDERING == 3: each edge has the original id of the other end
+		EDGE_WORDS = (VERTEX_REORDERING == 3) ? 2 : 1,
 	};
 
 	int org_local_bits_;
@@ -208,6 +273,9 @@ struct DegreeCalculation {
 	int64_t* row_length_;
 	int64_t* row_offset_;
 	std::vector<DWideRowEdge>* dwide_row_data_;
+#if VERTEX_REORDERING == 3
+	std::vector<int64_t>* dwide_row_nbrs_; // the other end of dwide_row_data_
+#endif
 	LocalVertex* vertexes_; // passed to ConstructionData
 
 	DegreeCalculation(int orig_local_bits, int log_local_verts_unit) {
@@ -219,12 +287,18 @@ struct DegreeCalculation {
 			throw "Error";
 		}
 		dwide_row_data_ = new std::vector<DWideRowEdge>[num_rows_]();
+#if VERTEX_REORDERING == 3
+		dwide_row_nbrs_ = new std::vector<int64_t>[num_rows_]();
+#endif
 		row_length_ = static_cast<int64_t*>(cache_aligned_xcalloc(num_rows_*sizeof(int64_t)));
 		row_offset_ = static_cast<int64_t*>(cache_aligned_xcalloc(num_rows_*sizeof(int64_t)));
 	}
 
 	~DegreeCalculation() {
 		if(dwide_row_data_ != NULL) { delete [] dwide_row_data_; dwide_row_data_ = NULL; }
+#if VERTEX_REORDERING == 3
+		if(dwide_row_nbrs_ != NULL) { delete [] dwide_row_nbrs_; dwide_row_nbrs_ = NULL; }
+#endif
 		if(wide_row_length_ != NULL) { free(wide_row_length_); wide_row_length_ = NULL; }
 		if(row_bitmap_ != NULL) { free(row_bitmap_); row_bitmap_ = NULL; }
 		if(row_sums_ != NULL) { free(row_sums_); row_sums_ = NULL; }
@@ -246,12 +320,14 @@ struct DegreeCalculation {
 	}
 
 	// edges: high: v1's c, low: v0's vertex_local
-	void add(int64_t* edges, int64_t num_edges) {
+	// (VERTEX_REORDERING == 3: followed by v1, EDGE_WORDS words for each edge)
+	void add(int64_t* edges, int64_t num_words) {
+		const int64_t num_edges = num_words / EDGE_WORDS;
 
 		// count edges
 #pragma omp parallel for
 		for(int64_t i = 0; i < num_edges; ++i) {
-			SeparatedId id(edges[i]);
+			SeparatedId id(edges[i*EDGE_WORDS]);
 			TwodVertex local = id.low(org_local_bits_);
 			int row = local >> LOG_BLOCK_SIZE;
 
@@ -261,12 +337,15 @@ struct DegreeCalculation {
 		// resize data store
 		for(int i = 0; i < num_rows_; ++i) {
 			dwide_row_data_[i].resize(row_length_[i], DWideRowEdge(0,0));
+#if VERTEX_REORDERING == 3
+			dwide_row_nbrs_[i].resize(row_length_[i], 0);
+#endif
 		}
 
 		// store data
 #pragma omp parallel for
 		for(int64_t i = 0; i < num_edges; ++i) {
-			SeparatedId id(edges[i]);
+			SeparatedId id(edges[i*EDGE_WORDS]);
 			int c = id.high(org_local_bits_);
 			TwodVertex local = id.low(org_local_bits_);
 			int row = local >> LOG_BLOCK_SIZE;
@@ -274,6 +353,9 @@ struct DegreeCalculation {
 
 			int64_t offset = __sync_fetch_and_add(&row_offset_[row], 1);
 			dwide_row_data_[row][offset] = DWideRowEdge(src_vertex, c);
+#if VERTEX_REORDERING == 3
+			dwide_row_nbrs_[row][offset] = edges[i*EDGE_WORDS + 1];
+#endif
 		}
 	}
 
@@ -315,7 +397,43 @@ private:
 		}
 
 		// sort by degree
+#if VERTEX_REORDERING == 3
+		locality_order(degree, num_verts);
+#elif RADIX_SORT_CSR && (VERTEX_REORDERING == 2 || VERTEX_REORDERING == 1)
+		{
+			// 2: descending order of the degree, 1: the vertices which have edges first
+			uint64_t* keys = static_cast<uint64_t*>(cache_aligned_xmalloc(std::max<int64_t>(1, num_verts)*sizeof(uint64_t)));
+#if VERTEX_REORDERING == 2
+			int64_t max_degree = 0;
+#pragma omp parallel for reduction(max:max_degree)
+			for(int64_t i = 0; i < num_verts; ++i) {
+				max_degree = std::max(max_degree, degree[i]);
+			}
+			const int key_bits = get_msb_index(std::max<int64_t>(1, max_degree)) + 1;
+#pragma omp parallel for
+			for(int64_t i = 0; i < num_verts; ++i) {
+				keys[i] = max_degree - degree[i];
+			}
+#else
+			const int key_bits = 1;
+#pragma omp parallel for
+			for(int64_t i = 0; i < num_verts; ++i) {
+				keys[i] = (degree[i] == 0);
+			}
+#endif
+			radix_sort::parallel_sort2(keys, vertexes_, num_verts, key_bits);
+			// the sorted degrees (VERTEX_REORDERING == 1: only whether it is zero is used below)
+#pragma omp parallel for
+			for(int64_t i = 0; i < num_verts; ++i) {
 #if VERTEX_REORDERING == 2
+				degree[i] = max_degree - keys[i];
+#else
+				degree[i] = 1 - keys[i];
+#endif
+			}
+			free(keys);
+		}
+#elif VERTEX_REORDERING == 2
 		sort2(degree, vertexes_, num_verts, std::greater<int64_t>());
 #elif VERTEX_REORDERING == 1
 		sort2(degree, vertexes_, num_verts, ZeroOrElseComparator<int64_t>());
@@ -351,6 +469,115 @@ private:
 		return reorde_map;
 	}
 
+#if VERTEX_REORDERING == 3
+	// Orders the vertices so that the vertices which share neighbors are close.
+	// The vertices are visited in BFS order on the bipartite graph of the local vertices
+	// and their neighbors: when a neighbor is expanded, all the local vertices adjacent
+	// to it are appended. The seeds are taken in descending order of the degree and
+	// the isolated vertices are placed at the end.
+	// In top_down_receive(), the targets of a source are the local vertices sharing the source,
+	// so their visited bits are in close words; in the bottom-up search, the neighbors of a row
+	// are close in shared_visited_ for the same reason on their owners.
+	// On return, vertexes_ has the order and degree is sorted by it.
+	void locality_order(int64_t* degree, int64_t num_verts) {
+		TRACER(locality_order);
+		// the edges (local vertex, neighbor) sorted by the neighbor
+		int64_t num_edges = 0;
+		for(int r = 0; r < num_rows_; ++r) num_edges += dwide_row_data_[r].size();
+		int64_t* row_offsets = static_cast<int64_t*>(cache_aligned_xmalloc((num_rows_ + 1)*sizeof(int64_t)));
+		row_offsets[0] = 0;
+		for(int r = 0; r < num_rows_; ++r) row_offsets[r + 1] = row_offsets[r] + dwide_row_data_[r].size();
+		uint64_t* nbrs = static_cast<uint64_t*>(cache_aligned_xmalloc(std::max<int64_t>(1, num_edges)*sizeof(uint64_t)));
+		LocalVertex* locals = static_cast<LocalVertex*>(cache_aligned_xmalloc(std::max<int64_t>(1, num_edges)*sizeof(LocalVertex)));
+		uint64_t max_nbr = 0;
+#pragma omp parallel for reduction(max:max_nbr) schedule(dynamic, 1)
+		for(int r = 0; r < num_rows_; ++r) {
+			const std::vector<DWideRowEdge>& row_data = dwide_row_data_[r];
+			const std::vector<int64_t>& row_nbrs = dwide_row_nbrs_[r];
+			for(int64_t c = 0; c < int64_t(row_data.size()); ++c) {
+				nbrs[row_offsets[r] + c] = row_nbrs[c];
+				locals[row_offsets[r] + c] = r * BLOCK_SIZE + row_data[c].src_vertex;
+				max_nbr = std::max<uint64_t>(max_nbr, row_nbrs[c]);
+			}
+			std::vector<int64_t>().swap(dwide_row_nbrs_[r]); // release memory
+		}
+		free(row_offsets);
+		radix_sort::parallel_sort2(nbrs, locals, num_edges, get_msb_index(int64_t(std::max<uint64_t>(1, max_nbr))) + 1);
+
+		// nbr_starts: the edges of each distinct neighbor in locals
+		// local_nbrs: CSR of the local vertices to the neighbor indices
+		int64_t num_nbrs = 0;
+		for(int64_t i = 0; i < num_edges; ++i) {
+			if(i == 0 || nbrs[i] != nbrs[i - 1]) ++num_nbrs;
+		}
+		int64_t* nbr_starts = static_cast<int64_t*>(cache_aligned_xmalloc((num_nbrs + 1)*sizeof(int64_t)));
+		int64_t* local_starts = static_cast<int64_t*>(cache_aligned_xcalloc((num_verts + 1)*sizeof(int64_t)));
+		int64_t* local_nbrs = static_cast<int64_t*>(cache_aligned_xmalloc(std::max<int64_t>(1, num_edges)*sizeof(int64_t)));
+		for(int64_t i = 0; i < num_verts; ++i) local_starts[i + 1] = local_starts[i] + degree[i];
+		int64_t n = -1;
+		for(int64_t i = 0; i < num_edges; ++i) {
+			if(i == 0 || nbrs[i] != nbrs[i - 1]) nbr_starts[++n] = i;
+			local_nbrs[local_starts[locals[i]]++] = n;
+		}
+		nbr_starts[num_nbrs] = num_edges;
+		for(int64_t i = num_verts; i > 0; --i) local_starts[i] = local_starts[i - 1];
+		local_starts[0] = 0;
+		free(nbrs);
+
+		// seeds in descending order of the degree
+		LocalVertex* seeds = static_cast<LocalVertex*>(cache_aligned_xmalloc(num_verts*sizeof(LocalVertex)));
+		uint64_t* keys = static_cast<uint64_t*>(cache_aligned_xmalloc(num_verts*sizeof(uint64_t)));
+		int64_t max_degree = 0;
+		for(int64_t i = 0; i < num_verts; ++i) max_degree = std::max(max_degree, degree[i]);
+#pragma omp parallel for
+		for(int64_t i = 0; i < num_verts; ++i) {
+			seeds[i] = i;
+			keys[i] = max_degree - degree[i];
+		}
+		radix_sort::parallel_sort2(keys, seeds, num_verts, get_msb_index(std::max<int64_t>(1, max_degree)) + 1);
+		free(keys);
+
+		// BFS: vertexes_ is the queue
+		uint8_t* visited = static_cast<uint8_t*>(cache_aligned_xcalloc(num_verts*sizeof(uint8_t)));
+		uint8_t* nbr_visited = static_cast<uint8_t*>(cache_aligned_xcalloc(std::max<int64_t>(1, num_nbrs)*sizeof(uint8_t)));
+		int64_t head = 0, tail = 0;
+		for(int64_t s = 0; s < num_verts; ++s) {
+			const LocalVertex seed = seeds[s];
+			if(visited[seed]) continue;
+			visited[seed] = 1;
+			vertexes_[tail++] = seed;
+			for( ; head < tail; ++head) {
+				const LocalVertex v = vertexes_[head];
+				for(int64_t e = local_starts[v]; e < local_starts[v + 1]; ++e) {
+					const int64_t nbr = local_nbrs[e];
+					if(nbr_visited[nbr]) continue;
+					nbr_visited[nbr] = 1;
+					for(int64_t k = nbr_starts[nbr]; k < nbr_starts[nbr + 1]; ++k) {
+						const LocalVertex u = locals[k];
+						if(visited[u] == 0) {
+							visited[u] = 1;
+							vertexes_[tail++] = u;
+						}
+					}
+				}
+			}
+		}
+		assert (tail == num_verts);
+		free(visited); free(nbr_visited); free(seeds);
+		free(locals); free(nbr_starts); free(local_starts); free(local_nbrs);
+
+		// sort the degrees by the order
+		int64_t* sorted_degree = static_cast<int64_t*>(cache_aligned_xmalloc(num_verts*sizeof(int64_t)));
+#pragma omp parallel for
+		for(int64_t i = 0; i < num_verts; ++i) {
+			sorted_degree[i] = degree[vertexes_[i]];
+		}
+		memcpy(degree, sorted_degree, num_verts*sizeof(int64_t));
+		free(sorted_degree);
+		if(mpi.isMaster()) print_with_prefix("Locality ordering: %" PRId64 " edges, %" PRId64 " distinct neighbors (rank 0)", num_edges, num_nbrs);
+	}
+#endif
+
 	void make_construct_data(LocalVertex* reorder_map) {
 		int64_t src_bitmap_size = local_bitmap_size() * mpi.size_2dc;
 		int64_t num_wide_rows = local_wide_row_size() * mpi.size_2dc;
@@ -765,8 +992,9 @@ private:
 	void scatterAndScanEdges(EdgeList* edge_list, GraphType& g) {
 		TRACER(scan_edge);
 		ScatterContext scatter(mpi.comm_2d);
+		const int EDGE_WORDS = DegreeCalculation::EDGE_WORDS;
 		int64_t* edges_to_send = static_cast<int64_t*>(
-				xMPI_Alloc_mem(2 * EdgeList::CHUNK_SIZE * sizeof(int64_t)));
+				xMPI_Alloc_mem(2 * EDGE_WORDS * EdgeList::CHUNK_SIZE * sizeof(int64_t)));
 		int num_loops = edge_list->beginRead(false);
 
 		if(mpi.isMaster()) print_with_prefix("Begin counting degree. Number of iterations is %d.", num_loops);
@@ -784,8 +1012,8 @@ private:
 					const int64_t v0 = edge_data[i].v0();
 					const int64_t v1 = edge_data[i].v1();
 					if (v0 == v1) continue;
-					(counts[vertex_owner(v0)])++;
-					(counts[vertex_owner(v1)])++;
+					(counts[vertex_owner(v0)]) += EDGE_WORDS;
+					(counts[vertex_owner(v1)]) += EDGE_WORDS;
 				} // #pragma omp for schedule(static)
 			} // #pragma omp parallel
 
@@ -814,8 +1042,14 @@ private:
 					const SeparatedId v1_swizzled(vertex_owner_c(v0), vertex_local(v1), local_bits);
 					//assert (offsets[edge_owner(v0,v1)] < 2 * FILE_CHUNKSIZE);
 					edges_to_send[(offsets[vertex_owner(v0)])++] = v0_swizzled.value;
+#if VERTEX_REORDERING == 3
+					edges_to_send[(offsets[vertex_owner(v0)])++] = v1;
+#endif
 					//assert (offsets[edge_owner(v1,v0)] < 2 * FILE_CHUNKSIZE);
 					edges_to_send[(offsets[vertex_owner(v1)])++] = v1_swizzled.value;
+#if VERTEX_REORDERING == 3
+					edges_to_send[(offsets[vertex_owner(v1)])++] = v0;
+#endif
 				} // #pragma omp for schedule(static)
 			} // #pragma omp parallel
 
@@ -878,6 +1112,52 @@ private:
 		if(mpi.isMaster()) print_with_prefix("Finished compacting edge array.");
 	}
 
+#if COMPRESSED_EDGE_ARRAY
+	void packEdgeArray(GraphType& g, int64_t non_zero_rows) {
+		TRACER(pack_edge);
+		const int64_t num_edges = g.row_starts_[non_zero_rows];
+		uint64_t max_value = 0;
+#pragma omp parallel for reduction(|:max_value)
+		for(int64_t e = 0; e < num_edges; ++e) {
+			max_value |= g.edge_array_[e];
+		}
+		const int bits = (max_value == 0) ? 1 : 64 - __builtin_clzll(max_value);
+		if(bits > 57) {
+			throw_exception("Too large vertex id to compress the edge array (%d bits)", bits);
+		}
+		g.edge_bits_ = bits;
+		const int64_t num_words = g.edge_array_words(num_edges);
+		uint8_t* packed = static_cast<uint8_t*>(cache_aligned_xcalloc(num_words*sizeof(int64_t)));
+
+		// Each group of 8 edges occupies exactly bits bytes,
+		// so the threads never write to the same byte.
+		const int64_t num_groups = (num_edges + 7) / 8;
+#pragma omp parallel for
+		for(int64_t grp = 0; grp < num_groups; ++grp) {
+			uint8_t buf[64 + sizeof(uint64_t)] = {0};
+			const int64_t e_start = grp * 8;
+			const int64_t e_end = std::min(e_start + 8, num_edges);
+			for(int64_t e = e_start; e < e_end; ++e) {
+				const int bit_offset = (e - e_start) * bits;
+				uint64_t word;
+				memcpy(&word, buf + (bit_offset >> 3), sizeof(word));
+				word |= uint64_t(g.edge_array_[e]) << (bit_offset & 7);
+				memcpy(buf + (bit_offset >> 3), &word, sizeof(word));
+			}
+			memcpy(packed + grp * bits, buf, ((e_end - e_start) * bits + 7) / 8);
+		}
+
+		free(g.edge_array_);
+		g.edge_array_ = reinterpret_cast<int64_t*>(packed);
+
+		int64_t send_size[2] = { num_edges * int64_t(sizeof(int64_t)), num_words * int64_t(sizeof(int64_t)) };
+		int64_t sum_size[2];
+		MPI_Reduce(send_size, sum_size, 2, MpiTypeOf<int64_t>::type, MPI_SUM, 0, mpi.comm_2d);
+		if(mpi.isMaster()) print_with_prefix("Compressed edge array: %d bits per edge, %f MB -> %f MB",
+				bits, to_mega(sum_size[0]), to_mega(sum_size[1]));
+	}
+#endif // #if COMPRESSED_EDGE_ARRAY
+
 	void constructFromWideCSR(GraphType& g) {
 		TRACER(form_csr);
 		const int64_t num_local_verts = g.num_local_verts_;
@@ -956,6 +1236,9 @@ private:
 #if ISOLATE_FIRST_EDGE
 		isolateFirstEdge(g);
 #endif // #if ISOLATE_FIRST_EDGE || DEGREE_ORDER
+#if COMPRESSED_EDGE_ARRAY
+		packEdgeArray(g, non_zero_rows);
+#endif
 
 #if VERVOSE_MODE
 		int64_t send_rowbmp[5] = { non_zero_rows, row_bitmap_length*NBPE, num_local_edges, 0, 0 };
@@ -1282,7 +1565,7 @@ private:
 	// using SFINAE
 	// function #1
 	template<typename EdgeType>
-	void sortEdgesInner(GraphType& g, typename EdgeType::has_weight dummy = 0)
+	void sortEdgesInner(GraphType& g, int64_t max_row_edges, typename EdgeType::has_weight dummy = 0)
 	{
 		/*
 		int64_t sort_buffer_length = 2*1024;
@@ -1374,15 +1657,43 @@ private:
 
 	// function #2
 	template<typename EdgeType>
-	void sortEdgesInner(GraphType& g, typename EdgeType::no_weight dummy = 0)
+	void sortEdgesInner(GraphType& g, int64_t max_row_edges, typename EdgeType::no_weight dummy = 0)
 	{
+		const int vertex_bits = g.r_bits_ + local_bits_;
+		const int64_t edge_mask = (int64_t(1) << vertex_bits) - 1;
+#if RADIX_SORT_CSR
+		// The key is the source in the wide row (LOG_EDGE_PART_SIZE bits) and the target
+		// (vertex_bits bits). The original vertex id in the upper bits is not sorted.
+		const int key_bits = LOG_EDGE_PART_SIZE + vertex_bits;
+		uint64_t* keys = (uint64_t*)cache_aligned_xmalloc(max_row_edges*sizeof(uint64_t));
+		uint64_t* key_tmp = (uint64_t*)cache_aligned_xmalloc(max_row_edges*sizeof(uint64_t));
+		int64_t* value_tmp = (int64_t*)cache_aligned_xmalloc(max_row_edges*sizeof(int64_t));
+#endif
 #pragma omp for
 		for(int64_t i = 0; i < num_wide_rows_; ++i) {
 			const int64_t edge_offset = wide_row_starts_[i];
 			const int64_t edge_count = wide_row_starts_[i+1] - edge_offset;
-			int vertex_bits = g.r_bits_ + local_bits_;
-			int64_t edge_mask = (int64_t(1) << vertex_bits) - 1;
+#if RADIX_SORT_CSR
+			uint16_t* srcs = src_vertexes_ + edge_offset;
+			int64_t* edges = g.edge_array_ + edge_offset;
 
+			// sort
+			for(int64_t c = 0; c < edge_count; ++c) {
+				keys[c] = (uint64_t(srcs[c]) << vertex_bits) | (edges[c] & edge_mask);
+			}
+			radix_sort::sort2(keys, edges, edge_count, key_bits, key_tmp, value_tmp);
+
+			// merge same edges
+			int64_t idx = 0;
+			for(int64_t c = 0; c < edge_count; ++c) {
+				if(c == 0 || keys[c] != keys[c-1]) {
+					edges[idx] = edges[c];
+					srcs[idx] = uint16_t(keys[c] >> vertex_bits);
+					++idx;
+				}
+			}
+			row_starts_sup_[i] = idx;
+#else
 			// sort
 			sort2(src_vertexes_ + edge_offset, g.edge_array_ + edge_offset, edge_count,
 					SortEdgeCompair(vertex_bits));
@@ -1407,30 +1718,128 @@ private:
 				}
 			}
 			row_starts_sup_[i] = idx - edge_offset;
+#endif
 		} // #pragma omp for
 
+#if RADIX_SORT_CSR
+		free(keys);
+		free(key_tmp);
+		free(value_tmp);
+#endif
+	}
+
+	// Converts row_starts_sup_ (the number of the edges of each row) into the row starts
+	// after the compaction and returns the number of the edges.
+	int64_t prefixSumRowCounts() {
+		const int max_threads = omp_get_max_threads();
+		int64_t thread_sums[max_threads + 1];
+		int num_threads = 1;
+#pragma omp parallel
+		{
+			const int tid = omp_get_thread_num();
+			int64_t sum = 0;
+#pragma omp for schedule(static)
+			for(int64_t i = 0; i < num_wide_rows_; ++i) {
+				sum += row_starts_sup_[i];
+			}
+			thread_sums[tid + 1] = sum;
+#pragma omp barrier
+#pragma omp master
+			{
+				num_threads = omp_get_num_threads();
+				thread_sums[0] = 0;
+				for(int i = 0; i < num_threads; ++i) {
+					thread_sums[i + 1] += thread_sums[i];
+				}
+			}
+#pragma omp barrier
+			// the same static schedule as the first loop
+			int64_t offset = thread_sums[tid];
+#pragma omp for schedule(static)
+			for(int64_t i = 0; i < num_wide_rows_; ++i) {
+				const int64_t count = row_starts_sup_[i];
+				row_starts_sup_[i] = offset;
+				offset += count;
+			}
+		}
+		row_starts_sup_[num_wide_rows_] = thread_sums[num_threads];
+		return thread_sums[num_threads];
+	}
+
+	// Moves the merged rows to the front in parallel and updates wide_row_starts_.
+	// The edges are moved in blocks of the destination. Since each edge moves forward,
+	// the sources of a block are not overwritten by the preceding blocks, and the edges
+	// of a block are copied to the buffer before they are written back to the destination.
+	int64_t compactEdges(GraphType& g) {
+		TRACER(compact_edge);
+		const int64_t num_edges = prefixSumRowCounts();
+		const int64_t* new_starts = row_starts_sup_;
+		const int64_t* old_starts = wide_row_starts_;
+
+		// skip the rows which do not move
+		int64_t first_moved = std::mismatch(new_starts, new_starts + num_wide_rows_, old_starts).first - new_starts;
+		const int64_t move_begin = new_starts[first_moved];
+		const int64_t buffer_length = std::min(num_edges - move_begin,
+				std::max<int64_t>(old_starts[num_wide_rows_] / EDGE_COMPACTION_BUFFER_DENOM, 64*1024));
+
+		if(buffer_length > 0) {
+			uint16_t* src_buffer = (uint16_t*)cache_aligned_xmalloc(buffer_length*sizeof(src_vertexes_[0]));
+			int64_t* edge_buffer = (int64_t*)cache_aligned_xmalloc(buffer_length*sizeof(g.edge_array_[0]));
+#pragma omp parallel
+			{
+				const int tid = omp_get_thread_num();
+				const int num_threads = omp_get_num_threads();
+				for(int64_t block_begin = move_begin; block_begin < num_edges; block_begin += buffer_length) {
+					const int64_t block_end = std::min(num_edges, block_begin + buffer_length);
+					const int64_t width = block_end - block_begin;
+					const int64_t d_start = block_begin + width * tid / num_threads;
+					const int64_t d_end = block_begin + width * (tid + 1) / num_threads;
+					// copy the edges of [d_start, d_end) in the destination into the buffer
+					int64_t d = d_start;
+					if(d < d_end) {
+						int64_t row = std::upper_bound(new_starts + first_moved, new_starts + num_wide_rows_ + 1, d)
+								- new_starts - 1;
+						for( ; d < d_end; ++row) {
+							const int64_t seg_end = std::min(d_end, new_starts[row + 1]);
+							const int64_t src_pos = old_starts[row] + (d - new_starts[row]);
+							memcpy(src_buffer + (d - block_begin), src_vertexes_ + src_pos,
+									(seg_end - d) * sizeof(src_vertexes_[0]));
+							memcpy(edge_buffer + (d - block_begin), g.edge_array_ + src_pos,
+									(seg_end - d) * sizeof(g.edge_array_[0]));
+							d = seg_end;
+						}
+					}
+#pragma omp barrier
+					memcpy(src_vertexes_ + d_start, src_buffer + (d_start - block_begin),
+							(d_end - d_start) * sizeof(src_vertexes_[0]));
+					memcpy(g.edge_array_ + d_start, edge_buffer + (d_start - block_begin),
+							(d_end - d_start) * sizeof(g.edge_array_[0]));
+#pragma omp barrier
+				}
+			}
+			free(src_buffer);
+			free(edge_buffer);
+		}
+
+		memcpy(wide_row_starts_, new_starts, num_wide_rows_*sizeof(wide_row_starts_[0]));
+		return num_edges;
 	}
 
 	void sortEdges(GraphType& g) {
 		TRACER(sort_edge);
 		if(mpi.isMaster()) print_with_prefix("Sorting edges.");
 
-#pragma omp parallel
-		sortEdgesInner<EdgeType>(g);
-
-		// this loop can't be parallel
-		int64_t rowstart_new = 0;
+		// The sort buffers of each thread have the length of the longest row.
+		int64_t max_row_edges = 1;
 		for(int64_t i = 0; i < num_wide_rows_; ++i) {
-			const int64_t edge_count_new = row_starts_sup_[i];
-			const int64_t rowstart_old = wide_row_starts_[i]; // read before write
-			wide_row_starts_[i] = rowstart_new;
-			if(rowstart_new != rowstart_old) {
-				memmove(src_vertexes_ + rowstart_new, src_vertexes_ + rowstart_old, edge_count_new * sizeof(src_vertexes_[0]));
-				memmove(g.edge_array_ + rowstart_new, g.edge_array_ + rowstart_old, edge_count_new * sizeof(g.edge_array_[0]));
-			}
-			rowstart_new += edge_count_new;
+			max_row_edges = std::max(max_row_edges, wide_row_starts_[i+1] - wide_row_starts_[i]);
 		}
+
+#pragma omp parallel
+		sortEdgesInner<EdgeType>(g, max_row_edges);
+
 		const int64_t old_num_edges = wide_row_starts_[num_wide_rows_];
+		const int64_t rowstart_new = compactEdges(g);
 		wide_row_starts_[num_wide_rows_] = rowstart_new;
 
 		 int64_t num_edge_sum[2] = {0};
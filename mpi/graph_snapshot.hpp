@@ -0,0 +1,280 @@
+/*
+ * graph_snapshot.hpp
+ */
+
+#ifndef GRAPH_SNAPSHOT_HPP_
+#define GRAPH_SNAPSHOT_HPP_
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "graph_constructor.hpp"
+
+//-------------------------------------------------------------//
+// Graph Snapshot
+//-------------------------------------------------------------//
+// Each rank writes its part of the constructed Graph2DCSR to <path>-<rank>.
+// The file is a header followed by the graph arrays, each of which is aligned to PAGE_SIZE
+// so that the load path can map the file and use the arrays in place.
+
+namespace snapshot {
+
+const int64_t MAGIC = INT64_C(0x47353030534E4150); // "G500SNAP"
+
+enum {
+	VERSION = 2,
+	HEADER_SIZE = PAGE_SIZE,
+};
+
+enum ARRAY_INDEX {
+	ROW_BITMAP,
+	ROW_SUMS,
+	HAS_EDGE_BITMAP,
+	REORDER_MAP,
+	INVERT_MAP,
+	ORIG_VERTEXES,
+	EDGE_ARRAY,
+	ROW_STARTS,
+	ISOLATED_EDGES,
+	NUM_ARRAYS,
+};
+
+struct Header {
+	int64_t magic;
+	int version;
+
+	// run parameters
+	int scale;
+	int edge_factor;
+	int size_2dr;
+	int size_2dc;
+	int rank_2d;
+	int vertex_reordering;
+	int isolate_first_edge;
+	int compressed_edge_array;
+
+	// Graph2DCSR scalars
+	int log_orig_global_verts;
+	int log_max_weight;
+	int max_weight;
+	int local_bits;
+	int orig_local_bits;
+	int r_bits;
+	int edge_bits;
+	int64_t num_orig_local_verts;
+	int64_t num_global_edges;
+	int64_t num_global_verts;
+	int64_t num_local_verts;
+
+	int64_t offset[NUM_ARRAYS]; // bytes from the beginning of the file
+	int64_t length[NUM_ARRAYS]; // bytes
+};
+
+void make_filepath(char* buf, const char* path) {
+	sprintf(buf, "%s-%03d", path, mpi.rank_2d);
+}
+
+bool header_match(const Header& h, int scale, int edge_factor) {
+	return h.magic == MAGIC && h.version == VERSION &&
+			h.scale == scale && h.edge_factor == edge_factor &&
+			h.size_2dr == mpi.size_2dr && h.size_2dc == mpi.size_2dc &&
+			h.rank_2d == mpi.rank_2d &&
+			h.vertex_reordering == VERTEX_REORDERING &&
+			h.isolate_first_edge == ISOLATE_FIRST_EDGE &&
+			h.compressed_edge_array == COMPRESSED_EDGE_ARRAY;
+}
+
+// returns the file descriptor or -1 when the file is not a valid snapshot for this run
+int open_file(const char* filepath, int scale, int edge_factor, Header* h, int64_t* file_size) {
+	int fd = open(filepath, O_RDONLY);
+	if(fd == -1) return -1;
+	struct stat st;
+	bool ok = (pread(fd, h, sizeof(*h), 0) == sizeof(*h)) &&
+			header_match(*h, scale, edge_factor) && (fstat(fd, &st) == 0);
+	if(ok) {
+		*file_size = st.st_size;
+		for(int i = 0; i < NUM_ARRAYS; ++i) {
+			if(h->offset[i] + h->length[i] > *file_size) ok = false;
+		}
+	}
+	if(ok == false) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+void get_arrays(Graph2DCSR& g, void** ptrs, int64_t* lengths) {
+	const int64_t local_bitmap_width = g.num_local_verts_ / PRM::NBPE;
+	const int64_t row_bitmap_length = local_bitmap_width * mpi.size_2dc;
+	const int64_t non_zero_rows = g.row_sums_[row_bitmap_length];
+	const int64_t num_local_edges = g.row_starts_[non_zero_rows];
+	// reorder_map_ and invert_map_ are allocated for 2^orig_local_bits_ entries
+	const int64_t num_map_entries = int64_t(1) << g.orig_local_bits_;
+
+	ptrs[ROW_BITMAP] = g.row_bitmap_; lengths[ROW_BITMAP] = row_bitmap_length*sizeof(BitmapType);
+	ptrs[ROW_SUMS] = g.row_sums_; lengths[ROW_SUMS] = (row_bitmap_length+1)*sizeof(TwodVertex);
+	ptrs[HAS_EDGE_BITMAP] = g.has_edge_bitmap_; lengths[HAS_EDGE_BITMAP] = local_bitmap_width*sizeof(BitmapType);
+	ptrs[REORDER_MAP] = g.reorder_map_; lengths[REORDER_MAP] = num_map_entries*sizeof(LocalVertex);
+	ptrs[INVERT_MAP] = g.invert_map_; lengths[INVERT_MAP] = num_map_entries*sizeof(LocalVertex);
+	ptrs[ORIG_VERTEXES] = g.orig_vertexes_; lengths[ORIG_VERTEXES] = non_zero_rows*sizeof(LocalVertex);
+	ptrs[EDGE_ARRAY] = g.edge_array_; lengths[EDGE_ARRAY] = g.edge_array_words(num_local_edges)*sizeof(int64_t);
+	ptrs[ROW_STARTS] = g.row_starts_; lengths[ROW_STARTS] = (non_zero_rows+1)*sizeof(int64_t);
+	ptrs[ISOLATED_EDGES] = g.isolated_edges_;
+	lengths[ISOLATED_EDGES] = (g.isolated_edges_ != NULL) ? non_zero_rows*sizeof(int64_t) : 0;
+}
+
+} // namespace snapshot {
+
+// returns true when all the ranks have written their snapshot successfully
+bool save_graph_snapshot(Graph2DCSR& g, const char* path, int SCALE, int edgefactor)
+{
+	using namespace snapshot;
+	TRACER(save_snapshot);
+	Header h;
+	memset(&h, 0x00, sizeof(h));
+	h.magic = MAGIC;
+	h.version = VERSION;
+	h.scale = SCALE;
+	h.edge_factor = edgefactor;
+	h.size_2dr = mpi.size_2dr;
+	h.size_2dc = mpi.size_2dc;
+	h.rank_2d = mpi.rank_2d;
+	h.vertex_reordering = VERTEX_REORDERING;
+	h.isolate_first_edge = ISOLATE_FIRST_EDGE;
+	h.compressed_edge_array = COMPRESSED_EDGE_ARRAY;
+	h.log_orig_global_verts = g.log_orig_global_verts_;
+	h.log_max_weight = g.log_max_weight_;
+	h.max_weight = g.max_weight_;
+	h.local_bits = g.local_bits_;
+	h.orig_local_bits = g.orig_local_bits_;
+	h.r_bits = g.r_bits_;
+	h.edge_bits = g.edge_bits_;
+	h.num_orig_local_verts = g.num_orig_local_verts_;
+	h.num_global_edges = g.num_global_edges_;
+	h.num_global_verts = g.num_global_verts_;
+	h.num_local_verts = g.num_local_verts_;
+
+	void* ptrs[NUM_ARRAYS];
+	get_arrays(g, ptrs, h.length);
+	int64_t file_offset = HEADER_SIZE;
+	for(int i = 0; i < NUM_ARRAYS; ++i) {
+		h.offset[i] = file_offset;
+		file_offset += roundup<int64_t>(h.length[i], PAGE_SIZE);
+	}
+
+	char filepath[256];
+	make_filepath(filepath, path);
+	if(mpi.isMaster()) print_with_prefix("Writing graph snapshot to %s ...", filepath);
+
+	bool ok = true;
+	FILE* fp = fopen(filepath, "wb");
+	if(fp == NULL) {
+		ok = false;
+	}
+	else {
+		uint8_t padding[PAGE_SIZE] = {0};
+		ok &= (fwrite(&h, sizeof(h), 1, fp) == 1);
+		ok &= (fwrite(padding, HEADER_SIZE - sizeof(h), 1, fp) == 1);
+		for(int i = 0; i < NUM_ARRAYS && ok; ++i) {
+			int64_t pad = roundup<int64_t>(h.length[i], PAGE_SIZE) - h.length[i];
+			if(h.length[i] > 0) ok &= (fwrite(ptrs[i], h.length[i], 1, fp) == 1);
+			if(pad > 0) ok &= (fwrite(padding, pad, 1, fp) == 1);
+		}
+		ok &= (fclose(fp) == 0);
+	}
+	if(ok == false) {
+		print_with_prefix("Cannot write graph snapshot %s ... skipping", filepath);
+		unlink(filepath);
+	}
+
+	int send_ok = ok, all_ok;
+	MPI_Allreduce(&send_ok, &all_ok, 1, MPI_INT, MPI_LAND, mpi.comm_2d);
+	if(mpi.isMaster()) print_with_prefix("Graph snapshot %s.", all_ok ? "saved" : "is NOT saved");
+	return all_ok;
+}
+
+// returns true when all the ranks have a valid snapshot for this run
+bool graph_snapshot_available(const char* path, int SCALE, int edgefactor)
+{
+	using namespace snapshot;
+	char filepath[256];
+	make_filepath(filepath, path);
+	Header h;
+	int64_t file_size;
+	int fd = open_file(filepath, SCALE, edgefactor, &h, &file_size);
+	if(fd != -1) close(fd);
+	int send_ok = (fd != -1), all_ok;
+	MPI_Allreduce(&send_ok, &all_ok, 1, MPI_INT, MPI_LAND, mpi.comm_2d);
+	return all_ok;
+}
+
+// Maps the snapshot written by save_graph_snapshot into g.
+// Returns false on all the ranks when any of the ranks does not have a valid snapshot
+// for this configuration. In that case g is not modified.
+bool load_graph_snapshot(Graph2DCSR& g, const char* path, int SCALE, int edgefactor)
+{
+	using namespace snapshot;
+	TRACER(load_snapshot);
+	char filepath[256];
+	make_filepath(filepath, path);
+
+	Header h;
+	void* region = MAP_FAILED;
+	int64_t file_size = 0;
+	bool ok = false;
+
+	int fd = open_file(filepath, SCALE, edgefactor, &h, &file_size);
+	if(fd != -1) {
+		int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+		// read the whole file now, so that the BFS does not suffer page faults
+		flags |= MAP_POPULATE;
+#endif
+		region = mmap(NULL, file_size, PROT_READ | PROT_WRITE, flags, fd, 0);
+		ok = (region != MAP_FAILED);
+		close(fd);
+	}
+
+	int send_ok = ok, all_ok;
+	MPI_Allreduce(&send_ok, &all_ok, 1, MPI_INT, MPI_LAND, mpi.comm_2d);
+	if(all_ok == false) {
+		if(region != MAP_FAILED) munmap(region, file_size);
+		if(mpi.isMaster()) print_with_prefix("Graph snapshot %s is not available.", filepath);
+		return false;
+	}
+
+	uint8_t* base = static_cast<uint8_t*>(region);
+#define ARRAY_PTR(type, idx) ((h.length[idx] > 0) ? reinterpret_cast<type*>(base + h.offset[idx]) : NULL)
+	g.row_bitmap_ = ARRAY_PTR(BitmapType, ROW_BITMAP);
+	g.row_sums_ = ARRAY_PTR(TwodVertex, ROW_SUMS);
+	g.has_edge_bitmap_ = ARRAY_PTR(BitmapType, HAS_EDGE_BITMAP);
+	g.reorder_map_ = ARRAY_PTR(LocalVertex, REORDER_MAP);
+	g.invert_map_ = ARRAY_PTR(LocalVertex, INVERT_MAP);
+	g.orig_vertexes_ = ARRAY_PTR(LocalVertex, ORIG_VERTEXES);
+	g.edge_array_ = ARRAY_PTR(int64_t, EDGE_ARRAY);
+	g.row_starts_ = ARRAY_PTR(int64_t, ROW_STARTS);
+	g.isolated_edges_ = ARRAY_PTR(int64_t, ISOLATED_EDGES);
+#undef ARRAY_PTR
+	g.mapped_region_ = region;
+	g.mapped_size_ = file_size;
+
+	g.log_orig_global_verts_ = h.log_orig_global_verts;
+	g.log_max_weight_ = h.log_max_weight;
+	g.max_weight_ = h.max_weight;
+	g.local_bits_ = h.local_bits;
+	g.orig_local_bits_ = h.orig_local_bits;
+	g.r_bits_ = h.r_bits;
+	g.edge_bits_ = h.edge_bits;
+	g.num_orig_local_verts_ = h.num_orig_local_verts;
+	g.num_global_edges_ = h.num_global_edges;
+	g.num_global_verts_ = h.num_global_verts;
+	g.num_local_verts_ = h.num_local_verts;
+
+	if(mpi.isMaster()) print_with_prefix("Graph snapshot is loaded from %s.", filepath);
+	return true;
+}
+
+#endif /* GRAPH_SNAPSHOT_HPP_ */
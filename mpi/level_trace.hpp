@@ -0,0 +1,185 @@
+/*
+ * level_trace.hpp
+ */
+
+#ifndef LEVEL_TRACE_HPP_
+#define LEVEL_TRACE_HPP_
+
+#include "utils.hpp"
+
+//-------------------------------------------------------------//
+// Per-level Trace
+//-------------------------------------------------------------//
+// Each process writes one JSON object per line (JSON lines) to <prefix>.<rank>.jsonl:
+//  {"type":"header", ...} : once, the layout of the process
+//  {"type":"level", ...}  : every level of every BFS
+//  {"type":"bfs", ...}    : the end of every BFS
+// A level consists of the expand of the previous level and the search (fold) of the level
+// like the per-level report of VERVOSE_MODE. The communication counters (VERVOSE_MODE) and
+// the profiling spans and counters (PROFILING_MODE) are the values submitted in the level.
+// The times are in milliseconds and "begin" is the time from the beginning of the BFS,
+// which is the call of run_bfs() on each process. The trace does not synchronize the processes:
+// the callers (main.cc and autotune.hpp) have a barrier right before run_bfs().
+// The trace files of all the processes are merged by merge-level-trace.py into one timeline.
+//
+// Runtime options:
+// LEVEL_TRACE: path prefix of the trace files. The trace is disabled if not set.
+
+struct LevelTraceRecord {
+	int level;
+	bool forward; // top-down or bottom-up
+	bool bitmap; // format of the expand: bitmap or list
+	double begin; // the begin of the expand
+	double expand_time;
+	double fold_time;
+	int64_t nq_local;
+	int64_t nq_global;
+	int64_t unvisited_global;
+	int64_t edge_relax; // -1: not counted
+	int64_t a2a_send; // -1: not counted
+};
+
+class LevelTrace
+{
+public:
+	LevelTrace()
+		: fp_(NULL)
+		, num_bfs_(0)
+		, root_(0)
+		, start_time_(0)
+		, time_mark_(0)
+		, counter_mark_(0)
+	{
+		memset(comm_mark_, 0, sizeof(comm_mark_));
+	}
+
+	~LevelTrace() {
+		close();
+	}
+
+	void initialize() {
+		close();
+		const char* prefix = getenv("LEVEL_TRACE");
+		if(prefix == NULL || prefix[0] == '\0') {
+			return ;
+		}
+		char filename[PATH_MAX];
+		snprintf(filename, sizeof(filename), "%s.%d.jsonl", prefix, mpi.rank);
+		fp_ = fopen(filename, "w");
+		if(fp_ == NULL) {
+			print_with_prefix("Level trace: Cannot write %s", filename);
+			return ;
+		}
+		int* wtime_is_global = NULL;
+		int flag = 0;
+		MPI_Comm_get_attr(MPI_COMM_WORLD, MPI_WTIME_IS_GLOBAL, &wtime_is_global, &flag);
+		fprintf(fp_, "{\"type\":\"header\",\"rank\":%d,\"size\":%d,\"rank_2dr\":%d,\"rank_2dc\":%d,"
+				"\"size_2dr\":%d,\"size_2dc\":%d,\"threads\":%d,\"wtime_global\":%d}\n",
+				mpi.rank, mpi.size, mpi.rank_2dr, mpi.rank_2dc, mpi.size_2dr, mpi.size_2dc,
+				omp_get_max_threads(), (flag && *wtime_is_global) ? 1 : 0);
+	}
+
+	bool enabled() const { return fp_ != NULL; }
+
+	void close() {
+		if(fp_ != NULL) {
+			fclose(fp_); fp_ = NULL;
+		}
+	}
+
+	// The beginning of the BFS. The times of the records are relative to this call.
+	void begin_bfs(int64_t root) {
+		root_ = root;
+		start_time_ = MPI_Wtime();
+		PROF(time_mark_ = profiling::g_pis.getTimes().size());
+		PROF(counter_mark_ = profiling::g_pis.getCounters().size());
+#if VERVOSE_MODE
+		memset(comm_mark_, 0, sizeof(comm_mark_));
+#endif
+	}
+
+	double get_time() const { return MPI_Wtime() - start_time_; }
+
+	void submit_level(const LevelTraceRecord& r) {
+		fprintf(fp_, "{\"type\":\"level\",\"bfs\":%d,\"root\":%" PRId64 ",\"level\":%d,"
+				"\"dir\":\"%s\",\"format\":\"%s\",\"begin\":%.3f,\"expand\":%.3f,\"fold\":%.3f,"
+				"\"nq\":%" PRId64 ",\"global_nq\":%" PRId64 ",\"global_unvisited\":%" PRId64,
+				num_bfs_, root_, r.level, r.forward ? "top-down" : "bottom-up",
+				r.bitmap ? "bitmap" : "list", r.begin * 1000.0,
+				r.expand_time * 1000.0, r.fold_time * 1000.0,
+				r.nq_local, r.nq_global, r.unvisited_global);
+		print_optional(",\"edge_relax\":", r.edge_relax);
+		print_optional(",\"a2a_send\":", r.a2a_send);
+#if VERVOSE_MODE
+		int64_t comm[NUM_COMM_COUNTERS] = { g_tp_comm, g_bu_pred_comm, g_bu_bitmap_comm,
+				g_bu_list_comm, g_expand_bitmap_comm, g_expand_list_comm };
+		static const char* const comm_names[NUM_COMM_COUNTERS] = { "tp_comm", "bu_pred_comm",
+				"bu_bitmap_comm", "bu_list_comm", "expand_bitmap_comm", "expand_list_comm" };
+		fprintf(fp_, ",\"comm\":{");
+		for(int i = 0; i < NUM_COMM_COUNTERS; ++i) {
+			fprintf(fp_, "%s\"%s\":%" PRId64, i ? "," : "", comm_names[i], comm[i] - comm_mark_[i]);
+			comm_mark_[i] = comm[i];
+		}
+		fprintf(fp_, "}");
+#endif
+#if PROFILING_MODE
+		// the elements are written as arrays since the same content can be submitted several times
+		const std::vector<profiling::ProfilingInformationStore::TimeElement>& times =
+				profiling::g_pis.getTimes();
+		fprintf(fp_, ",\"spans\":[");
+		for(int i = time_mark_; i < int(times.size()); ++i) {
+			fprintf(fp_, "%s[", (i > time_mark_) ? "," : "");
+			print_string(times[i].content);
+			fprintf(fp_, ",%d,%.3f]", times[i].number, times[i].span * 1000.0);
+		}
+		time_mark_ = times.size();
+		const std::vector<profiling::ProfilingInformationStore::CountElement>& counters =
+				profiling::g_pis.getCounters();
+		fprintf(fp_, "],\"counters\":[");
+		for(int i = counter_mark_; i < int(counters.size()); ++i) {
+			fprintf(fp_, "%s[", (i > counter_mark_) ? "," : "");
+			print_string(counters[i].content);
+			fprintf(fp_, ",%d,%" PRId64 "]", counters[i].number, counters[i].count);
+		}
+		counter_mark_ = counters.size();
+		fprintf(fp_, "]");
+#endif
+		fprintf(fp_, "}\n");
+	}
+
+	void end_bfs(int num_levels, int64_t global_visited) {
+		fprintf(fp_, "{\"type\":\"bfs\",\"bfs\":%d,\"root\":%" PRId64 ",\"time\":%.3f,"
+				"\"levels\":%d,\"global_visited\":%" PRId64 "}\n",
+				num_bfs_, root_, get_time() * 1000.0, num_levels, global_visited);
+		fflush(fp_);
+		++num_bfs_;
+	}
+
+private:
+	enum { NUM_COMM_COUNTERS = 6 };
+
+	FILE* fp_;
+	int num_bfs_;
+	int64_t root_;
+	double start_time_;
+	int time_mark_;
+	int counter_mark_;
+	int64_t comm_mark_[NUM_COMM_COUNTERS];
+
+	void print_optional(const char* key, int64_t value) {
+		if(value >= 0) {
+			fprintf(fp_, "%s%" PRId64, key, value);
+		}
+	}
+
+	void print_string(const char* str) {
+		fputc('"', fp_);
+		for( ; *str != '\0'; ++str) {
+			if(*str == '"' || *str == '\\') fputc('\\', fp_);
+			fputc(*str, fp_);
+		}
+		fputc('"', fp_);
+	}
+};
+
+#endif /* LEVEL_TRACE_HPP_ */
@@ -25,6 +25,12 @@
 
 #include <algorithm>
 
+#include "parameters.h"
+#if BOTTOM_UP_SIMD
+// before utils_core.h, which redefines the built-in functions
+#include <immintrin.h>
+#endif
+
 #include "utils_core.h"
 #include "low_level_func.h"
 
@@ -162,3 +168,170 @@ void backward_isolated_edge(
 
 #endif // #if LOW_LEVEL_FUNCTION
 
+
+#if BOTTOM_UP_SIMD
+
+//-------------------------------------------------------------//
+// SIMD kernels of the bottom-up bitmap scan
+//-------------------------------------------------------------//
+// The same as the scalar scan in BfsBase::bottom_up_search_bitmap_process_block.
+// The probes of the source vertices in the shared visited bitmap (the compact bit index
+// and the test of the bit) are vectorized with the gather instructions.
+// The first edges (isolated_edges) of the unvisited rows of a word are probed together
+// and the other edges of a row are probed by the width of the vector.
+
+namespace {
+
+struct ProbeParams {
+	int lgl;
+	int64_t src_mask; // (1 << (r_bits + lgl)) - 1
+	int64_t L;
+	const BitmapType* shared_visited;
+};
+
+// Returns the mask of the lanes [0, n) whose source vertex is visited.
+__attribute__((target("avx2")))
+inline unsigned probe_avx2(const int64_t* srcs, int n, const ProbeParams& p)
+{
+	const __m256i lanes = _mm256_cmpgt_epi64(_mm256_set1_epi64x(n), _mm256_setr_epi64x(0, 1, 2, 3));
+	__m256i src = _mm256_maskload_epi64((const long long*)srcs, lanes);
+	src = _mm256_and_si256(src, _mm256_set1_epi64x(p.src_mask));
+	const __m256i high = _mm256_srli_epi64(src, p.lgl);
+	const __m256i low = _mm256_and_si256(src, _mm256_set1_epi64x((int64_t(1) << p.lgl) - 1));
+	// high < 2^r_bits and L < 2^32
+	const __m256i bit_idx = _mm256_add_epi64(_mm256_mul_epu32(high, _mm256_set1_epi64x(p.L)), low);
+	const __m256i word = _mm256_mask_i64gather_epi64(_mm256_setzero_si256(),
+			(const long long*)p.shared_visited, _mm256_srli_epi64(bit_idx, PRM::LOG_NBPE), lanes, 8);
+	const __m256i bit = _mm256_sllv_epi64(_mm256_set1_epi64x(1),
+			_mm256_and_si256(bit_idx, _mm256_set1_epi64x(PRM::NBPE_MASK)));
+	const __m256i not_visited = _mm256_cmpeq_epi64(_mm256_and_si256(word, bit), _mm256_setzero_si256());
+	return ~_mm256_movemask_pd(_mm256_castsi256_pd(not_visited)) & ((1u << n) - 1);
+}
+
+__attribute__((target("avx512f")))
+inline unsigned probe_avx512(const int64_t* srcs, int n, const ProbeParams& p)
+{
+	// The zero-masked forms are used since the unmasked forms of GCC take an uninitialized
+	// source operand (-Wuninitialized). The inactive lanes are zero.
+	const __mmask8 lanes = (__mmask8)((1u << n) - 1);
+	__m512i src = _mm512_maskz_loadu_epi64(lanes, srcs);
+	src = _mm512_and_si512(src, _mm512_set1_epi64(p.src_mask));
+	const __m512i high = _mm512_maskz_srli_epi64(lanes, src, p.lgl);
+	const __m512i low = _mm512_and_si512(src, _mm512_set1_epi64((int64_t(1) << p.lgl) - 1));
+	// high < 2^r_bits and L < 2^32
+	const __m512i bit_idx = _mm512_add_epi64(_mm512_maskz_mul_epu32(lanes, high, _mm512_set1_epi64(p.L)), low);
+	const __m512i word = _mm512_mask_i64gather_epi64(_mm512_setzero_si512(), lanes,
+			_mm512_maskz_srli_epi64(lanes, bit_idx, PRM::LOG_NBPE), p.shared_visited, 8);
+	const __m512i bit = _mm512_maskz_sllv_epi64(lanes, _mm512_set1_epi64(1),
+			_mm512_and_si512(bit_idx, _mm512_set1_epi64(PRM::NBPE_MASK)));
+	return _mm512_mask_test_epi64_mask(lanes, word, bit);
+}
+
+// scan_words is inlined into the wrappers below, which have the target of the probe,
+// so that the probes are inlined into the scan loop.
+template <int WIDTH, unsigned (*PROBE)(const int64_t*, int, const ProbeParams&)>
+inline __attribute__((always_inline))
+BitmapType scan_words(BottomUpScanArgs* args, int64_t blk_start, int64_t blk_end)
+{
+	const int lgl = args->lgl;
+	const int orig_lgl = args->orig_lgl;
+	const int64_t phase_bmp_off = args->phase_bmp_off;
+	BitmapType* __restrict__ phase_bitmap = args->phase_bitmap;
+	const BitmapType* __restrict__ row_bitmap = args->row_bitmap;
+	const TwodVertex* __restrict__ row_sums = args->row_sums;
+	const int64_t* __restrict__ isolated_edges = args->isolated_edges;
+	const int64_t* __restrict__ row_starts = args->row_starts;
+	const LocalVertex* __restrict__ orig_vertexes = args->orig_vertexes;
+	const int64_t* __restrict__ edge_array = args->edge_array;
+	int64_t* __restrict__ send_buffer = args->send_buffer;
+	ProbeParams p;
+	p.lgl = lgl;
+	p.src_mask = (int64_t(1) << (args->r_bits + lgl)) - 1;
+	p.L = args->L;
+	p.shared_visited = args->shared_visited;
+
+	int num_send = args->num_send;
+	int64_t edge_relax = args->edge_relax;
+	BitmapType unvisited_rows = 0;
+	for(int64_t blk_bmp_off = blk_start; blk_bmp_off < blk_end; ++blk_bmp_off) {
+		const BitmapType row_bmp_i = row_bitmap[phase_bmp_off + blk_bmp_off];
+		BitmapType visited_i = phase_bitmap[blk_bmp_off];
+		const TwodVertex bmp_row_sums = row_sums[phase_bmp_off + blk_bmp_off];
+		BitmapType bit_flags = (~visited_i) & row_bmp_i;
+		while(bit_flags != BitmapType(0)) {
+			// the first edges of up to WIDTH unvisited rows
+			int64_t srcs[WIDTH];
+			BitmapType vis_bits[WIDTH];
+			TwodVertex non_zero_idx[WIDTH];
+			int n = 0;
+			do {
+				BitmapType vis_bit = bit_flags & (-bit_flags);
+				bit_flags &= ~vis_bit;
+				vis_bits[n] = vis_bit;
+				non_zero_idx[n] = bmp_row_sums + __builtin_popcountl(row_bmp_i & (vis_bit - 1));
+				srcs[n] = isolated_edges[non_zero_idx[n]];
+			} while(++n < WIDTH && bit_flags != BitmapType(0));
+			const unsigned found = PROBE(srcs, n, p);
+			for(int i = 0; i < n; ++i) {
+				const LocalVertex tgt_orig = orig_vertexes[non_zero_idx[i]];
+				if(found & (1u << i)) {
+					// add to next queue
+					visited_i |= vis_bits[i];
+					send_buffer[num_send++] = ((srcs[i] >> lgl) << orig_lgl) | tgt_orig;
+					edge_relax += 1;
+					continue;
+				}
+				const int64_t e_start = row_starts[non_zero_idx[i]];
+				const int64_t e_end = row_starts[non_zero_idx[i]+1];
+				for(int64_t e = e_start; e < e_end; e += WIDTH) {
+					const unsigned edge_found = PROBE(edge_array + e, std::min<int64_t>(WIDTH, e_end - e), p);
+					if(edge_found) {
+						// the first visited source as the scalar scan
+						const int64_t src_e = e + __builtin_ctzl(edge_found);
+						visited_i |= vis_bits[i];
+						send_buffer[num_send++] = ((edge_array[src_e] >> lgl) << orig_lgl) | tgt_orig;
+						edge_relax += src_e - e_start + 1;
+						break;
+					}
+				}
+			}
+		}
+		// write back
+		phase_bitmap[blk_bmp_off] = visited_i;
+		unvisited_rows |= (~visited_i) & row_bmp_i;
+	}
+	args->num_send = num_send;
+	args->edge_relax = edge_relax;
+	return unvisited_rows;
+}
+
+__attribute__((target("avx2")))
+BitmapType scan_words_avx2(BottomUpScanArgs* args, int64_t blk_start, int64_t blk_end)
+{
+	return scan_words<4, probe_avx2>(args, blk_start, blk_end);
+}
+
+__attribute__((target("avx512f")))
+BitmapType scan_words_avx512(BottomUpScanArgs* args, int64_t blk_start, int64_t blk_end)
+{
+	return scan_words<8, probe_avx512>(args, blk_start, blk_end);
+}
+
+} // namespace {
+
+BottomUpScanKernel get_bottom_up_scan_kernel(bool allow_avx512, const char** name)
+{
+	__builtin_cpu_init();
+	if(allow_avx512 && __builtin_cpu_supports("avx512f")) {
+		*name = "AVX-512";
+		return scan_words_avx512;
+	}
+	if(__builtin_cpu_supports("avx2")) {
+		*name = "AVX2";
+		return scan_words_avx2;
+	}
+	*name = "scalar";
+	return NULL;
+}
+
+#endif // #if BOTTOM_UP_SIMD
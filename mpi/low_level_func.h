@@ -39,4 +39,32 @@ void backward_isolated_edge(
 	LocalPacket* buffer
 );
 
+#if BOTTOM_UP_SIMD
+// Arguments of the SIMD kernels of the bottom-up bitmap scan
+struct BottomUpScanArgs {
+	int lgl;
+	int r_bits;
+	int orig_lgl;
+	int64_t L; // must be less than 2^32
+	int64_t phase_bmp_off;
+	BitmapType* phase_bitmap;
+	const BitmapType* row_bitmap;
+	const BitmapType* shared_visited;
+	const TwodVertex* row_sums;
+	const int64_t* isolated_edges;
+	const int64_t* row_starts;
+	const LocalVertex* orig_vertexes;
+	const int64_t* edge_array;
+	int64_t* send_buffer;
+	int num_send; // [in/out]
+	int64_t edge_relax; // [in/out]
+};
+
+// Scans the words [blk_start, blk_end) of the phase bitmap and returns the unvisited rows in them.
+typedef BitmapType (*BottomUpScanKernel)(BottomUpScanArgs* args, int64_t blk_start, int64_t blk_end);
+
+// Returns the fastest kernel supported by the CPU or NULL if no kernel is supported.
+BottomUpScanKernel get_bottom_up_scan_kernel(bool allow_avx512, const char** name);
+#endif // #if BOTTOM_UP_SIMD
+
 #endif /* LOW_LEVEL_FUNC_H_ */
@@ -25,12 +25,31 @@
 #include "graph_constructor.hpp"
 #include "validate.hpp"
 #include "benchmark_helper.hpp"
+#include "graph_snapshot.hpp"
 #include "bfs.hpp"
 #include "bfs_cpu.hpp"
+#include "multi_source_bfs.hpp"
+#include "autotune.hpp"
 #if CUDA_ENABLED
 #include "bfs_gpu.hpp"
 #endif
 
+// Returns the array to validate. The validation writes the depths into it,
+// so the result is copied into buf if buf is given.
+// Otherwise pred is handed out and the next BFS has to clear it entirely.
+static int64_t* pred_to_validate(BfsOnCPU* benchmark, int64_t* pred, int64_t* buf, int64_t nlocalverts)
+{
+	if(buf == NULL) {
+		benchmark->invalidate_pred();
+		return pred;
+	}
+#pragma omp parallel for
+	for(int64_t i = 0; i < nlocalverts; ++i) {
+		buf[i] = pred[i];
+	}
+	return buf;
+}
+
 void graph500_bfs(int SCALE, int edgefactor)
 {
 	using namespace PRM;
@@ -44,26 +63,68 @@ void graph500_bfs(int SCALE, int edgefactor)
 
 	EdgeListStorage<UnweightedPackedEdge, 8*1024*1024> edge_list(
 //	EdgeListStorage<UnweightedPackedEdge, 512*1024> edge_list(
-			(int64_t(1) << SCALE) * edgefactor / mpi.size_2d, getenv("TMPFILE"));
+			(int64_t(1) << SCALE) * edgefactor / mpi.size_2d, getenv("TMPFILE"), getenv("EDGE_LIST_MMAP") != NULL);
 
 	BfsOnCPU::printInformation();
 
-	if(mpi.isMaster()) print_with_prefix("Graph generation");
-	double generation_time = MPI_Wtime();
-	generate_graph_spec2010(&edge_list, SCALE, edgefactor);
-	generation_time = MPI_Wtime() - generation_time;
+	// When GRAPH_SNAPSHOT is set, the constructed graph is loaded from the snapshot if exists.
+	// Otherwise, the graph is constructed and saved to the snapshot.
+	const char* snapshot_path = getenv("GRAPH_SNAPSHOT");
+	const bool graph_from_snapshot = (snapshot_path != NULL) &&
+			graph_snapshot_available(snapshot_path, SCALE, edgefactor);
+	// The edge list is still required for the validation.
+	const bool need_edge_list = (graph_from_snapshot == false) || (VALIDATION_LEVEL > 0);
+	// When STREAMING_CONSTRUCTION is set, the graph is constructed from the edges generated on demand
+	// and the edge list for the validation is generated after the construction.
+	// This reduces the peak memory usage of the construction.
+	const bool streaming_construction = (getenv("STREAMING_CONSTRUCTION") != NULL) &&
+			(graph_from_snapshot == false);
+
+	double generation_time = 0;
+	if(need_edge_list && streaming_construction == false) {
+		if(mpi.isMaster()) print_with_prefix("Graph generation");
+		generation_time = MPI_Wtime();
+		generate_graph_spec2010(&edge_list, SCALE, edgefactor);
+		generation_time = MPI_Wtime() - generation_time;
+	}
 
 	if(mpi.isMaster()) print_with_prefix("Graph construction");
 	// Create BFS instance and the *COMMUNICATION THREAD*.
 	BfsOnCPU* benchmark = new BfsOnCPU();
 	double construction_time = MPI_Wtime();
-	benchmark->construct(&edge_list);
+	if(graph_from_snapshot) {
+		if(load_graph_snapshot(benchmark->graph_, snapshot_path, SCALE, edgefactor) == false) {
+			throw_exception("Failed to load graph snapshot %s", snapshot_path);
+		}
+	}
+	else if(streaming_construction) {
+		if(mpi.isMaster()) print_with_prefix("Streaming construction: the edges are generated on demand");
+		Spec2010GraphGenerator<UnweightedPackedEdge> generator(SCALE, edgefactor);
+		GeneratedEdgeList<UnweightedPackedEdge, 8*1024*1024> generated_edge_list(&generator);
+		benchmark->construct(&generated_edge_list);
+	}
+	else {
+		benchmark->construct(&edge_list);
+	}
 	construction_time = MPI_Wtime() - construction_time;
+	if(snapshot_path != NULL && graph_from_snapshot == false) {
+		save_graph_snapshot(benchmark->graph_, snapshot_path, SCALE, edgefactor);
+	}
+
+	if(need_edge_list && streaming_construction && VALIDATION_LEVEL > 0) {
+		if(mpi.isMaster()) print_with_prefix("Graph generation for the validation");
+		generation_time = MPI_Wtime();
+		generate_graph_spec2010(&edge_list, SCALE, edgefactor);
+		generation_time = MPI_Wtime() - generation_time;
+	}
 
-	if(mpi.isMaster()) print_with_prefix("Redistributing edge list...");
-	double redistribution_time = MPI_Wtime();
-	redistribute_edge_2d(&edge_list);
-	redistribution_time = MPI_Wtime() - redistribution_time;
+	double redistribution_time = 0;
+	if(need_edge_list && (streaming_construction == false || VALIDATION_LEVEL > 0)) {
+		if(mpi.isMaster()) print_with_prefix("Redistributing edge list...");
+		redistribution_time = MPI_Wtime();
+		redistribute_edge_2d(&edge_list);
+		redistribution_time = MPI_Wtime() - redistribution_time;
+	}
 
 	int64_t bfs_roots[NUM_BFS_ROOTS];
 	int num_bfs_roots = NUM_BFS_ROOTS;
@@ -86,10 +147,52 @@ void graph500_bfs(int SCALE, int edgefactor)
 	if(root_start == 0)
 		init_log(SCALE, edgefactor, generation_time, construction_time, redistribution_time, &log);
 
-	benchmark->prepare_bfs();
+	// When MULTI_SOURCE_BFS is set, the roots are processed in batches of up to
+	// MultiSourceBfs::MAX_LANES roots in one traversal.
+	// The time of a batch is divided equally among the roots in the batch.
+	MultiSourceBfs* ms_bfs = NULL;
+	int64_t* ms_pred = NULL;
+	int ms_max_batch_size = 0, ms_batch_start = 0, ms_batch_size = 0;
+	double ms_batch_time = 0;
+	// When SSSP is set, the delta-stepping SSSP kernel runs instead of BFS.
+	float* dist = NULL;
+	// The BFS result is validated on a copy so that run_bfs() only has to clear
+	// the blocks of pred written in the previous BFS (INCREMENTAL_PRED_RESET).
+	int64_t* validate_pred = NULL;
+	// The lane masks are exchanged on the 2D communicators, which do not support the Y dimension.
+	const bool multi_source_bfs = (getenv("MULTI_SOURCE_BFS") != NULL) && !mpi.isYdimAvailable();
+	if(getenv("MULTI_SOURCE_BFS") && !multi_source_bfs) {
+		if(mpi.isMaster()) print_with_prefix("Warning: MULTI_SOURCE_BFS is not supported with the Y dimension. Running single-source BFS.");
+	}
+	if(multi_source_bfs) {
+		if(mpi.isMaster()) print_with_prefix("Multi-source BFS mode");
+		ms_bfs = new MultiSourceBfs(benchmark->graph_);
+		ms_max_batch_size = ms_bfs->max_batch_size(num_bfs_roots);
+		ms_bfs->prepare();
+		ms_pred = static_cast<int64_t*>(cache_aligned_xmalloc(
+				nlocalverts*ms_max_batch_size*sizeof(ms_pred[0])));
+	}
+	else if(getenv("SSSP")) {
+		if(mpi.isMaster()) print_with_prefix("SSSP mode");
+		benchmark->prepare_sssp();
+		dist = static_cast<float*>(cache_aligned_xmalloc(nlocalverts*sizeof(dist[0])));
+	}
+	else {
+		benchmark->prepare_bfs();
+#if VALIDATION_LEVEL >= 1 && INCREMENTAL_PRED_RESET
+		validate_pred = static_cast<int64_t*>(
+			cache_aligned_xmalloc(nlocalverts*sizeof(validate_pred[0])));
+#endif
+		// When AUTOTUNE is set, the runtime parameters are tuned before the benchmark
+		// and the benchmark runs with the best configuration.
+		const char* autotune_path = getenv("AUTOTUNE");
+		if(autotune_path != NULL) {
+			autotune_bfs(benchmark, bfs_roots, num_bfs_roots, pred, autotune_path);
+		}
+	}
 // narashi
 		double time_left = PRE_EXEC_TIME;
-        for(int c = root_start; time_left > 0.0; ++c) {
+        for(int c = root_start; ms_bfs == NULL && dist == NULL && time_left > 0.0; ++c) {
                 if(mpi.isMaster())  print_with_prefix("========== Pre Running BFS %d ==========", c);
                 MPI_Barrier(mpi.comm_2d);
                 double bfs_time = MPI_Wtime();
@@ -110,11 +213,34 @@ void graph500_bfs(int SCALE, int edgefactor)
 #if ENABLE_FUJI_PROF
 		fapp_start("bfs", i, 1);
 #endif
-		MPI_Barrier(mpi.comm_2d);
-		PROF(profiling::g_pis.reset());
-		bfs_times[i] = MPI_Wtime();
-		benchmark->run_bfs(bfs_roots[i], pred);
-		bfs_times[i] = MPI_Wtime() - bfs_times[i];
+		int64_t* root_pred = pred;
+		if(ms_bfs != NULL) {
+			if(i >= ms_batch_start + ms_batch_size) {
+				ms_batch_start = i;
+				ms_batch_size = std::min<int>(num_bfs_roots - i, ms_max_batch_size);
+				MPI_Barrier(mpi.comm_2d);
+				PROF(profiling::g_pis.reset());
+				ms_batch_time = MPI_Wtime();
+				ms_bfs->run(&bfs_roots[i], ms_batch_size, ms_pred);
+				ms_batch_time = MPI_Wtime() - ms_batch_time;
+			}
+			bfs_times[i] = ms_batch_time / ms_batch_size;
+			root_pred = ms_pred + (i - ms_batch_start) * nlocalverts;
+		}
+		else if(dist != NULL) {
+			MPI_Barrier(mpi.comm_2d);
+			PROF(profiling::g_pis.reset());
+			bfs_times[i] = MPI_Wtime();
+			benchmark->run_sssp(bfs_roots[i], pred, dist);
+			bfs_times[i] = MPI_Wtime() - bfs_times[i];
+		}
+		else {
+			MPI_Barrier(mpi.comm_2d);
+			PROF(profiling::g_pis.reset());
+			bfs_times[i] = MPI_Wtime();
+			benchmark->run_bfs(bfs_roots[i], pred);
+			bfs_times[i] = MPI_Wtime() - bfs_times[i];
+		}
 #if ENABLE_FUJI_PROF
 		fapp_stop("bfs", i, 1);
 #endif
@@ -124,17 +250,25 @@ void graph500_bfs(int SCALE, int edgefactor)
 			print_with_prefix("Validating BFS %d", i);
 		}
 
-		benchmark->get_pred(pred);
+		// get_pred() hands pred out to the caller. It is not needed when the validation
+		// reads a copy, which keeps pred clean for the incremental reset.
+		if(ms_bfs == NULL && dist == NULL && validate_pred == NULL) benchmark->get_pred(pred);
 
 		validate_times[i] = MPI_Wtime();
 		int64_t edge_visit_count = 0;
 #if VALIDATION_LEVEL >= 2
-		result_ok = validate_bfs_result(
-					&edge_list, max_used_vertex + 1, nlocalverts, bfs_roots[i], pred, &edge_visit_count);
+		result_ok = (dist != NULL) ? validate_sssp_result(
+					&edge_list, max_used_vertex + 1, nlocalverts, bfs_roots[i], pred, dist, &edge_visit_count) :
+				validate_bfs_result(
+					&edge_list, max_used_vertex + 1, nlocalverts, bfs_roots[i],
+					pred_to_validate(benchmark, root_pred, validate_pred, nlocalverts), &edge_visit_count);
 #elif VALIDATION_LEVEL == 1
 		if(i == 0) {
-			result_ok = validate_bfs_result(
-						&edge_list, max_used_vertex + 1, nlocalverts, bfs_roots[i], pred, &edge_visit_count);
+			result_ok = (dist != NULL) ? validate_sssp_result(
+						&edge_list, max_used_vertex + 1, nlocalverts, bfs_roots[i], pred, dist, &edge_visit_count) :
+					validate_bfs_result(
+						&edge_list, max_used_vertex + 1, nlocalverts, bfs_roots[i],
+						pred_to_validate(benchmark, root_pred, validate_pred, nlocalverts), &edge_visit_count);
 			pf_nedge[SCALE] = edge_visit_count;
 		}
 		else {
@@ -158,7 +292,18 @@ void graph500_bfs(int SCALE, int edgefactor)
 
 		update_log_file(&log, bfs_times[i], validate_times[i], edge_visit_count);
 	}
-	benchmark->end_bfs();
+	if(ms_bfs != NULL) {
+		delete ms_bfs;
+		free(ms_pred);
+	}
+	else if(dist != NULL) {
+		benchmark->end_sssp();
+		free(dist);
+	}
+	else {
+		benchmark->end_bfs();
+		free(validate_pred);
+	}
 
 	if(mpi.isMaster()) {
 	  fprintf(stdout, "============= Result ==============\n");
@@ -208,20 +353,28 @@ void test02(int SCALE, int edgefactor)
 int main(int argc, char** argv)
 {
 	// Parse arguments.
+	// The options (--<name>=<value>) are parsed by RuntimeConfig after MPI is initialized.
 	int SCALE = 16;
 	int edgefactor = 16; // nedges / nvertices, i.e., 2*avg. degree
-	if (argc >= 2) SCALE = atoi(argv[1]);
-	if (argc >= 3) edgefactor = atoi(argv[2]);
-	if (argc <= 1 || argc >= 4 || SCALE == 0 || edgefactor == 0) {
-		fprintf(IMD_OUT, "Usage: %s SCALE edgefactor\n"
+	int num_args = 0;
+	for(int i = 1; i < argc; ++i) {
+		if(strncmp(argv[i], "--", 2) == 0) continue;
+		if(num_args == 0) SCALE = atoi(argv[i]);
+		if(num_args == 1) edgefactor = atoi(argv[i]);
+		++num_args;
+	}
+	if (num_args < 1 || num_args > 2 || SCALE == 0 || edgefactor == 0) {
+		fprintf(IMD_OUT, "Usage: %s [--config=<file>] [--<name>=<value> ...] SCALE edgefactor\n"
 				"SCALE = log_2(# vertices) [integer, required]\n"
 				"edgefactor = (# edges) / (# vertices) = .5 * (average vertex degree) [integer, defaults to 16]\n"
-				"(Random number seed are in main.c)\n",
+				"(Random number seed are in main.c)\n"
+				"See runtime_config.hpp for the names of the runtime parameters.\n",
 				argv[0]);
 		return 0;
 	}
 
 	setup_globals(argc, argv, SCALE, edgefactor);
+	g_config.load(argc, argv);
 
 	graph500_bfs(SCALE, edgefactor);
 
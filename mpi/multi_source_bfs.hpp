@@ -0,0 +1,495 @@
+/*
+ * multi_source_bfs.hpp
+ */
+
+#ifndef MULTI_SOURCE_BFS_HPP_
+#define MULTI_SOURCE_BFS_HPP_
+
+#include "utils.hpp"
+#include "graph_constructor.hpp"
+#include "runtime_config.hpp"
+
+//-------------------------------------------------------------//
+// Multi-source BFS
+//-------------------------------------------------------------//
+// Runs up to 64 BFSs from different roots in one level-synchronous traversal.
+// Each vertex has a 64-bit lane mask (1 bit for each root) instead of a visited bit,
+// so that the edge scans and the communication of each level are shared by all roots.
+//
+// top-down: the frontier masks are gathered along the processor row and
+//           (target, lanes, parent) updates are sent to the owners of the targets.
+// bottom-up: the frontier masks are gathered along the processor column and
+//           (vertex, lanes, parent) updates are sent to the owners of the unvisited vertices.
+//
+// The cost grows with the number of local vertices, not with the frontier:
+// - the predecessor arrays of a batch take 8 bytes per root and local vertex
+//   (512 bytes per local vertex with 64 roots);
+// - the lane masks take 8 bytes x (3 + max(R, C) + C) per local vertex, including the
+//   gathered masks of the processor row and column;
+// - every level gathers the 64-bit masks of all the vertices of the processor row or column
+//   (the bottom-up step gathers both the frontier and the visited masks).
+// The batch size is reduced so that these arrays fit into MULTI_SOURCE_BFS_MEMORY.
+//
+// Runtime options:
+// MULTI_SOURCE_BFS_MEMORY: memory per process in MB for the multi-source BFS
+//                          (default: 1/4 of the physical memory)
+
+struct MultiSourceUpdate;
+template <> struct MpiTypeOf<MultiSourceUpdate> { static MPI_Datatype type; };
+MPI_Datatype MpiTypeOf<MultiSourceUpdate>::type = MPI_DATATYPE_NULL;
+
+struct MultiSourceUpdate {
+	uint64_t lanes;
+	int64_t parent; // original vertex id of the parent
+	int64_t local; // reordered local vertex id of the target
+
+	static void initialize()
+	{
+		MPI_Type_contiguous(3, MPI_INT64_T, &MpiTypeOf<MultiSourceUpdate>::type);
+		MPI_Type_commit(&MpiTypeOf<MultiSourceUpdate>::type);
+	}
+
+	static void uninitialize()
+	{
+		MPI_Type_free(&MpiTypeOf<MultiSourceUpdate>::type);
+	}
+};
+
+class MultiSourceBfs
+{
+	typedef Graph2DCSR GraphType;
+	typedef uint64_t LaneMask;
+public:
+	enum {
+		MAX_LANES = sizeof(LaneMask) * 8,
+
+		NBPE = PRM::NBPE,
+		LOG_NBPE = PRM::LOG_NBPE,
+		NBPE_MASK = PRM::NBPE_MASK,
+	};
+
+	explicit MultiSourceBfs(GraphType& g)
+		: graph_(g)
+		, seen_(NULL)
+		, frontier_(NULL)
+		, next_(NULL)
+		, gathered_frontier_(NULL)
+		, gathered_seen_(NULL)
+		, col_invert_map_(NULL)
+		, pred_(NULL)
+		, num_lanes_(0)
+		, all_lanes_(0)
+		, current_level_(0)
+	{ }
+
+	~MultiSourceBfs()
+	{
+		end();
+	}
+
+	void prepare()
+	{
+		const int64_t L = graph_.num_local_verts_;
+		const int max_comm_size = std::max(mpi.size_2dc, mpi.size_2dr);
+		MultiSourceUpdate::initialize();
+
+		seen_ = static_cast<LaneMask*>(cache_aligned_xmalloc(L*sizeof(LaneMask)));
+		frontier_ = static_cast<LaneMask*>(cache_aligned_xmalloc(L*sizeof(LaneMask)));
+		next_ = static_cast<LaneMask*>(cache_aligned_xmalloc(L*sizeof(LaneMask)));
+		gathered_frontier_ = static_cast<LaneMask*>(
+				cache_aligned_xmalloc(L*max_comm_size*sizeof(LaneMask)));
+		gathered_seen_ = static_cast<LaneMask*>(
+				cache_aligned_xmalloc(L*mpi.size_2dc*sizeof(LaneMask)));
+
+		// The bottom-up search finds parents in the processor column.
+		// To report their original vertex ids, we need the invert map of the column.
+		col_invert_map_ = static_cast<LocalVertex*>(
+				cache_aligned_xmalloc(L*mpi.size_2dr*sizeof(LocalVertex)));
+		MPI_Allgather(graph_.invert_map_, L, MpiTypeOf<LocalVertex>::type,
+				col_invert_map_, L, MpiTypeOf<LocalVertex>::type, mpi.comm_2dc);
+
+		VERVOSE(if(mpi.isMaster()) print_with_prefix("Multi-source BFS memory: %f MB per process",
+				to_mega(mask_bytes())));
+	}
+
+	// Returns the number of roots in a batch (at most num_roots and MAX_LANES) whose
+	// predecessor arrays fit into MULTI_SOURCE_BFS_MEMORY with the lane masks.
+	// This is a collective operation.
+	int max_batch_size(int num_roots) const
+	{
+		const char* str = getenv("MULTI_SOURCE_BFS_MEMORY");
+		int64_t limit = (str != NULL) ? int64_t(atof(str) * 1024 * 1024) :
+				int64_t(sysconf(_SC_PHYS_PAGES)) * sysconf(_SC_PAGE_SIZE) / 4;
+		int64_t pred_bytes = graph_.pred_size() * sizeof(int64_t);
+		int64_t lanes = (limit - mask_bytes()) / std::max<int64_t>(1, pred_bytes);
+		int batch_size = int(std::max<int64_t>(0, std::min<int64_t>(lanes,
+				std::min<int>(num_roots, MAX_LANES))));
+		MPI_Allreduce(MPI_IN_PLACE, &batch_size, 1, MPI_INT, MPI_MIN, mpi.comm_2d);
+		if(batch_size == 0) {
+			throw_exception("Multi-source BFS needs %f MB per process for one root (MULTI_SOURCE_BFS_MEMORY=%f)",
+					to_mega(mask_bytes() + pred_bytes), to_mega(limit));
+		}
+		if(mpi.isMaster() && batch_size < std::min<int>(num_roots, MAX_LANES)) {
+			print_with_prefix("Multi-source BFS: %d roots per batch to fit into %f MB per process",
+					batch_size, to_mega(limit));
+		}
+		return batch_size;
+	}
+
+	void end()
+	{
+		if(seen_ == NULL) return ;
+		free(seen_); seen_ = NULL;
+		free(frontier_); frontier_ = NULL;
+		free(next_); next_ = NULL;
+		free(gathered_frontier_); gathered_frontier_ = NULL;
+		free(gathered_seen_); gathered_seen_ = NULL;
+		free(col_invert_map_); col_invert_map_ = NULL;
+		MultiSourceUpdate::uninitialize();
+	}
+
+	/**
+	 * @param roots [in] UNSWIZZLED and ORIGINAL vertex ids. num_roots <= MAX_LANES
+	 * @param pred [out] num_roots predecessor arrays. The array for i-th root begins at
+	 * pred + i * graph.pred_size().
+	 */
+	void run(const int64_t* roots, int num_roots, int64_t* pred);
+
+private:
+	GraphType& graph_;
+
+	// Index: reordered local vertex
+	LaneMask* seen_;
+	LaneMask* frontier_;
+	LaneMask* next_;
+	// Index: compact vertex of processor row (top-down) or column (bottom-up)
+	LaneMask* gathered_frontier_;
+	LaneMask* gathered_seen_;
+	LocalVertex* col_invert_map_;
+
+	int64_t* pred_;
+	int num_lanes_;
+	LaneMask all_lanes_;
+	int current_level_;
+
+	void initialize_memory(const int64_t* roots) {
+		const int64_t L = graph_.num_local_verts_;
+		const int64_t num_pred = graph_.pred_size() * num_lanes_;
+		int64_t* pred = pred_;
+
+#pragma omp parallel
+		{
+#pragma omp for nowait
+			for(int64_t i = 0; i < num_pred; ++i) {
+				pred[i] = -1;
+			}
+#pragma omp for nowait
+			for(int64_t i = 0; i < L; ++i) {
+				seen_[i] = frontier_[i] = next_[i] = 0;
+			}
+		}
+
+		for(int lane = 0; lane < num_lanes_; ++lane) {
+			int64_t root = roots[lane];
+			if(vertex_owner(root) == mpi.rank_2d) {
+				int64_t root_local = vertex_local(root);
+				LocalVertex reordered = graph_.reorder_map_[root_local];
+				pred_[lane * graph_.pred_size() + root_local] = root;
+				seen_[reordered] |= LaneMask(1) << lane;
+				frontier_[reordered] |= LaneMask(1) << lane;
+			}
+		}
+	}
+
+	// bytes per process of the arrays allocated in prepare()
+	int64_t mask_bytes() const {
+		const int64_t L = graph_.num_local_verts_;
+		const int max_comm_size = std::max(mpi.size_2dc, mpi.size_2dr);
+		return L*(3 + max_comm_size + mpi.size_2dc)*sizeof(LaneMask) + L*mpi.size_2dr*sizeof(LocalVertex);
+	}
+
+	void top_down_search(ScatterContext& scatter);
+	void bottom_up_search(ScatterContext& scatter);
+	void apply_updates(MultiSourceUpdate* updates, int num_updates);
+
+	// returns the number of (vertex, root) pairs in the next frontier.
+	int64_t swap_frontier(int64_t* num_unvisited);
+
+	template <bool count_only>
+	void top_down_scan(int* restrict counts, MultiSourceUpdate* restrict buffer);
+	template <bool count_only>
+	void bottom_up_scan(int* restrict counts, MultiSourceUpdate* restrict buffer);
+};
+
+template <bool count_only>
+void MultiSourceBfs::top_down_scan(int* restrict counts, MultiSourceUpdate* restrict buffer)
+{
+	const int lgl = graph_.local_bits_;
+	const int r_mask = (1 << graph_.r_bits_) - 1;
+	const int64_t lmask = (int64_t(1) << lgl) - 1;
+	const int P = mpi.size_2d;
+	const int R = mpi.size_2dr;
+	const int r = mpi.rank_2dr;
+	const int64_t local_bitmap_width = graph_.num_local_verts_ / NBPE;
+	const int64_t bitmap_size = local_bitmap_width * mpi.size_2dc;
+	const BitmapType* restrict row_bitmap = graph_.row_bitmap_;
+	const TwodVertex* restrict row_sums = graph_.row_sums_;
+	const LaneMask* restrict row_frontier = gathered_frontier_;
+	const EdgeArrayRef edge_array = graph_.edge_array();
+
+#define EMIT_UPDATE(tgt) do { \
+		int dest = (tgt >> lgl) & r_mask; \
+		if(count_only) { counts[dest]++; } \
+		else { \
+			MultiSourceUpdate& upd = buffer[counts[dest]++]; \
+			upd.lanes = lanes; upd.parent = src_orig; upd.local = tgt & lmask; \
+		} \
+	} while(false)
+
+#pragma omp for schedule(static)
+	for(int64_t word_idx = 0; word_idx < bitmap_size; ++word_idx) {
+		BitmapType bit_flags = row_bitmap[word_idx];
+		while(bit_flags != BitmapType(0)) {
+			BitmapType vis_bit = bit_flags & (-bit_flags);
+			BitmapType low_mask = vis_bit - 1;
+			bit_flags &= ~vis_bit;
+			LaneMask lanes = row_frontier[word_idx * NBPE + __builtin_popcountl(low_mask)];
+			if(lanes == 0) continue;
+
+			TwodVertex non_zero_off = row_sums[word_idx] + __builtin_popcountl(row_bitmap[word_idx] & low_mask);
+			int64_t src_c = word_idx / local_bitmap_width;
+			int64_t src_orig = int64_t(graph_.orig_vertexes_[non_zero_off]) * P + src_c * R + r;
+#if ISOLATE_FIRST_EDGE
+			{
+				int64_t tgt = graph_.isolated_edges_[non_zero_off];
+				EMIT_UPDATE(tgt);
+			}
+#endif
+			int64_t e_start = graph_.row_starts_[non_zero_off];
+			int64_t e_end = graph_.row_starts_[non_zero_off+1];
+			for(int64_t e = e_start; e < e_end; ++e) {
+				int64_t tgt = edge_array[e];
+				EMIT_UPDATE(tgt);
+			}
+		}
+	}
+#undef EMIT_UPDATE
+}
+
+template <bool count_only>
+void MultiSourceBfs::bottom_up_scan(int* restrict counts, MultiSourceUpdate* restrict buffer)
+{
+	const int lgl = graph_.local_bits_;
+	const int r_bits = graph_.r_bits_;
+	const int64_t L = graph_.num_local_verts_;
+	const int P = mpi.size_2d;
+	const int R = mpi.size_2dr;
+	const int c = mpi.rank_2dc;
+	const int64_t local_bitmap_width = L / NBPE;
+	const int64_t bitmap_size = local_bitmap_width * mpi.size_2dc;
+	const BitmapType* restrict row_bitmap = graph_.row_bitmap_;
+	const TwodVertex* restrict row_sums = graph_.row_sums_;
+	const LaneMask* restrict row_seen = gathered_seen_;
+	const LaneMask* restrict col_frontier = gathered_frontier_;
+	const LaneMask all_lanes = all_lanes_;
+	const EdgeArrayRef edge_array = graph_.edge_array();
+
+	// returns true when all the lanes are found
+#define PROBE_NEIGHBOR(tgt) do { \
+		TwodVertex bit_idx = SeparatedId(SeparatedId(tgt).low(r_bits + lgl)).compact(lgl, L); \
+		LaneMask found = col_frontier[bit_idx] & unseen; \
+		if(found) { \
+			if(count_only) { counts[src_c]++; } \
+			else { \
+				int64_t tgt_r = bit_idx / L; \
+				MultiSourceUpdate& upd = buffer[counts[src_c]++]; \
+				upd.lanes = found; \
+				upd.parent = int64_t(col_invert_map_[bit_idx]) * P + c * R + tgt_r; \
+				upd.local = compact - src_c * L; \
+			} \
+			unseen &= ~found; \
+		} \
+	} while(false)
+
+#pragma omp for schedule(static)
+	for(int64_t word_idx = 0; word_idx < bitmap_size; ++word_idx) {
+		BitmapType bit_flags = row_bitmap[word_idx];
+		while(bit_flags != BitmapType(0)) {
+			BitmapType vis_bit = bit_flags & (-bit_flags);
+			BitmapType low_mask = vis_bit - 1;
+			bit_flags &= ~vis_bit;
+			int64_t compact = word_idx * NBPE + __builtin_popcountl(low_mask);
+			LaneMask unseen = all_lanes & ~row_seen[compact];
+			if(unseen == 0) continue;
+
+			TwodVertex non_zero_off = row_sums[word_idx] + __builtin_popcountl(row_bitmap[word_idx] & low_mask);
+			int src_c = word_idx / local_bitmap_width;
+#if ISOLATE_FIRST_EDGE
+			{
+				int64_t tgt = graph_.isolated_edges_[non_zero_off];
+				PROBE_NEIGHBOR(tgt);
+			}
+#endif
+			int64_t e_start = graph_.row_starts_[non_zero_off];
+			int64_t e_end = graph_.row_starts_[non_zero_off+1];
+			for(int64_t e = e_start; e < e_end && unseen != 0; ++e) {
+				int64_t tgt = edge_array[e];
+				PROBE_NEIGHBOR(tgt);
+			}
+		}
+	}
+#undef PROBE_NEIGHBOR
+}
+
+void MultiSourceBfs::top_down_search(ScatterContext& scatter)
+{
+	TRACER(ms_td_search);
+	const int64_t L = graph_.num_local_verts_;
+	MPI_Allgather(frontier_, L, MpiTypeOf<LaneMask>::type,
+			gathered_frontier_, L, MpiTypeOf<LaneMask>::type, mpi.comm_2dr);
+
+#pragma omp parallel
+	top_down_scan<true>(scatter.get_counts(), NULL);
+
+	scatter.sum();
+	MultiSourceUpdate* send_buf = static_cast<MultiSourceUpdate*>(
+			cache_aligned_xmalloc(std::max(1, scatter.get_send_count())*sizeof(MultiSourceUpdate)));
+
+#pragma omp parallel
+	top_down_scan<false>(scatter.get_offsets(), send_buf);
+
+	MultiSourceUpdate* recv_buf = scatter.scatter(send_buf);
+	free(send_buf);
+	apply_updates(recv_buf, scatter.get_recv_count());
+	scatter.free(recv_buf);
+}
+
+void MultiSourceBfs::bottom_up_search(ScatterContext& scatter)
+{
+	TRACER(ms_bu_search);
+	const int64_t L = graph_.num_local_verts_;
+	MPI_Allgather(frontier_, L, MpiTypeOf<LaneMask>::type,
+			gathered_frontier_, L, MpiTypeOf<LaneMask>::type, mpi.comm_2dc);
+	MPI_Allgather(seen_, L, MpiTypeOf<LaneMask>::type,
+			gathered_seen_, L, MpiTypeOf<LaneMask>::type, mpi.comm_2dr);
+
+#pragma omp parallel
+	bottom_up_scan<true>(scatter.get_counts(), NULL);
+
+	scatter.sum();
+	MultiSourceUpdate* send_buf = static_cast<MultiSourceUpdate*>(
+			cache_aligned_xmalloc(std::max(1, scatter.get_send_count())*sizeof(MultiSourceUpdate)));
+
+#pragma omp parallel
+	bottom_up_scan<false>(scatter.get_offsets(), send_buf);
+
+	MultiSourceUpdate* recv_buf = scatter.scatter(send_buf);
+	free(send_buf);
+	apply_updates(recv_buf, scatter.get_recv_count());
+	scatter.free(recv_buf);
+}
+
+void MultiSourceBfs::apply_updates(MultiSourceUpdate* updates, int num_updates)
+{
+	const int64_t pred_size = graph_.pred_size();
+	const int64_t level_bits = int64_t(current_level_) << 48;
+	const LocalVertex* invert_map = graph_.invert_map_;
+	int64_t* restrict pred = pred_;
+
+#pragma omp parallel for schedule(static)
+	for(int i = 0; i < num_updates; ++i) {
+		int64_t local = updates[i].local;
+		LaneMask lanes = updates[i].lanes;
+		if((lanes & ~seen_[local]) == 0) continue;
+		// each lane of a vertex is claimed only once
+		LaneMask new_lanes = lanes & ~__sync_fetch_and_or(&seen_[local], lanes);
+		if(new_lanes == 0) continue;
+		__sync_fetch_and_or(&next_[local], new_lanes);
+		int64_t pred_v = updates[i].parent | level_bits;
+		int64_t orig = invert_map[local];
+		while(new_lanes != 0) {
+			int lane = __builtin_ctzl(new_lanes);
+			new_lanes &= new_lanes - 1;
+			pred[lane * pred_size + orig] = pred_v;
+		}
+	}
+}
+
+int64_t MultiSourceBfs::swap_frontier(int64_t* num_unvisited)
+{
+	const int64_t L = graph_.num_local_verts_;
+	const LaneMask all_lanes = all_lanes_;
+	int64_t send_count[2] = { 0, 0 };
+	int64_t nq_size = 0, unvisited = 0;
+#pragma omp parallel for reduction(+:nq_size, unvisited)
+	for(int64_t i = 0; i < L; ++i) {
+		LaneMask nq = next_[i];
+		frontier_[i] = nq;
+		next_[i] = 0;
+		nq_size += __builtin_popcountl(nq);
+		if(graph_.has_edge_bitmap_[i >> LOG_NBPE] & (BitmapType(1) << (i & NBPE_MASK))) {
+			unvisited += __builtin_popcountl(all_lanes & ~seen_[i]);
+		}
+	}
+	send_count[0] = nq_size;
+	send_count[1] = unvisited;
+	int64_t recv_count[2];
+	MPI_Allreduce(send_count, recv_count, 2, MpiTypeOf<int64_t>::type, MPI_SUM, mpi.comm_2d);
+	*num_unvisited = recv_count[1];
+	return recv_count[0];
+}
+
+void MultiSourceBfs::run(const int64_t* roots, int num_roots, int64_t* pred)
+{
+	TRACER(run_ms_bfs);
+	assert (num_roots > 0 && num_roots <= MAX_LANES);
+	pred_ = pred;
+	num_lanes_ = num_roots;
+	all_lanes_ = (num_roots == MAX_LANES) ? ~LaneMask(0) : ((LaneMask(1) << num_roots) - 1);
+	VERVOSE(double start_time = MPI_Wtime());
+
+	initialize_memory(roots);
+
+	ScatterContext td_scatter(mpi.comm_2dc);
+	ScatterContext bu_scatter(mpi.comm_2dr);
+
+	// The switch parameters are the same as the single source BFS
+	// but all counts are the sum of all lanes.
+	const int64_t num_global_lane_verts = graph_.num_global_verts_ * num_lanes_;
+	int64_t global_nq_size = num_lanes_;
+	int64_t prev_global_nq_size = 0;
+	bool forward_or_backward = true;
+	bool growing_or_shrinking = true;
+
+	for(current_level_ = 1; global_nq_size > 0; ++current_level_) {
+		TRACER(ms_level);
+		if(forward_or_backward)
+			top_down_search(td_scatter);
+		else
+			bottom_up_search(bu_scatter);
+
+		prev_global_nq_size = global_nq_size;
+		int64_t global_unvisited;
+		global_nq_size = swap_frontier(&global_unvisited);
+
+		VERVOSE(if(mpi.isMaster()) print_with_prefix("MS-BFS Level %d (%s) NQ %" PRId64 " Unvisited %" PRId64 "",
+				current_level_, forward_or_backward ? "top-down" : "bottom-up", global_nq_size, global_unvisited));
+
+		if(growing_or_shrinking && global_nq_size > prev_global_nq_size) { // growing
+			if(forward_or_backward && global_nq_size > num_global_lane_verts / g_config.denom_topdown_to_bottomup) {
+				forward_or_backward = false;
+			}
+		}
+		else { // shrinking
+			if(!forward_or_backward && global_unvisited < int64_t(num_global_lane_verts / g_config.denom_bottomup_to_topdown)) {
+				forward_or_backward = true;
+				growing_or_shrinking = false;
+			}
+		}
+	}
+
+	VERVOSE(if(mpi.isMaster()) print_with_prefix("Time of MS-BFS (%d roots): %f ms",
+			num_lanes_, (MPI_Wtime() - start_time) * 1000.0));
+}
+
+#endif /* MULTI_SOURCE_BFS_HPP_ */
@@ -0,0 +1,191 @@
+/*
+ * numa_layout.hpp
+ */
+
+#ifndef NUMA_LAYOUT_HPP_
+#define NUMA_LAYOUT_HPP_
+
+#include <numa.h>
+#include <numaif.h>
+
+#include "utils.hpp"
+#include "graph_constructor.hpp"
+
+//-------------------------------------------------------------//
+// NUMA-aware Memory Layout
+//-------------------------------------------------------------//
+// For the runs with one process for multiple NUMA nodes.
+// The graph is divided into the slabs scanned by each thread and each slab is copied
+// by the thread which scans it, so that the first touch places it on the thread's NUMA node.
+// The kernels use the same static thread ranges (thread_range()) instead of the dynamic ones.
+// The bitmaps, which all the threads read randomly, are interleaved over the NUMA nodes.
+//
+// Runtime options:
+// NUMA_LAYOUT: 1 = enable
+// NUMA_BITMAP_POLICY: interleave (default) or local (keep the first touch placement)
+
+class NumaLayout
+{
+public:
+	NumaLayout() : enabled_(false), interleave_bitmaps_(true) { }
+
+	void initialize() {
+		const char* layout_str = getenv("NUMA_LAYOUT");
+		const char* policy_str = getenv("NUMA_BITMAP_POLICY");
+		enabled_ = (layout_str != NULL && atoi(layout_str) != 0);
+		interleave_bitmaps_ = (policy_str == NULL || strcmp(policy_str, "local") != 0);
+		if(enabled_ && numa_available() < 0) {
+			if(mpi.isMaster()) print_with_prefix("NUMA layout is disabled since NUMA is not available.");
+			enabled_ = false;
+		}
+	}
+
+	bool enabled() const { return enabled_; }
+
+	void print_information() const {
+		print_with_prefix("NUMA layout: %s (bitmaps: %s)", enabled_ ? "enabled" : "disabled",
+				interleave_bitmaps_ ? "interleave" : "local");
+	}
+
+	enum {
+		// The thread ranges are aligned to the groups of the bottom-up summary bitmap.
+		RANGE_ALIGN = 64,
+	};
+
+	// The maximum width of the thread ranges.
+	static int64_t range_width(int64_t length, int num_threads) {
+		return roundup<int64_t>((length + num_threads - 1) / num_threads, RANGE_ALIGN);
+	}
+
+	// The range of a thread in the static partitioning of [0, length).
+	static void thread_range(int64_t length, int tid, int num_threads, int64_t* begin, int64_t* end) {
+		const int64_t width = range_width(length, num_threads);
+		*begin = std::min(length, width * tid);
+		*end = std::min(length, *begin + width);
+	}
+
+	/**
+	 * Moves the CSR arrays to the NUMA nodes of the threads which scan them.
+	 * The row bitmap is divided into the regions of region_width words (the bottom-up step width)
+	 * and each region is divided among the threads with thread_range().
+	 * This must be called from the main thread (not in a parallel region).
+	 */
+	void place_graph(Graph2DCSR& g, int64_t region_width) {
+		if(enabled_ == false) return ;
+		TRACER(numa_place);
+		if(g.mapped_region_ != NULL) {
+			if(mpi.isMaster()) print_with_prefix("NUMA layout: the graph mapped from the snapshot is not moved.");
+			return ;
+		}
+		const int64_t row_bitmap_length = g.num_local_verts_ / PRM::NBPE * mpi.size_2dc;
+		const int64_t non_zero_rows = g.row_sums_[row_bitmap_length];
+		const int64_t num_edges = g.row_starts_[non_zero_rows];
+		const int64_t num_regions = row_bitmap_length / region_width;
+		const int max_threads = omp_get_max_threads();
+
+		// slab boundaries in each index space: [region][thread] -> begin
+		const int64_t num_slabs = num_regions * max_threads;
+		int64_t* word_bound = static_cast<int64_t*>(cache_aligned_xmalloc((num_slabs + 1)*sizeof(int64_t)));
+		int64_t* row_bound = static_cast<int64_t*>(cache_aligned_xmalloc((num_slabs + 1)*sizeof(int64_t)));
+		int64_t* edge_bound = static_cast<int64_t*>(cache_aligned_xmalloc((num_slabs + 1)*sizeof(int64_t)));
+		for(int64_t region = 0; region < num_regions; ++region) {
+			for(int tid = 0; tid < max_threads; ++tid) {
+				int64_t begin, end;
+				thread_range(region_width, tid, max_threads, &begin, &end);
+				const int64_t slab = region * max_threads + tid;
+				word_bound[slab] = region * region_width + begin;
+				row_bound[slab] = g.row_sums_[word_bound[slab]];
+				edge_bound[slab] = g.row_starts_[row_bound[slab]];
+			}
+		}
+		word_bound[num_slabs] = row_bitmap_length;
+		row_bound[num_slabs] = non_zero_rows;
+		edge_bound[num_slabs] = num_edges;
+
+		g.row_bitmap_ = place_array(g.row_bitmap_, row_bitmap_length, word_bound, num_regions);
+		g.row_sums_ = place_array(g.row_sums_, row_bitmap_length + 1, word_bound, num_regions);
+		g.row_starts_ = place_array(g.row_starts_, non_zero_rows + 1, row_bound, num_regions);
+		if(g.isolated_edges_ != NULL) {
+			g.isolated_edges_ = place_array(g.isolated_edges_, non_zero_rows, row_bound, num_regions);
+		}
+		{
+			LocalVertex* orig_vertexes = static_cast<LocalVertex*>(
+					xMPI_Alloc_mem(std::max<int64_t>(non_zero_rows, 1)*sizeof(LocalVertex)));
+			copy_slabs(orig_vertexes, g.orig_vertexes_, non_zero_rows, sizeof(LocalVertex), row_bound, num_regions);
+			MPI_Free_mem(g.orig_vertexes_);
+			g.orig_vertexes_ = orig_vertexes;
+		}
+		{
+			// the edge array may be bit-packed: convert the edge indices to byte offsets
+			const int64_t edge_bytes = g.edge_array_words(num_edges) * sizeof(int64_t);
+			for(int64_t slab = 0; slab < num_slabs; ++slab) {
+#if COMPRESSED_EDGE_ARRAY
+				edge_bound[slab] = (edge_bound[slab] * g.edge_bits_) >> 3;
+#else
+				edge_bound[slab] *= sizeof(int64_t);
+#endif
+			}
+			edge_bound[num_slabs] = edge_bytes;
+			uint8_t* edge_array = static_cast<uint8_t*>(cache_aligned_xmalloc(std::max<int64_t>(edge_bytes, 1)));
+			copy_slabs(edge_array, g.edge_array_, edge_bytes, 1, edge_bound, num_regions);
+			free(g.edge_array_);
+			g.edge_array_ = reinterpret_cast<int64_t*>(edge_array);
+		}
+
+		free(word_bound);
+		free(row_bound);
+		free(edge_bound);
+		if(mpi.isMaster()) print_with_prefix("NUMA layout: the graph is placed for %d threads.", max_threads);
+	}
+
+	// Interleaves the pages of the bitmaps over the NUMA nodes. ptr must be page aligned.
+	void place_bitmaps(void* ptr, int64_t bytes) {
+		if(enabled_ == false || interleave_bitmaps_ == false) return ;
+		struct bitmask* nodes = numa_allocate_nodemask();
+		for(int node = 0; node <= numa_max_node(); ++node) {
+			numa_bitmask_setbit(nodes, node);
+		}
+		const int64_t page_size = sysconf(_SC_PAGESIZE);
+		const int64_t length = (bytes + page_size - 1) / page_size * page_size;
+		// the pages which are already touched are moved
+		if(mbind(ptr, length, MPOL_INTERLEAVE, nodes->maskp, nodes->size, MPOL_MF_MOVE) != 0) {
+			if(mpi.isMaster()) print_with_prefix("NUMA layout: mbind failed (%s).", strerror(errno));
+		}
+		numa_free_nodemask(nodes);
+	}
+
+private:
+	bool enabled_;
+	bool interleave_bitmaps_;
+
+	template <typename T>
+	T* place_array(T* src, int64_t length, const int64_t* bound, int64_t num_regions) {
+		T* dst = static_cast<T*>(cache_aligned_xmalloc(std::max<int64_t>(length, 1)*sizeof(T)));
+		copy_slabs(dst, src, length, sizeof(T), bound, num_regions);
+		free(src);
+		return dst;
+	}
+
+	// Each thread copies (and first touches) its slabs. The last slab extends to length.
+	void copy_slabs(void* dst, const void* src, int64_t length, int64_t elem_size,
+			const int64_t* bound, int64_t num_regions)
+	{
+#pragma omp parallel
+		{
+			SET_OMP_AFFINITY;
+			const int tid = omp_get_thread_num();
+			const int num_threads = omp_get_num_threads();
+			for(int64_t region = 0; region < num_regions; ++region) {
+				const int64_t slab = region * num_threads + tid;
+				const int64_t begin = bound[slab];
+				const int64_t end = (slab + 1 == num_regions * num_threads) ? length : bound[slab + 1];
+				if(end > begin) {
+					memcpy(static_cast<uint8_t*>(dst) + begin * elem_size,
+							static_cast<const uint8_t*>(src) + begin * elem_size, (end - begin) * elem_size);
+				}
+			}
+		}
+	}
+};
+
+#endif /* NUMA_LAYOUT_HPP_ */
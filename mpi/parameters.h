@@ -36,9 +36,12 @@
 
 // General Optimizations
 // 0: completely off, 1: only reduce isolated vertices, 2: sort by degree and reduce isolated vertices
+// 3: order the vertices which share neighbors closely (BFS order on the local bipartite graph) and reduce isolated vertices
 #ifndef VERTEX_REORDERING
 #define VERTEX_REORDERING 0
 #endif
+// TOP_DOWN_SEND_LB, BOTTOM_UP_OVERLAP_PFS, DENOM_*, COMM_BUFFER_SIZE and TOP_DOWN_PENDING_WIDTH
+// are the default values. They can be changed at runtime (see runtime_config.hpp).
 // 0: put all edges to temporally buffer, 1: count first, 2: hybrid
 #define TOP_DOWN_SEND_LB 2
 #define TOP_DOWN_RECV_LB 1
@@ -71,22 +74,64 @@
 #define DEGREE_ORDER 0
 #define DEGREE_ORDER_ONLY_IE 0
 #define CONSOLIDATE_IFE_PROC 1
+// The merged edges are compacted through a buffer of (# of edges) / EDGE_COMPACTION_BUFFER_DENOM edges
+#define EDGE_COMPACTION_BUFFER_DENOM 16
+// Sort the edges of each wide row and the degrees (VERTEX_REORDERING) with LSD radix sort
+// on the bit fields of the vertex ids instead of the comparison sort
+#define RADIX_SORT_CSR 1
+// Skip the blocks of 64 words in the bottom-up bitmap scan where all the vertices are visited
+#define BOTTOM_UP_SUMMARY 1
+// Vectorize the bottom-up bitmap scan with AVX2/AVX-512 (selected at runtime by the CPU features)
+#define BOTTOM_UP_SIMD 1
+// Store the edge array with fixed-width bit-packing (see PackedEdgeArray in graph_constructor.hpp)
+#ifndef COMPRESSED_EDGE_ARRAY
+#define COMPRESSED_EDGE_ARRAY 0
+#endif
 
 // We omit initialize predecessor array when this option is enabled.
 // WARNING: In the most case, BFS generates correct answer without initializing predecessor array
 // because all the vertexes reached in the previous would be reached in the current run.
 // But this is not true in the general case. BFS may generate wrong answer in some situation.
 #define INIT_PRED_ONCE 0
+// Clear only the blocks of the predecessor array written in the previous BFS.
+// This is correct unlike INIT_PRED_ONCE: the whole array is cleared if it is modified out of the BFS.
+#define INCREMENTAL_PRED_RESET 1
+// log2 of the number of the elements of a block (512 elements = 4KB)
+#define PRED_RESET_BLOCK_BITS 9
+// The BFS writes the predecessors in the index space of the reordered vertices
+// and run_bfs() converts them to the original vertex order in one pass before it returns.
+// This removes the lookup of invert_map_ for each vertex found in the top-down step
+// but adds the conversion pass: no gain was measured up to SCALE 17, so it is disabled by default.
+#define PRED_REORDERED 0
 
 #define PRE_EXEC_TIME 0 // 300 seconds
 
 #define BACKTRACE_ON_SIGNAL 0
 #define PRINT_BT_SIGNAL SIGTRAP
 
+// Record the TRACER/CTRACER scopes and the profiling spans to the per-thread ring buffers
+// and write them in Chrome trace event format (TIMELINE_TRACE=<prefix> at runtime)
+#ifndef TIMELINE_TRACE
+#define TIMELINE_TRACE 0
+#endif
+
 // org = 1000
 #define DENOM_TOPDOWN_TO_BOTTOMUP 2000.0
 #define DEMON_BOTTOMUP_TO_TOPDOWN 8.0
 #define DENOM_BITMAP_TO_LIST 2.0 // temp
+// Estimate the cost of the next level from the measured edge and byte costs
+// and choose the direction and the NQ format at runtime (enabled with ADAPTIVE_SWITCH).
+// The thresholds above are used until the costs are measured.
+// This also enables the edge counters (EDGE_COUNT) in the top-down and bottom-up loops.
+#ifndef ADAPTIVE_DIRECTION_SWITCH
+#define ADAPTIVE_DIRECTION_SWITCH 0
+#endif
+// The default bucket width of the delta-stepping SSSP is SSSP_DELTA_DEGREE / (average degree).
+// This can be overwritten with SSSP_DELTA environment variable.
+#define SSSP_DELTA_DEGREE 2.0
+// A phase of the SSSP pulls the relaxations from the side of the rows
+// when (frontier size) * SSSP_DENOM_PUSH_TO_PULL > (number of unsettled vertices).
+#define SSSP_DENOM_PUSH_TO_PULL 4.0
 
 #define CUDA_ENABLED 0
 #define CUDA_COMPUTE_EXCLUSIVE_THREAD_MODE 0
@@ -122,6 +167,22 @@
 #	define REPORT_GEN_RPGRESS 0
 #endif // #if VTRACE
 
+#if COMPRESSED_EDGE_ARRAY && (BFELL || CUDA_ENABLED)
+#	error "COMPRESSED_EDGE_ARRAY is not supported with BFELL or CUDA"
+#endif
+
+// top_down_send_large() sends the edge array without copying, which requires the uncompressed edges.
+// A nonzero top_down_send_lb is rejected at runtime (see runtime_config.hpp).
+#if COMPRESSED_EDGE_ARRAY
+#	undef TOP_DOWN_SEND_LB
+#	define TOP_DOWN_SEND_LB 0
+#endif
+
+#if BOTTOM_UP_SIMD && (COMPRESSED_EDGE_ARRAY || BFELL || !CONSOLIDATE_IFE_PROC || !defined(__GNUC__) || !defined(__x86_64__))
+#	undef BOTTOM_UP_SIMD
+#	define BOTTOM_UP_SIMD 0
+#endif
+
 #if BFELL
 #	undef ISOLATE_FIRST_EDGE
 #	define ISOLATE_FIRST_EDGE 0
@@ -138,6 +199,12 @@
 #define CACHE_LINE 128
 #define PAGE_SIZE 8192
 //#define PAGE_SIZE 16
+// Back the large arrays with huge pages (transparent huge pages or hugetlbfs).
+// The mode is selected with the HUGE_PAGES environment variable.
+#define HUGE_PAGE_ALLOC 1
+#define HUGE_PAGE_SIZE (2*1024*1024)
+// The arrays smaller than this are allocated with the normal pages.
+#define HUGE_PAGE_MIN_SIZE (4*HUGE_PAGE_SIZE)
 
 //#define IMD_OUT get_imd_out_file()
 #define IMD_OUT stderr
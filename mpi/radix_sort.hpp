@@ -0,0 +1,222 @@
+/*
+ * radix_sort.hpp
+ */
+
+#ifndef RADIX_SORT_HPP_
+#define RADIX_SORT_HPP_
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+
+#include "utils.hpp"
+
+//-------------------------------------------------------------//
+// LSD radix sort of (key, value) pairs
+//-------------------------------------------------------------//
+// The keys are unsigned integers and only the lower key_bits bits are sorted,
+// so the callers pass the bit fields of the keys (e.g., local_bits_ + r_bits_).
+// The digits are 8 bits: the histogram and the write positions of all the buckets
+// fit in L1 cache. The digits in which all the keys are the same are skipped.
+// The sort is stable.
+
+namespace radix_sort {
+
+enum {
+	LOG_RADIX = 8,
+	RADIX = 1 << LOG_RADIX,
+	RADIX_MASK = RADIX - 1,
+	// insertion sort for the shorter arrays
+	MIN_LENGTH = 64,
+	// the serial sort for the shorter arrays in parallel_sort2()
+	PARALLEL_MIN_LENGTH = 64 * 1024,
+	// the passes for 64-bit keys
+	MAX_PASSES = (64 + LOG_RADIX - 1) / LOG_RADIX,
+};
+
+inline int num_passes(int key_bits) {
+	return (key_bits + LOG_RADIX - 1) / LOG_RADIX;
+}
+
+template <typename Key, typename Value>
+void insertion_sort2(Key* keys, Value* values, int64_t count)
+{
+	for(int64_t i = 1; i < count; ++i) {
+		Key k = keys[i];
+		Value v = values[i];
+		int64_t j = i;
+		for( ; j > 0 && keys[j - 1] > k; --j) {
+			keys[j] = keys[j - 1];
+			values[j] = values[j - 1];
+		}
+		keys[j] = k;
+		values[j] = v;
+	}
+}
+
+// Serial sort. key_tmp and value_tmp must have count elements.
+template <typename Key, typename Value>
+void sort2(Key* keys, Value* values, int64_t count, int key_bits, Key* key_tmp, Value* value_tmp)
+{
+	if(count < MIN_LENGTH) {
+		insertion_sort2(keys, values, count);
+		return;
+	}
+	const int passes = num_passes(key_bits);
+	if(passes == 0) return ;
+	assert (passes <= MAX_PASSES);
+	int64_t hist[MAX_PASSES][RADIX];
+	memset(hist, 0, passes * sizeof(hist[0]));
+	// the histograms of all the digits with one read
+	for(int64_t i = 0; i < count; ++i) {
+		const Key k = keys[i];
+		for(int p = 0; p < passes; ++p) {
+			++hist[p][(k >> (p * LOG_RADIX)) & RADIX_MASK];
+		}
+	}
+
+	Key* src_k = keys; Key* dst_k = key_tmp;
+	Value* src_v = values; Value* dst_v = value_tmp;
+	for(int p = 0; p < passes; ++p) {
+		const int shift = p * LOG_RADIX;
+		int64_t* offsets = hist[p];
+		if(offsets[(src_k[0] >> shift) & RADIX_MASK] == count) continue;
+		int64_t sum = 0;
+		for(int d = 0; d < RADIX; ++d) {
+			const int64_t c = offsets[d];
+			offsets[d] = sum;
+			sum += c;
+		}
+		for(int64_t i = 0; i < count; ++i) {
+			const int64_t pos = offsets[(src_k[i] >> shift) & RADIX_MASK]++;
+			dst_k[pos] = src_k[i];
+			dst_v[pos] = src_v[i];
+		}
+		std::swap(src_k, dst_k);
+		std::swap(src_v, dst_v);
+	}
+	if(src_k != keys) {
+		memcpy(keys, src_k, count * sizeof(Key));
+		memcpy(values, src_v, count * sizeof(Value));
+	}
+}
+
+// Parallel sort. Call this outside of the parallel region.
+// Each thread counts and scatters the same static chunk in every pass.
+template <typename Key, typename Value>
+void parallel_sort2(Key* keys, Value* values, int64_t count, int key_bits)
+{
+	Key* key_tmp = (Key*)cache_aligned_xmalloc(std::max<int64_t>(1, count) * sizeof(Key));
+	Value* value_tmp = (Value*)cache_aligned_xmalloc(std::max<int64_t>(1, count) * sizeof(Value));
+	if(count < PARALLEL_MIN_LENGTH) {
+		sort2(keys, values, count, key_bits, key_tmp, value_tmp);
+		free(key_tmp); free(value_tmp);
+		return;
+	}
+	const int passes = num_passes(key_bits);
+	const int max_threads = omp_get_max_threads();
+	int64_t* counts = (int64_t*)cache_aligned_xmalloc(max_threads * RADIX * sizeof(int64_t));
+	bool skip = false;
+
+#pragma omp parallel
+	{
+		const int tid = omp_get_thread_num();
+		const int num_threads = omp_get_num_threads();
+		const int64_t begin = count * tid / num_threads;
+		const int64_t end = count * (tid + 1) / num_threads;
+		int64_t* my_counts = counts + tid * RADIX;
+		Key* src_k = keys; Key* dst_k = key_tmp;
+		Value* src_v = values; Value* dst_v = value_tmp;
+
+		for(int p = 0; p < passes; ++p) {
+			const int shift = p * LOG_RADIX;
+			memset(my_counts, 0, RADIX * sizeof(int64_t));
+			for(int64_t i = begin; i < end; ++i) {
+				++my_counts[(src_k[i] >> shift) & RADIX_MASK];
+			}
+#pragma omp barrier
+#pragma omp master
+			{
+				// offsets in the order of (digit, thread)
+				int64_t sum = 0;
+				skip = false;
+				for(int d = 0; d < RADIX; ++d) {
+					int64_t digit_count = 0;
+					for(int t = 0; t < num_threads; ++t) {
+						const int64_t c = counts[t * RADIX + d];
+						counts[t * RADIX + d] = sum;
+						sum += c;
+						digit_count += c;
+					}
+					if(digit_count == count) skip = true;
+				}
+			}
+#pragma omp barrier
+			if(skip == false) {
+				for(int64_t i = begin; i < end; ++i) {
+					const int64_t pos = my_counts[(src_k[i] >> shift) & RADIX_MASK]++;
+					dst_k[pos] = src_k[i];
+					dst_v[pos] = src_v[i];
+				}
+				std::swap(src_k, dst_k);
+				std::swap(src_v, dst_v);
+			}
+#pragma omp barrier
+		}
+
+		if(src_k != keys) {
+#pragma omp for
+			for(int64_t i = 0; i < count; ++i) {
+				keys[i] = src_k[i];
+				values[i] = src_v[i];
+			}
+		}
+	}
+
+	free(counts);
+	free(key_tmp);
+	free(value_tmp);
+}
+
+// Computes the stable destination of each element for the bucket start offsets
+// which are already computed by the caller (one counting sort pass).
+// keys: [0, num_keys), offsets: num_keys + 1 elements
+template <typename Key, typename Index>
+void scatter_positions(const Key* keys, int64_t count, const Index* offsets, int num_keys, Index* positions)
+{
+	Index* insert_positions = (Index*)cache_aligned_xmalloc(std::max(1, num_keys) * sizeof(Index));
+	memcpy(insert_positions, offsets, num_keys * sizeof(Index));
+	for(int64_t i = 0; i < count; ++i) {
+		assert (keys[i] >= 0 && keys[i] < num_keys);
+		positions[i] = insert_positions[keys[i]]++;
+	}
+	free(insert_positions);
+}
+
+// Moves values[i] to values[positions[i]] through a buffer.
+template <typename T, typename Index>
+void apply_positions(T* values, int64_t count, const Index* positions)
+{
+	T* buffer = (T*)cache_aligned_xmalloc(std::max<int64_t>(1, count) * sizeof(T));
+	for(int64_t i = 0; i < count; ++i) {
+		buffer[positions[i]] = values[i];
+	}
+	memcpy(values, buffer, count * sizeof(T));
+	free(buffer);
+}
+
+// The same as apply_positions() for the elements of elt_size bytes.
+template <typename Index>
+void apply_positions(char* values, int64_t count, const Index* positions, size_t elt_size)
+{
+	char* buffer = (char*)cache_aligned_xmalloc(std::max<int64_t>(1, count) * elt_size);
+	for(int64_t i = 0; i < count; ++i) {
+		memcpy(buffer + positions[i] * elt_size, values + i * elt_size, elt_size);
+	}
+	memcpy(values, buffer, count * elt_size);
+	free(buffer);
+}
+
+} // namespace radix_sort {
+
+#endif /* RADIX_SORT_HPP_ */
@@ -0,0 +1,206 @@
+/*
+ * rma_comm.hpp
+ */
+
+#ifndef RMA_COMM_HPP_
+#define RMA_COMM_HPP_
+
+#include "utils.hpp"
+
+//-------------------------------------------------------------//
+// MPI-3 RMA (one-sided) Transport
+//-------------------------------------------------------------//
+// The portable version of the RDMA transport of the K computer (fjmpi_comm.hpp).
+// The data is written into the memory of the receiver by MPI_Put in the passive target
+// epoch (MPI_Win_lock_all) which is open while the window exists.
+// The sender completes the puts with MPI_Win_flush and then increments the notification
+// counter of the receiver with MPI_Accumulate. The receiver polls its counters.
+// The counters are never reset, so the receiver knows the expected values without
+// any additional synchronization.
+//
+// Runtime option:
+// RMA_TRANSPORT: 1 = use the one-sided puts for the alltoall of the top-down and
+//                    the bottom-up and for the bottom-up substep communication
+
+inline bool rma_transport_enabled() {
+	const char* rma_str = getenv("RMA_TRANSPORT");
+	return (rma_str != NULL && atoi(rma_str) != 0);
+}
+
+class RmaNotificationCounters {
+public:
+	// This is a collective operation on comm.
+	// The counters are indexed by the ranks of comm.
+	RmaNotificationCounters(MPI_Comm comm, int num_counters)
+		: one_(1)
+	{
+		MPI_Comm_rank(comm, &rank_);
+		int64_t* base;
+		MPI_Win_allocate(num_counters*sizeof(int64_t), sizeof(int64_t),
+				MPI_INFO_NULL, comm, &base, &win_);
+		for(int i = 0; i < num_counters; ++i) {
+			base[i] = 0;
+		}
+		MPI_Win_lock_all(MPI_MODE_NOCHECK, win_);
+		// nobody notifies before all the counters are initialized
+		MPI_Win_sync(win_);
+		MPI_Barrier(comm);
+	}
+
+	// This is a collective operation.
+	~RmaNotificationCounters() {
+		MPI_Win_unlock_all(win_);
+		MPI_Win_free(&win_);
+	}
+
+	// Increments the counter of the target.
+	// The operations issued before must be completed at the target.
+	void notify(int target, int counter) {
+		MPI_Accumulate(&one_, 1, MpiTypeOf<int64_t>::type, target, counter,
+				1, MpiTypeOf<int64_t>::type, MPI_SUM, win_);
+		MPI_Win_flush_local(target, win_);
+	}
+
+	int64_t read(int counter) {
+		int64_t value;
+		// the accumulate operations are atomic only with the other accumulate operations
+		MPI_Fetch_and_op(NULL, &value, MpiTypeOf<int64_t>::type, rank_, counter, MPI_NO_OP, win_);
+		MPI_Win_flush(rank_, win_);
+		return value;
+	}
+
+	void wait(int counter, int64_t expected) {
+		while(read(counter) < expected) ;
+	}
+
+private:
+	MPI_Win win_;
+	int rank_;
+	const int64_t one_;
+};
+
+// Translates the ranks of comm to the ranks of the window communicator.
+inline void rma_translate_ranks(MPI_Comm comm, MPI_Comm window_comm, int* window_ranks) {
+	int comm_size;
+	MPI_Comm_size(comm, &comm_size);
+	MPI_Group group, window_group;
+	MPI_Comm_group(comm, &group);
+	MPI_Comm_group(window_comm, &window_group);
+	std::vector<int> ranks(comm_size);
+	for(int i = 0; i < comm_size; ++i) {
+		ranks[i] = i;
+	}
+	MPI_Group_translate_ranks(group, comm_size, &ranks[0], window_group, window_ranks);
+	MPI_Group_free(&group);
+	MPI_Group_free(&window_group);
+}
+
+// The receive buffer of the alltoall.
+// The buffer is allocated by MPI_Win_allocate, which enables the shared memory and
+// the registered memory of the MPI library, and is shared by the alltoall of the
+// sub-communicators (RmaAlltoallChannel). The window is created on the communicator which
+// includes all the processes since Open MPI (4.1) names the shared memory segment of a window by
+// the context id, which is the same for the disjoint communicators split from the same communicator.
+class RmaAlltoallWindow {
+public:
+	// This is a collective operation on comm.
+	RmaAlltoallWindow(MPI_Comm comm, int64_t size, int num_channels)
+		: comm_(comm)
+		, counters_(comm, num_channels)
+	{
+		MPI_Win_allocate(size, 1, MPI_INFO_NULL, comm_, &buffer_, &win_);
+		MPI_Win_lock_all(MPI_MODE_NOCHECK, win_);
+	}
+
+	// This is a collective operation.
+	~RmaAlltoallWindow() {
+		MPI_Win_unlock_all(win_);
+		MPI_Win_free(&win_);
+	}
+
+	void* buffer() const { return buffer_; }
+
+private:
+	friend class RmaAlltoallChannel;
+	MPI_Comm comm_;
+	MPI_Win win_;
+	void* buffer_;
+	RmaNotificationCounters counters_;
+};
+
+// Alltoallv with MPI_Put into the buffer of RmaAlltoallWindow.
+// Each channel has its own notification counter.
+class RmaAlltoallChannel {
+public:
+	RmaAlltoallChannel(RmaAlltoallWindow* window, int channel, MPI_Comm comm)
+		: window_(window)
+		, channel_(channel)
+		, comm_(comm)
+		, expected_(0)
+	{
+		MPI_Comm_size(comm_, &comm_size_);
+		MPI_Comm_rank(comm_, &rank_);
+		window_ranks_ = static_cast<int*>(cache_aligned_xmalloc(comm_size_*sizeof(int)*2));
+		target_disp_ = window_ranks_ + comm_size_;
+		rma_translate_ranks(comm_, window_->comm_, window_ranks_);
+	}
+
+	~RmaAlltoallChannel() {
+		free(window_ranks_); window_ranks_ = NULL;
+	}
+
+	void* recv_buffer() const { return window_->buffer(); }
+
+	// The counts must be exchanged before and the data of the receive buffer is
+	// arranged in the rank order like MPI_Alltoallv.
+	void alltoallv(void* sendbuf, const int* send_counts, const int* send_offsets,
+			const int* recv_counts, const int* recv_offsets, MPI_Datatype type)
+	{
+		uint8_t* recv_buffer = static_cast<uint8_t*>(window_->buffer());
+		int type_size;
+		MPI_Type_size(type, &type_size);
+		// the offsets of my data in the receive buffers of the targets
+		MPI_Exscan(send_counts, target_disp_, comm_size_, MPI_INT, MPI_SUM, comm_);
+		if(rank_ == 0) {
+			memset(target_disp_, 0x00, comm_size_*sizeof(int));
+		}
+		for(int i = 0; i < comm_size_; ++i) {
+			// start from the next rank to distribute the traffic
+			const int target = (rank_ + 1 + i) % comm_size_;
+			const int count = send_counts[target];
+			if(count == 0) continue;
+			void* src = (uint8_t*)sendbuf + int64_t(send_offsets[target]) * type_size;
+			if(target == rank_) {
+				memcpy(recv_buffer + int64_t(recv_offsets[rank_]) * type_size,
+						src, int64_t(count) * type_size);
+			}
+			else {
+				MPI_Put(src, count, type, window_ranks_[target],
+						MPI_Aint(target_disp_[target]) * type_size, count, type, window_->win_);
+			}
+		}
+		MPI_Win_flush_all(window_->win_);
+		for(int i = 0; i < comm_size_; ++i) {
+			if(i != rank_ && send_counts[i] > 0) {
+				window_->counters_.notify(window_ranks_[i], channel_);
+			}
+			if(i != rank_ && recv_counts[i] > 0) {
+				++expected_;
+			}
+		}
+		window_->counters_.wait(channel_, expected_);
+		MPI_Win_sync(window_->win_);
+	}
+
+private:
+	RmaAlltoallWindow* window_;
+	int channel_;
+	MPI_Comm comm_;
+	int comm_size_;
+	int rank_;
+	int* window_ranks_;
+	int* target_disp_;
+	int64_t expected_;
+};
+
+#endif /* RMA_COMM_HPP_ */
@@ -0,0 +1,157 @@
+/*
+ * runtime_config.hpp
+ */
+
+#ifndef RUNTIME_CONFIG_HPP_
+#define RUNTIME_CONFIG_HPP_
+
+#include "parameters.h"
+#include "utils.hpp"
+
+//-------------------------------------------------------------//
+// Runtime Configuration
+//-------------------------------------------------------------//
+// Tuning parameters that can be changed without rebuilding. The defaults are the values in parameters.h.
+// Rank 0 reads the configuration file (--config=<file>) and the options (--<name>=<value>)
+// and broadcasts the result. The options have priority over the file.
+// In the file, each line is "<name> = <value>" and '#' begins a comment.
+//
+// The kernels that depend on these parameters are instantiated for each value and
+// the variant is selected once per call (e.g., top_down_parallel_section<TOP_DOWN_SEND_LB>).
+
+struct RuntimeConfig {
+	int comm_buffer_size; // COMM_BUFFER_SIZE
+	int top_down_pending_width; // TOP_DOWN_PENDING_WIDTH
+	int top_down_send_lb; // TOP_DOWN_SEND_LB
+	int bottom_up_overlap_pfs; // BOTTOM_UP_OVERLAP_PFS
+	double denom_topdown_to_bottomup; // DENOM_TOPDOWN_TO_BOTTOMUP
+	double denom_bottomup_to_topdown; // DEMON_BOTTOMUP_TO_TOPDOWN
+	double denom_bitmap_to_list; // DENOM_BITMAP_TO_LIST
+
+	RuntimeConfig() { set_default(); }
+
+	void set_default() {
+		comm_buffer_size = PRM::COMM_BUFFER_SIZE;
+		top_down_pending_width = PRM::TOP_DOWN_PENDING_WIDTH;
+		top_down_send_lb = TOP_DOWN_SEND_LB;
+		bottom_up_overlap_pfs = BOTTOM_UP_OVERLAP_PFS;
+		denom_topdown_to_bottomup = DENOM_TOPDOWN_TO_BOTTOMUP;
+		denom_bottomup_to_topdown = DEMON_BOTTOMUP_TO_TOPDOWN;
+		denom_bitmap_to_list = DENOM_BITMAP_TO_LIST;
+	}
+
+	// returns false if the name is unknown or the value is not valid
+	bool set(const char* name, const char* value) {
+#define SET_PARAM(p, cond) if(strcmp(name, #p) == 0) { \
+		if(parse(value, &p) == false) return false; \
+		return (cond); }
+		SET_PARAM(comm_buffer_size, comm_buffer_size >= PRM::PACKET_LENGTH &&
+				comm_buffer_size % int(sizeof(int64_t)) == 0);
+		SET_PARAM(top_down_pending_width, top_down_pending_width >= 10);
+		SET_PARAM(top_down_send_lb, top_down_send_lb >= 0 && top_down_send_lb <= (COMPRESSED_EDGE_ARRAY ? 0 : 2));
+		SET_PARAM(bottom_up_overlap_pfs, bottom_up_overlap_pfs == 0 || bottom_up_overlap_pfs == 1);
+		SET_PARAM(denom_topdown_to_bottomup, denom_topdown_to_bottomup > 0);
+		SET_PARAM(denom_bottomup_to_topdown, denom_bottomup_to_topdown > 0);
+		SET_PARAM(denom_bitmap_to_list, denom_bitmap_to_list > 0);
+#undef SET_PARAM
+		return false;
+	}
+
+	// This is a collective operation. The arguments which do not begin with "--" are ignored.
+	void load(int argc, char** argv) {
+		int ok = 1;
+		if(mpi.isMaster()) {
+			for(int i = 1; i < argc && ok; ++i) {
+				if(strncmp(argv[i], "--config=", 9) == 0) ok = load_file(argv[i] + 9);
+			}
+			for(int i = 1; i < argc && ok; ++i) {
+				if(strncmp(argv[i], "--", 2) != 0 || strncmp(argv[i], "--config=", 9) == 0) continue;
+				ok = set_option(argv[i] + 2);
+			}
+		}
+		MPI_Bcast(&ok, 1, MPI_INT, 0, mpi.comm_2d);
+		if(!ok) throw_exception("Invalid runtime configuration");
+		MPI_Bcast(this, sizeof(*this), MPI_BYTE, 0, mpi.comm_2d);
+	}
+
+	void write(FILE* fp) const {
+		fprintf(fp, "comm_buffer_size = %d\n", comm_buffer_size);
+		fprintf(fp, "top_down_pending_width = %d\n", top_down_pending_width);
+		fprintf(fp, "top_down_send_lb = %d\n", top_down_send_lb);
+		fprintf(fp, "bottom_up_overlap_pfs = %d\n", bottom_up_overlap_pfs);
+		fprintf(fp, "denom_topdown_to_bottomup = %f\n", denom_topdown_to_bottomup);
+		fprintf(fp, "denom_bottomup_to_topdown = %f\n", denom_bottomup_to_topdown);
+		fprintf(fp, "denom_bitmap_to_list = %f\n", denom_bitmap_to_list);
+	}
+
+	void print() const {
+		print_with_prefix("comm_buffer_size = %d.", comm_buffer_size);
+		print_with_prefix("top_down_pending_width = %d.", top_down_pending_width);
+		print_with_prefix("top_down_send_lb = %d.", top_down_send_lb);
+		print_with_prefix("bottom_up_overlap_pfs = %d.", bottom_up_overlap_pfs);
+		print_with_prefix("denom_topdown_to_bottomup = %f.", denom_topdown_to_bottomup);
+		print_with_prefix("denom_bottomup_to_topdown = %f.", denom_bottomup_to_topdown);
+		print_with_prefix("denom_bitmap_to_list = %f.", denom_bitmap_to_list);
+	}
+
+private:
+	static bool parse(const char* str, int* value) {
+		char* end;
+		long v = strtol(str, &end, 10);
+		if(end == str || *end != '\0') return false;
+		*value = (int)v;
+		return true;
+	}
+
+	static bool parse(const char* str, double* value) {
+		char* end;
+		double v = strtod(str, &end);
+		if(end == str || *end != '\0') return false;
+		*value = v;
+		return true;
+	}
+
+	// "<name>=<value>"
+	bool set_option(const char* option) {
+		char name[128];
+		const char* eq = strchr(option, '=');
+		if(eq == NULL || eq - option >= (int)sizeof(name)) {
+			print_with_prefix("Invalid option: --%s", option);
+			return false;
+		}
+		memcpy(name, option, eq - option);
+		name[eq - option] = '\0';
+		if(set(name, eq + 1) == false) {
+			print_with_prefix("Invalid option: --%s", option);
+			return false;
+		}
+		return true;
+	}
+
+	bool load_file(const char* path) {
+		FILE* fp = fopen(path, "r");
+		if(fp == NULL) {
+			print_with_prefix("Cannot open the configuration file: %s", path);
+			return false;
+		}
+		bool ok = true;
+		char line[256];
+		for(int line_no = 1; fgets(line, sizeof(line), fp) != NULL; ++line_no) {
+			char* comment = strchr(line, '#');
+			if(comment != NULL) *comment = '\0';
+			char name[128], value[128];
+			int n = sscanf(line, " %127[^= \t\n] = %127s", name, value);
+			if(n <= 0) continue; // empty line
+			if(n != 2 || set(name, value) == false) {
+				print_with_prefix("%s:%d: Invalid line", path, line_no);
+				ok = false;
+			}
+		}
+		fclose(fp);
+		return ok;
+	}
+};
+
+RuntimeConfig g_config;
+
+#endif /* RUNTIME_CONFIG_HPP_ */
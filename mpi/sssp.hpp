@@ -0,0 +1,82 @@
+/*
+ * sssp.hpp
+ */
+
+#ifndef SSSP_HPP_
+#define SSSP_HPP_
+
+#include <float.h>
+
+#include "utils.hpp"
+
+//-------------------------------------------------------------//
+// SSSP common definitions
+//-------------------------------------------------------------//
+// The weight of an edge is a hash of the unordered pair of its ORIGINAL end points,
+// so that the kernel (BfsBase::run_sssp) and the validator (validate_sssp_result)
+// compute the same weight from the CSR and from the edge list without storing weights
+// in the edge list or in the graph construction.
+// The weights are in (0, 1] like the uniform weights of the Graph500 SSSP kernel, but they are
+// not the weights of the generator (WeightedEdge): the weighted construction path of
+// GraphConstructor2DCSR is out of date, so the edges are generated without weights.
+// The distances are therefore not comparable with the Graph500 SSSP results.
+// Since no weight is zero, the distances strictly decrease along the predecessors.
+
+// The distance of the vertices which are not reached (in the kernel).
+#define SSSP_UNREACHED FLT_MAX
+
+inline float sssp_edge_weight(int64_t v0, int64_t v1) {
+	uint64_t lo = std::min(v0, v1), hi = std::max(v0, v1);
+	// splitmix64 finalizer
+	uint64_t z = lo * UINT64_C(0x9E3779B97F4A7C15) + hi + UINT64_C(0x632BE59BD9B4E019);
+	z = (z ^ (z >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+	z = (z ^ (z >> 27)) * UINT64_C(0x94D049BB133111EB);
+	z = z ^ (z >> 31);
+	// 24 bits are exactly represented by float
+	return float((z >> 40) + 1) * (1.0f / float(1 << 24));
+}
+
+// An element of the relaxation sent to the owner of the target vertex.
+struct SsspUpdate;
+template <> struct MpiTypeOf<SsspUpdate> { static MPI_Datatype type; };
+MPI_Datatype MpiTypeOf<SsspUpdate>::type = MPI_DATATYPE_NULL;
+
+struct SsspUpdate {
+	int64_t parent; // original vertex id of the source
+	uint32_t local; // reordered local vertex id of the target
+	float dist; // tentative distance of the target
+
+	static void initialize()
+	{
+		MPI_Type_contiguous(2, MPI_INT64_T, &MpiTypeOf<SsspUpdate>::type);
+		MPI_Type_commit(&MpiTypeOf<SsspUpdate>::type);
+	}
+
+	static void uninitialize()
+	{
+		MPI_Type_free(&MpiTypeOf<SsspUpdate>::type);
+	}
+};
+
+// An element of the frontier gathered along the processor row.
+struct SsspVertex;
+template <> struct MpiTypeOf<SsspVertex> { static MPI_Datatype type; };
+MPI_Datatype MpiTypeOf<SsspVertex>::type = MPI_DATATYPE_NULL;
+
+struct SsspVertex {
+	uint32_t local; // reordered local vertex id
+	float dist;
+
+	static void initialize()
+	{
+		MPI_Type_contiguous(1, MPI_INT64_T, &MpiTypeOf<SsspVertex>::type);
+		MPI_Type_commit(&MpiTypeOf<SsspVertex>::type);
+	}
+
+	static void uninitialize()
+	{
+		MPI_Type_free(&MpiTypeOf<SsspVertex>::type);
+	}
+};
+
+#endif /* SSSP_HPP_ */
@@ -0,0 +1,226 @@
+/*
+ * timeline_trace.hpp
+ */
+
+#ifndef TIMELINE_TRACE_HPP_
+#define TIMELINE_TRACE_HPP_
+
+#include <mpi.h>
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <limits.h>
+
+#include <algorithm>
+
+//-------------------------------------------------------------//
+// Timeline Trace
+//-------------------------------------------------------------//
+// Records the TRACER (compute), CTRACER (communication) scopes and the spans submitted by
+// profiling::TimeKeeper (profile) when TIMELINE_TRACE is enabled in parameters.h.
+// Each thread has its own ring buffer, which is written only by the thread, so recording
+// an event requires neither locks nor atomic operations. The buffers are registered to the
+// global list with compare-and-swap. When the buffer is full, the oldest events are overwritten.
+// The events are written in the Chrome trace event format (complete events) at the end of the
+// program, which can be loaded by chrome://tracing or Perfetto UI.
+// The time stamps are MPI_Wtime aligned to the barrier in initialize() so that the
+// timelines of the processes can be compared.
+// The trace state has internal linkage. Only the translation unit which calls initialize()
+// and finalize() (main.cc through utils.hpp) records events.
+//
+// Runtime options:
+// TIMELINE_TRACE: path prefix of the trace files (<prefix>.<rank>.json).
+//                 The events are not recorded if not set.
+// TIMELINE_TRACE_EVENTS: capacity of the ring buffer of each thread (default: 262144 events)
+
+namespace timeline {
+
+enum CATEGORY {
+	COMPUTE = 0,
+	COMM = 1,
+	PROFILE = 2,
+	NUM_CATEGORIES = 3,
+};
+
+struct Event {
+	const char* name;
+	double begin;
+	double end;
+	int category;
+};
+
+struct ThreadBuffer {
+	Event* events;
+	int64_t mask; // capacity - 1
+	int64_t count;
+	int tid;
+	int omp_tid;
+	const char* name;
+	ThreadBuffer* next;
+};
+
+static bool g_enabled = false;
+static const char* g_prefix = NULL;
+static int64_t g_capacity = 0;
+static double g_base_time = 0;
+static ThreadBuffer* volatile g_thread_buffers = NULL;
+static volatile int g_next_tid = 0;
+static __thread ThreadBuffer* t_buffer = NULL;
+
+inline ThreadBuffer* register_thread() {
+	ThreadBuffer* buf = new ThreadBuffer();
+	buf->events = static_cast<Event*>(malloc(g_capacity * sizeof(Event)));
+	buf->mask = g_capacity - 1;
+	buf->count = 0;
+	buf->tid = __sync_fetch_and_add(&g_next_tid, 1);
+	buf->omp_tid = omp_in_parallel() ? omp_get_thread_num() : -1;
+	buf->name = NULL;
+	ThreadBuffer* head;
+	do {
+		head = g_thread_buffers;
+		buf->next = head;
+	} while(!__sync_bool_compare_and_swap(&g_thread_buffers, head, buf));
+	t_buffer = buf;
+	return buf;
+}
+
+inline void record(const char* name, double begin, double end, int category) {
+	ThreadBuffer* buf = t_buffer;
+	if(buf == NULL) {
+		buf = register_thread();
+	}
+	Event& e = buf->events[buf->count & buf->mask];
+	e.name = name;
+	e.begin = begin;
+	e.end = end;
+	e.category = category;
+	++buf->count;
+}
+
+// Records the span which ends now.
+inline void record_span(const char* name, double span, int category) {
+	if(g_enabled) {
+		double end = MPI_Wtime();
+		record(name, end - span, end, category);
+	}
+}
+
+// Names the calling thread in the trace (e.g., the communication thread).
+inline void set_thread_name(const char* name) {
+	if(g_enabled) {
+		ThreadBuffer* buf = t_buffer;
+		if(buf == NULL) {
+			buf = register_thread();
+		}
+		buf->name = name;
+	}
+}
+
+struct ScopedRegion {
+	const char* name_;
+	double begin_;
+	int category_;
+	ScopedRegion(const char* name, int category) {
+		name_ = g_enabled ? name : NULL;
+		if(name_ != NULL) {
+			begin_ = MPI_Wtime();
+			category_ = category;
+		}
+	}
+	~ScopedRegion() {
+		if(name_ != NULL) {
+			record(name_, begin_, MPI_Wtime(), category_);
+		}
+	}
+};
+
+// This is a collective operation on MPI_COMM_WORLD.
+inline void initialize() {
+	const char* prefix = getenv("TIMELINE_TRACE");
+	g_prefix = (prefix != NULL && prefix[0] != '\0') ? prefix : NULL;
+	const char* events_str = getenv("TIMELINE_TRACE_EVENTS");
+	int64_t capacity = (events_str != NULL) ? atol(events_str) : 0;
+	if(capacity <= 0) {
+		capacity = int64_t(1) << 18;
+	}
+	g_capacity = 1;
+	while(g_capacity < capacity) g_capacity *= 2;
+
+	MPI_Barrier(MPI_COMM_WORLD);
+	g_base_time = MPI_Wtime();
+	int* wtime_is_global = NULL;
+	int flag = 0;
+	MPI_Comm_get_attr(MPI_COMM_WORLD, MPI_WTIME_IS_GLOBAL, &wtime_is_global, &flag);
+	if(flag && *wtime_is_global) {
+		MPI_Bcast(&g_base_time, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+	}
+	g_enabled = (g_prefix != NULL);
+	set_thread_name("main");
+}
+
+inline void write_metadata(FILE* fp, const char* name, int rank, int tid, const char* value) {
+	fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+			name, rank, tid, value);
+}
+
+// Writes the events and releases the buffers. The other threads must not record events.
+inline void finalize(int rank) {
+	if(g_enabled == false) {
+		return ;
+	}
+	g_enabled = false;
+	static const char* const category_names[NUM_CATEGORIES] = { "compute", "comm", "profile" };
+	char filename[PATH_MAX];
+	snprintf(filename, sizeof(filename), "%s.%d.json", g_prefix, rank);
+	FILE* fp = fopen(filename, "w");
+	if(fp == NULL) {
+		fprintf(IMD_OUT, "[r:%d] Timeline trace: Cannot write %s\n", rank, filename);
+	}
+	int64_t num_dropped = 0;
+	if(fp != NULL) {
+		fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+		// the metadata of the process is the first element and the others are preceded by commas
+		fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"rank %d\"}}",
+				rank, rank);
+	}
+	for(ThreadBuffer* buf = g_thread_buffers; buf != NULL; ) {
+		if(fp != NULL) {
+			char thread_name[64];
+			if(buf->name != NULL) {
+				snprintf(thread_name, sizeof(thread_name), "%s", buf->name);
+			}
+			else if(buf->omp_tid >= 0) {
+				snprintf(thread_name, sizeof(thread_name), "thread %d (omp %d)", buf->tid, buf->omp_tid);
+			}
+			else {
+				snprintf(thread_name, sizeof(thread_name), "thread %d", buf->tid);
+			}
+			write_metadata(fp, "thread_name", rank, buf->tid, thread_name);
+			int64_t start = std::max<int64_t>(0, buf->count - (buf->mask + 1));
+			num_dropped += start;
+			for(int64_t i = start; i < buf->count; ++i) {
+				const Event& e = buf->events[i & buf->mask];
+				fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,"
+						"\"ts\":%.3f,\"dur\":%.3f}", e.name, category_names[e.category], rank, buf->tid,
+						(e.begin - g_base_time) * 1000000.0, (e.end - e.begin) * 1000000.0);
+			}
+		}
+		ThreadBuffer* next = buf->next;
+		free(buf->events);
+		delete buf;
+		buf = next;
+	}
+	g_thread_buffers = NULL;
+	if(fp != NULL) {
+		fprintf(fp, "\n],\"otherData\":{\"rank\":%d,\"clock\":\"MPI_Wtime\",\"dropped_events\":%" PRId64 "}}\n",
+				rank, num_dropped);
+		fclose(fp);
+	}
+}
+
+} // namespace timeline {
+
+#endif /* TIMELINE_TRACE_HPP_ */
@@ -11,6 +11,8 @@
 #include <stdint.h>
 #include <stdarg.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
 #include <malloc.h>
 
 // for affinity setting //
@@ -32,6 +34,7 @@
 #include <sys/types.h>
 #include <sys/time.h>
 #include <sys/shm.h>
+#include <sys/mman.h>
 
 #include <algorithm>
 #include <vector>
@@ -79,6 +82,12 @@ struct ScopedRegion {
 #define USER_END(s) do { int line = __LINE__; int flag = 103;\
 		user_defined_proc(&flag, __FILE__, &line, NULL); } while (false)
 #define TRACER(s) ScopedRegion my_trace_obj(__FILE__, __LINE__)
+#elif TIMELINE_TRACE
+#include "timeline_trace.hpp"
+#define USER_START(s)
+#define USER_END(s)
+#define TRACER(s) timeline::ScopedRegion my_trace_obj(#s, timeline::COMPUTE)
+#define CTRACER(s) timeline::ScopedRegion my_ctrace_obj(#s, timeline::COMM)
 
 #else // #if VTRACE
 #define USER_START(s)
@@ -94,6 +103,13 @@ struct ScopedRegion {
 #define VERVOSE(s)
 #endif
 
+// edge counters are required also by the adaptive direction switch
+#if VERVOSE_MODE || ADAPTIVE_DIRECTION_SWITCH
+#define EDGE_COUNT(s) s
+#else
+#define EDGE_COUNT(s)
+#endif
+
 #if PROFILING_MODE
 #define PROF(s) s
 #else
@@ -316,14 +332,122 @@ void x_free_check(void* ptr) {
 		fprintf(IMD_OUT, "[MEM] %f MB (- %f MB)\n", (double)g_memory_usage / (1024*1024), (double)nbytes / (1024*1024));
 	}
 }
+////
+
+//-------------------------------------------------------------//
+// Huge pages
+//-------------------------------------------------------------//
+
+// HUGE_PAGES=0: normal pages
+// HUGE_PAGES=thp (default): madvise(MADV_HUGEPAGE) on the large arrays
+// HUGE_PAGES=hugetlb, hugetlb1g: the shared memory is allocated from hugetlbfs
+//   with 2MB or 1GB pages. The other arrays use THP.
+// When the huge pages are not available, the normal pages are used.
+enum HUGE_PAGE_MODE {
+	HUGE_PAGE_NONE,
+	HUGE_PAGE_THP,
+	HUGE_PAGE_HUGETLB,
+	HUGE_PAGE_HUGETLB_1G,
+};
+
+#ifndef SHM_HUGE_SHIFT
+#define SHM_HUGE_SHIFT 26
+#endif
+
+int g_huge_page_mode = -1; // not initialized
+
+int get_huge_page_mode() {
+	if(g_huge_page_mode == -1) {
+		int mode = HUGE_PAGE_NONE;
+#if HUGE_PAGE_ALLOC
+		const char* str = getenv("HUGE_PAGES");
+		if(str == NULL || strcmp(str, "thp") == 0 || strcmp(str, "1") == 0) {
+			mode = HUGE_PAGE_THP;
+		}
+		else if(strcmp(str, "hugetlb") == 0) {
+			mode = HUGE_PAGE_HUGETLB;
+		}
+		else if(strcmp(str, "hugetlb1g") == 0) {
+			mode = HUGE_PAGE_HUGETLB_1G;
+		}
+#endif
+		// this may be called from multiple threads but they compute the same value
+		g_huge_page_mode = mode;
+	}
+	return g_huge_page_mode;
+}
+
+const char* get_huge_page_mode_name() {
+	switch(get_huge_page_mode()) {
+	case HUGE_PAGE_THP: return "THP (madvise)";
+	case HUGE_PAGE_HUGETLB: return "hugetlbfs 2MB for shared memory, THP for the others";
+	case HUGE_PAGE_HUGETLB_1G: return "hugetlbfs 1GB for shared memory, THP for the others";
+	}
+	return "disabled";
+}
+
+bool use_huge_pages(size_t nbytes) {
+	return nbytes >= HUGE_PAGE_MIN_SIZE && get_huge_page_mode() != HUGE_PAGE_NONE;
+}
+
+// Requests THP for the huge page aligned part of [ptr, ptr + nbytes).
+// The failure is ignored: the pages remain normal pages.
+void advise_huge_pages(void* ptr, size_t nbytes) {
+#ifdef MADV_HUGEPAGE
+	if(ptr == NULL || use_huge_pages(nbytes) == false) return ;
+	const uintptr_t begin = (reinterpret_cast<uintptr_t>(ptr) + HUGE_PAGE_SIZE - 1) & ~uintptr_t(HUGE_PAGE_SIZE - 1);
+	const uintptr_t end = (reinterpret_cast<uintptr_t>(ptr) + nbytes) & ~uintptr_t(HUGE_PAGE_SIZE - 1);
+	if(end > begin) {
+		madvise(reinterpret_cast<void*>(begin), end - begin, MADV_HUGEPAGE);
+	}
+#endif
+}
+
+// The huge page backed part of the memory of this process from /proc/self/smaps_rollup.
+// Returns false if it is not available.
+bool get_huge_page_usage(int64_t* resident, int64_t* huge) {
+	FILE* fp = fopen("/proc/self/smaps_rollup", "r");
+	if(fp == NULL) return false;
+	char line[256];
+	int64_t rss = 0, anon_huge = 0, shmem_huge = 0, hugetlb = 0;
+	while(fgets(line, sizeof(line), fp) != NULL) {
+		long long kb = 0;
+		if(sscanf(line, "Rss: %lld", &kb) == 1) rss = kb;
+		else if(sscanf(line, "AnonHugePages: %lld", &kb) == 1) anon_huge = kb;
+		else if(sscanf(line, "ShmemPmdMapped: %lld", &kb) == 1) shmem_huge = kb;
+		else if(sscanf(line, "Shared_Hugetlb: %lld", &kb) == 1) hugetlb += kb;
+		else if(sscanf(line, "Private_Hugetlb: %lld", &kb) == 1) hugetlb += kb;
+	}
+	fclose(fp);
+	// Rss does not include the hugetlbfs pages
+	*resident = (rss + hugetlb) * 1024;
+	*huge = (anon_huge + shmem_huge + hugetlb) * 1024;
+	return true;
+}
+
 void print_max_memory_usage() {
 	int64_t g_max = 0;
 	MPI_Reduce(&g_memory_usage, &g_max, 1, MpiTypeOf<int64_t>::type, MPI_MAX, 0, mpi.comm_2d);
 	if(mpi.isMaster()) {
 		fprintf(IMD_OUT, "[MEM-MAX] %f MB\n", (double)g_max / (1024*1024));
 	}
+	// huge page coverage: [0] resident, [1] backed by huge pages
+	int64_t usage[2] = { 0, 0 };
+	int available = get_huge_page_usage(&usage[0], &usage[1]), all_available;
+	int64_t sum_usage[2];
+	MPI_Reduce(usage, sum_usage, 2, MpiTypeOf<int64_t>::type, MPI_SUM, 0, mpi.comm_2d);
+	MPI_Reduce(&available, &all_available, 1, MPI_INT, MPI_LAND, 0, mpi.comm_2d);
+	if(mpi.isMaster()) {
+		if(all_available) {
+			fprintf(IMD_OUT, "[MEM-HUGE] %s: %f MB / %f MB resident = %f %%\n",
+					get_huge_page_mode_name(), (double)sum_usage[1] / (1024*1024), (double)sum_usage[0] / (1024*1024),
+					(double)sum_usage[1] / std::max<int64_t>(1, sum_usage[0]) * 100.0);
+		}
+		else {
+			fprintf(IMD_OUT, "[MEM-HUGE] %s: the coverage is not available\n", get_huge_page_mode_name());
+		}
+	}
 }
-////
 
 void* xMPI_Alloc_mem(size_t nbytes) {
   void* p = NULL;
@@ -331,6 +455,8 @@ void* xMPI_Alloc_mem(size_t nbytes) {
   if (nbytes != 0 && !p) {
 	  throw_exception("MPI_Alloc_mem failed for size%zu (%"PRId64") byte(s)", nbytes, (int64_t)nbytes);
   }
+  // the alignment is chosen by MPI: only the aligned part can be backed by huge pages
+  advise_huge_pages(p, nbytes);
 #if VERVOSE_MODE
   if(mpi.isMaster() && nbytes > 1024*1024) {
     fprintf(IMD_OUT, "[MEM-MPI] + %f MB\n", (double)nbytes / (1024*1024));
@@ -339,40 +465,34 @@ void* xMPI_Alloc_mem(size_t nbytes) {
   return p;
 }
 
-void* cache_aligned_xcalloc(const size_t size) {
-    void* p = NULL;
-	if(posix_memalign(&p, CACHE_LINE, size)){
+// The large arrays are aligned to the huge page size.
+void* aligned_xmalloc(const size_t size, const size_t alignment) {
+	void* p = NULL;
+	const bool huge = use_huge_pages(size);
+	if(posix_memalign(&p, huge ? std::max<size_t>(alignment, HUGE_PAGE_SIZE) : alignment, size)){
 		throw_exception("Out of memory trying to allocate %zu (%"PRId64") byte(s)", size, (int64_t)size);
 	}
+	if(huge) advise_huge_pages(p, size);
 	VERVOSE(x_allocate_check(p));
+	return p;
+}
+
+void* cache_aligned_xcalloc(const size_t size) {
+	void* p = aligned_xmalloc(size, CACHE_LINE);
 	memset(p, 0, size);
 	return p;
 }
 void* cache_aligned_xmalloc(const size_t size) {
-	void* p = NULL;
-	if(posix_memalign(&p, CACHE_LINE, size)){
-		throw_exception("Out of memory trying to allocate %zu (%"PRId64") byte(s)", size, (int64_t)size);
-	}
-	VERVOSE(x_allocate_check(p));
-	return p;
+	return aligned_xmalloc(size, CACHE_LINE);
 }
 
 void* page_aligned_xcalloc(const size_t size) {
-	void* p = NULL;
-	if(posix_memalign(&p, PAGE_SIZE, size)){
-		throw_exception("Out of memory trying to allocate %zu (%"PRId64") byte(s)", size, (int64_t)size);
-	}
-	VERVOSE(x_allocate_check(p));
+	void* p = aligned_xmalloc(size, PAGE_SIZE);
 	memset(p, 0, size);
 	return p;
 }
 void* page_aligned_xmalloc(const size_t size) {
-	void* p = NULL;
-	if(posix_memalign(&p, PAGE_SIZE, size)){
-		throw_exception("Out of memory trying to allocate %zu (%"PRId64") byte(s)", size, (int64_t)size);
-	}
-	VERVOSE(x_allocate_check(p));
-	return p;
+	return aligned_xmalloc(size, PAGE_SIZE);
 }
 
 #if VERVOSE_MODE
@@ -393,13 +513,30 @@ void* shared_malloc(size_t nbytes) {
 	int shmid = -1;
 	void* addr = NULL;
 
+	int hugetlb = 0;
 	if(rank == 0) {
 		timeval tv; gettimeofday(&tv, NULL);
 		shm_key = tv.tv_usec;
+		int shm_flags = IPC_CREAT | IPC_EXCL | 0600;
+		size_t shm_size = nbytes;
+		const int mode = get_huge_page_mode();
+		if((mode == HUGE_PAGE_HUGETLB || mode == HUGE_PAGE_HUGETLB_1G) && use_huge_pages(nbytes)) {
+			const int log_page_size = (mode == HUGE_PAGE_HUGETLB_1G) ? 30 : get_msb_index(HUGE_PAGE_SIZE);
+			shm_flags |= SHM_HUGETLB | (log_page_size << SHM_HUGE_SHIFT);
+			shm_size = ((nbytes + (size_t(1) << log_page_size) - 1) >> log_page_size) << log_page_size;
+			hugetlb = 1;
+		}
 		for(int i = 0; i < 1000; ++i) {
-			shmid = shmget(++shm_key, nbytes,
-					IPC_CREAT | IPC_EXCL | 0600);
+			shmid = shmget(++shm_key, shm_size, shm_flags);
 			if(shmid != -1) break;
+			if(hugetlb && errno != EEXIST) {
+				// no huge pages in the pool: fall back to the normal pages
+				shm_flags &= ~(SHM_HUGETLB | (0x3f << SHM_HUGE_SHIFT));
+				shm_size = nbytes;
+				hugetlb = 0;
+				--shm_key;
+				continue;
+			}
 #ifndef NDEBUG
 			perror("shmget try");
 #endif
@@ -416,6 +553,7 @@ void* shared_malloc(size_t nbytes) {
 	}
 
 	MPI_Bcast(&shm_key, 1, MpiTypeOf<key_t>::type, 0, comm);
+	MPI_Bcast(&hugetlb, 1, MPI_INT, 0, comm);
 
 	if(rank != 0) {
 		shmid = shmget(shm_key, 0, 0);
@@ -431,6 +569,11 @@ void* shared_malloc(size_t nbytes) {
 		}
 	}
 
+	if(hugetlb == 0) {
+		// effective only when shmem THP is "advise" (/sys/kernel/mm/transparent_hugepage/shmem_enabled)
+		advise_huge_pages(addr, nbytes);
+	}
+
 	MPI_Barrier(comm);
 
 	if(rank == 0) {
@@ -1626,6 +1769,10 @@ void setup_globals(int argc, char** argv, int SCALE, int edgefactor)
 #if BACKTRACE_ON_SIGNAL
 	backtrace::start_thread();
 #endif
+#if TIMELINE_TRACE
+	timeline::initialize();
+	if(mpi.isMaster() && timeline::g_enabled) print_with_prefix("Timeline trace is enabled.");
+#endif
 
 #if OPENMP_SUB_THREAD
 	omp_set_nested(1);
@@ -1689,6 +1836,9 @@ void setup_globals(int argc, char** argv, int SCALE, int edgefactor)
 			print_with_prefix("Error: PAGE_SIZE(%d) is not correct.", PAGE_SIZE);
 		}
 	}
+#if HUGE_PAGE_ALLOC
+	if(mpi.isMaster()) print_with_prefix("Huge pages: %s", get_huge_page_mode_name());
+#endif
 
 	// set affinity
 	numa::initialize_num_threads();
@@ -1730,6 +1880,9 @@ void cleanup_globals()
 #if BACKTRACE_ON_SIGNAL
 	backtrace::thread_join();
 #endif
+#if TIMELINE_TRACE
+	timeline::finalize(mpi.rank);
+#endif
 #if ENABLE_FJMPI_RDMA
 	FJMPI_Rdma_finalize();
 #endif
@@ -2151,6 +2304,23 @@ public:
 	}
 
 	void alltoallv(void* sendbuf, void* recvbuf, MPI_Datatype type, int recvbufsize)
+	{
+		exchange_counts(recvbufsize);
+		MPI_Alltoallv(sendbuf, send_counts_, send_offsets_, type,
+				recvbuf, recv_counts_, recv_offsets_, type, comm_);
+	}
+
+	// The data is sent by the transport (e.g., RmaAlltoallWindow) instead of MPI_Alltoallv.
+	template <typename Transport>
+	void alltoallv(void* sendbuf, Transport* transport, MPI_Datatype type, int recvbufsize)
+	{
+		exchange_counts(recvbufsize);
+		transport->alltoallv(sendbuf, send_counts_, send_offsets_,
+				recv_counts_, recv_offsets_, type);
+	}
+
+private:
+	void exchange_counts(int recvbufsize)
 	{
 		recv_offsets_[0] = 0;
 		for(int r = 0; r < comm_size_; ++r) {
@@ -2166,11 +2336,8 @@ public:
 			fprintf(IMD_OUT, "Error: recv_counts_[comm_size_] > recvbufsize");
 			throw "Error: buffer size not enough";
 		}
-		MPI_Alltoallv(sendbuf, send_counts_, send_offsets_, type,
-				recvbuf, recv_counts_, recv_offsets_, type, comm_);
 	}
 
-private:
 	MPI_Comm comm_;
 	int comm_size_;
 	int buffer_width_;
@@ -3265,7 +3432,7 @@ public:
 		printTimeResult();
 		printCountResult();
 	}
-private:
+
 	struct TimeElement {
 		double span;
 		const char* content;
@@ -3283,6 +3450,11 @@ private:
 			: count(count__), content(content__), number(number__) { }
 	};
 
+	// The elements are in the order of the submission.
+	const std::vector<TimeElement>& getTimes() const { return times_; }
+	const std::vector<CountElement>& getCounters() const { return counters_; }
+
+private:
 	void printTimeResult() {
 		int num_times = times_.size();
 		double *dbl_times = new double[num_times];
@@ -3374,6 +3546,9 @@ public:
 	void submit(const char* content, int number) {
 		int64_t end = get_time_in_microsecond();
 		g_pis.submit(end - start_, content, number);
+#if TIMELINE_TRACE
+		timeline::record_span(content, (double)(end - start_) / 1000000.0, timeline::PROFILE);
+#endif
 		start_ = end;
 	}
 	int64_t getSpanAndReset() {
@@ -21,6 +21,9 @@
 
 #include <algorithm>
 
+#include "sssp.hpp"
+#include "radix_sort.hpp"
+
 /* One-sided emulation since many MPI implementations don't have good
  * performance and/or fail when using many one-sided operations between fences.
  * Only the necessary operations are implemented, and only MPI_MODE_NOPRECEDE
@@ -109,7 +112,8 @@ void add_gather_request(gather* g, size_t local_idx, int remote_rank, size_t rem
   g->remote_indices[req_id] = (MPI_Aint)remote_idx;
 }
 
-/* Adapted from histogram_sort_inplace in boost/graph/detail/histogram_sort.hpp
+/* Counting sort by the destination rank (keys) with the bucket offsets (rowstart).
+ * The elements are scattered out of place with radix_sort::scatter_positions.
  * */
 void histogram_sort_size_tMPI_Aint
        (int* restrict keys,
@@ -117,30 +121,17 @@ void histogram_sort_size_tMPI_Aint
         int numkeys,
         size_t* restrict values1,
         MPI_Aint* restrict values2) {
-  int* restrict insert_positions = (int*)cache_aligned_xmalloc(numkeys * sizeof(int));
-  memcpy(insert_positions, rowstart, numkeys * sizeof(int));
+  const int n = rowstart[numkeys];
+  int* restrict positions = (int*)cache_aligned_xmalloc(std::max(1, n) * sizeof(int));
+  radix_sort::scatter_positions(keys, n, rowstart, numkeys, positions);
+  radix_sort::apply_positions(values1, n, positions);
+  radix_sort::apply_positions(values2, n, positions);
   int i;
-  for (i = 0; i < rowstart[numkeys]; ++i) {
-    int key = keys[i];
-    assert (key >= 0 && key < numkeys);
-    // print_with_prefix("i = %d, key = %d", i, key);
-    while (!(i >= rowstart[key] && i < insert_positions[key])) {
-      int target_pos = insert_positions[key]++;
-      // print_with_prefix("target_pos = %d from limit %d", target_pos, rowstart[key + 1]);
-      if (target_pos == i) continue;
-      assert (target_pos < rowstart[key + 1]);
-      // print_with_prefix("swapping [%d] = (%d, %d, %d) with [%d] = (%d, %d, %d)", i, keys[i], (int)values1[i], (int)values2[i], target_pos, keys[target_pos], (int)values1[target_pos], (int)values2[target_pos]);
-      {int t = keys[i]; key = keys[target_pos]; keys[i] = key; keys[target_pos] = t;}
-      {size_t t = values1[i]; values1[i] = values1[target_pos]; values1[target_pos] = t;}
-      {MPI_Aint t = values2[i]; values2[i] = values2[target_pos]; values2[target_pos] = t;}
-      assert (key >= 0 && key < numkeys);
-    }
-    // print_with_prefix("done");
+  for (i = 0; i < numkeys; ++i) {
+    int j;
+    for (j = rowstart[i]; j < rowstart[i + 1]; ++j) keys[j] = i;
   }
-  for (i = 1; i < rowstart[numkeys]; ++i) {
-    assert (keys[i] >= keys[i - 1]);
-  }
-  free(insert_positions);
+  free(positions);
 }
 
 void end_gather(gather* g) {
@@ -267,32 +258,24 @@ void add_scatter_constant_request(scatter_constant* sc, int remote_rank, size_t
   sc->remote_indices[req_id] = (MPI_Aint)remote_idx;
 }
 
-/* Adapted from histogram_sort_inplace in boost/graph/detail/histogram_sort.hpp
+/* Counting sort by the destination rank (keys) with the bucket offsets (rowstart).
+ * The elements are scattered out of place with radix_sort::scatter_positions.
  * */
 void histogram_sort_MPI_Aint
        (int* restrict keys,
         const int* restrict rowstart,
         int numkeys,
         MPI_Aint* restrict values1) {
-  int* restrict insert_positions = (int*)cache_aligned_xmalloc(numkeys * sizeof(int));
-  memcpy(insert_positions, rowstart, numkeys * sizeof(int));
+  const int n = rowstart[numkeys];
+  int* restrict positions = (int*)cache_aligned_xmalloc(std::max(1, n) * sizeof(int));
+  radix_sort::scatter_positions(keys, n, rowstart, numkeys, positions);
+  radix_sort::apply_positions(values1, n, positions);
   int i;
-  for (i = 0; i < rowstart[numkeys]; ++i) {
-    int key = keys[i];
-    assert (key >= 0 && key < numkeys);
-    while (!(i >= rowstart[key] && i < insert_positions[key])) {
-      int target_pos = insert_positions[key]++;
-      if (target_pos == i) continue;
-      assert (target_pos < rowstart[key + 1]);
-      {int t = keys[i]; key = keys[target_pos]; keys[i] = key; keys[target_pos] = t;}
-      {MPI_Aint t = values1[i]; values1[i] = values1[target_pos]; values1[target_pos] = t;}
-      assert (key >= 0 && key < numkeys);
-    }
+  for (i = 0; i < numkeys; ++i) {
+    int j;
+    for (j = rowstart[i]; j < rowstart[i + 1]; ++j) keys[j] = i;
   }
-  for (i = 1; i < rowstart[numkeys]; ++i) {
-    assert (keys[i] >= keys[i - 1]);
-  }
-  free(insert_positions);
+  free(positions);
 }
 
 void end_scatter_constant(scatter_constant* sc) {
@@ -406,7 +389,8 @@ void add_scatter_request(scatter* sc, const char* local_data, int remote_rank, s
   sc->remote_indices[req_id] = (MPI_Aint)remote_idx;
 }
 
-/* Adapted from histogram_sort_inplace in boost/graph/detail/histogram_sort.hpp
+/* Counting sort by the destination rank (keys) with the bucket offsets (rowstart).
+ * The elements are scattered out of place with radix_sort::scatter_positions.
  * */
 void histogram_sort_MPI_Aintcharblock
        (int* restrict keys,
@@ -415,29 +399,17 @@ void histogram_sort_MPI_Aintcharblock
         MPI_Aint* restrict values1,
         char* restrict values2,
         size_t elt_size2) {
-  int* restrict insert_positions = (int*)cache_aligned_xmalloc(numkeys * sizeof(int));
-  memcpy(insert_positions, rowstart, numkeys * sizeof(int));
+  const int n = rowstart[numkeys];
+  int* restrict positions = (int*)cache_aligned_xmalloc(std::max(1, n) * sizeof(int));
+  radix_sort::scatter_positions(keys, n, rowstart, numkeys, positions);
+  radix_sort::apply_positions(values1, n, positions);
+  radix_sort::apply_positions(values2, n, positions, elt_size2);
   int i;
-  for (i = 0; i < rowstart[numkeys]; ++i) {
-    int key = keys[i];
-    assert (key >= 0 && key < numkeys);
-    print_with_prefix("i = %d, key = %d", i, key);
-    while (!(i >= rowstart[key] && i < insert_positions[key])) {
-      int target_pos = insert_positions[key]++;
-      print_with_prefix("target_pos = %d from limit %d", target_pos, rowstart[key + 1]);
-      if (target_pos == i) continue;
-      assert (target_pos < rowstart[key + 1]);
-      {int t = keys[i]; key = keys[target_pos]; keys[i] = key; keys[target_pos] = t;}
-      {MPI_Aint t = values1[i]; values1[i] = values1[target_pos]; values1[target_pos] = t;}
-      {char t[elt_size2]; memcpy(t, values2 + i * elt_size2, elt_size2); memcpy(values2 + i * elt_size2, values2 + target_pos * elt_size2, elt_size2); memcpy(values2 + target_pos * elt_size2, t, elt_size2);}
-      assert (key >= 0 && key < numkeys);
-    }
-    print_with_prefix("done");
+  for (i = 0; i < numkeys; ++i) {
+    int j;
+    for (j = rowstart[i]; j < rowstart[i + 1]; ++j) keys[j] = i;
   }
-  for (i = 1; i < rowstart[numkeys]; ++i) {
-    assert (keys[i] >= keys[i - 1]);
-  }
-  free(insert_positions);
+  free(positions);
 }
 
 void end_scatter(scatter* sc) {
@@ -1019,4 +991,246 @@ int validate_bfs_result(
 }
 
 
+/* Validates the result of the SSSP (BfsBase::run_sssp) with the weights of sssp_edge_weight():
+ * - the root is its own parent and its distance is 0
+ * - the vertices with predecessors are the vertices with distances
+ * - every edge connects two reached vertices or two unreached vertices and
+ *   the distances of the end points differ by at most the weight of the edge
+ * - for every reached vertex except the root, there is an edge from its predecessor with
+ *   dist[v] == dist[pred] + weight and dist[pred] < dist[v] (so the predecessors form a tree)
+ * The distances are compared with a small relative tolerance since the code is compiled with -ffast-math.
+ * */
+class SsspValidation {
+	enum { MAX_OUTPUT = 10 };
+public:
+	SsspValidation(int64_t nglobalverts__, int64_t nlocalverts__, int64_t chunksize)
+		: nglobalverts(nglobalverts__)
+		, nlocalverts(nlocalverts__)
+		, chunksize_(chunksize)
+	{ }
+
+	template <typename EdgeList>
+	bool validate(EdgeList* edge_list, const int64_t root, const int64_t* const pred,
+			const float* const dist, int64_t* const edge_visit_count_ptr)
+	{
+		*edge_visit_count_ptr = 0;
+		int64_t error_counts = 0;
+		const int root_owner = vertex_owner(root);
+		const int64_t root_local = vertex_local(root);
+		const bool root_is_mine = (root_owner == mpi.rank_2d);
+
+		if(root_is_mine && (pred[root_local] != root || dist[root_local] != 0)) {
+			print_with_prefix("Validation error: parent of root vertex %" PRId64 " is %" PRId64 " and its distance is %f.",
+					root, pred[root_local], dist[root_local]);
+			++error_counts;
+		}
+#pragma omp parallel for
+		for(int64_t i = 0; i < nlocalverts; ++i) {
+			const int64_t v = i * mpi.size_2d + mpi.rank_2d;
+			const int64_t p = pred[i];
+			if(p < -1 || p >= nglobalverts || (p == v && v != root) || (p == -1) != (dist[i] < 0)) {
+				if(__sync_fetch_and_add(&error_counts, 1) < MAX_OUTPUT)
+					print_with_prefix("Validation error: vertex %" PRId64 " has invalid parent %" PRId64 " or distance %f.", v, p, dist[i]);
+			}
+		}
+		MPI_Allreduce(MPI_IN_PLACE, &error_counts, 1, MpiTypeOf<int64_t>::type, MPI_SUM, mpi.comm_2d);
+		if(error_counts) return false;
+
+		ScatterContext scatter_r(mpi.comm_2dr);
+		ScatterContext scatter_c(mpi.comm_2dc);
+		unsigned char* restrict pred_valid = (unsigned char*)cache_aligned_xmalloc(nlocalverts * sizeof(unsigned char));
+		memset(pred_valid, 0, nlocalverts * sizeof(unsigned char));
+		int64_t edge_visit_count = 0;
+
+		typedef typename EdgeList::edge_type EdgeType;
+		int num_loops = edge_list->beginRead(false);
+		for(int loop_count = 0; loop_count < num_loops && error_counts == 0; ++loop_count) {
+			EdgeType* edge_data;
+			const int bufsize = edge_list->read(&edge_data);
+			int* restrict local_indices_r = (int*)cache_aligned_xmalloc(bufsize * sizeof(int));
+			int* restrict local_indices_c = (int*)cache_aligned_xmalloc(bufsize * sizeof(int));
+			int64_t* restrict remote_indices_r = (int64_t*)cache_aligned_xmalloc(bufsize * sizeof(int64_t));
+			int64_t* restrict remote_indices_c = (int64_t*)cache_aligned_xmalloc(bufsize * sizeof(int64_t));
+
+			// v0 is owned by the processor row and v1 is owned by the processor column
+#pragma omp parallel
+			{
+				int* count_r = scatter_r.get_counts();
+				int* count_c = scatter_c.get_counts();
+#pragma omp for schedule(static)
+				for(int i = 0; i < bufsize; ++i) {
+					(count_r[vertex_owner_c(edge_data[i].v0())])++;
+					(count_c[vertex_owner_r(edge_data[i].v1())])++;
+				}
+#pragma omp master
+				{
+					scatter_r.sum();
+					scatter_c.sum();
+				}
+#pragma omp barrier
+				int* offsets_r = scatter_r.get_offsets();
+				int* offsets_c = scatter_c.get_offsets();
+#pragma omp for schedule(static)
+				for(int i = 0; i < bufsize; ++i) {
+					int64_t v0 = edge_data[i].v0();
+					int64_t v1 = edge_data[i].v1();
+					int v0_pos = offsets_r[vertex_owner_c(v0)]++;
+					local_indices_r[i] = v0_pos;
+					remote_indices_r[v0_pos] = vertex_local(v0);
+					int v1_pos = offsets_c[vertex_owner_r(v1)]++;
+					local_indices_c[i] = v1_pos;
+					remote_indices_c[v1_pos] = vertex_local(v1);
+				}
+			}
+			int64_t* restrict edge_preds = (int64_t*)cache_aligned_xmalloc(2 * bufsize * sizeof(int64_t));
+			float* restrict edge_dists = (float*)cache_aligned_xmalloc(2 * bufsize * sizeof(float));
+			gather_values(scatter_r, remote_indices_r, local_indices_r, bufsize, pred, dist, edge_preds, edge_dists);
+			gather_values(scatter_c, remote_indices_c, local_indices_c, bufsize, pred, dist, edge_preds + bufsize, edge_dists + bufsize);
+			free(remote_indices_r); remote_indices_r = NULL;
+			free(remote_indices_c); remote_indices_c = NULL;
+			free(local_indices_r); local_indices_r = NULL;
+			free(local_indices_c); local_indices_c = NULL;
+
+			int64_t* restrict valid_indices_r = (int64_t*)cache_aligned_xmalloc(bufsize * sizeof(int64_t));
+			int64_t* restrict valid_indices_c = (int64_t*)cache_aligned_xmalloc(bufsize * sizeof(int64_t));
+#pragma omp parallel
+			{
+				int* count_r = scatter_r.get_counts();
+				int* count_c = scatter_c.get_counts();
+#pragma omp for schedule(static) reduction(+:edge_visit_count)
+				for(int i = 0; i < bufsize; ++i) {
+					const int64_t v0 = edge_data[i].v0();
+					const int64_t v1 = edge_data[i].v1();
+					const float d0 = edge_dists[i], d1 = edge_dists[bufsize + i];
+					const float w = sssp_edge_weight(v0, v1);
+					if((d0 < 0) != (d1 < 0)) {
+						if(__sync_fetch_and_add(&error_counts, 1) < MAX_OUTPUT)
+							print_with_prefix("Validation error: edge connects vertex %" PRId64 " (distance %f) and vertex %" PRId64 " (distance %f) outside the tree.", v0, d0, v1, d1);
+					}
+					else if(d0 >= 0) {
+						if(fabsf(d0 - d1) > w + tolerance(std::max(d0, d1))) {
+							if(__sync_fetch_and_add(&error_counts, 1) < MAX_OUTPUT)
+								print_with_prefix("Validation error: distances of edge endpoints %" PRId64 " (%f) and %" PRId64 " (%f) differ by more than the weight %f.", v0, d0, v1, d1, w);
+						}
+						++edge_visit_count;
+					}
+					if(edge_preds[i] == v1 && is_tree_edge(d1, d0, w)) (count_r[vertex_owner_c(v0)])++;
+					if(edge_preds[bufsize + i] == v0 && is_tree_edge(d0, d1, w)) (count_c[vertex_owner_r(v1)])++;
+				}
+#pragma omp master
+				{
+					scatter_r.sum();
+					scatter_c.sum();
+				}
+#pragma omp barrier
+				int* offsets_r = scatter_r.get_offsets();
+				int* offsets_c = scatter_c.get_offsets();
+#pragma omp for schedule(static)
+				for(int i = 0; i < bufsize; ++i) {
+					const int64_t v0 = edge_data[i].v0();
+					const int64_t v1 = edge_data[i].v1();
+					const float d0 = edge_dists[i], d1 = edge_dists[bufsize + i];
+					const float w = sssp_edge_weight(v0, v1);
+					if(edge_preds[i] == v1 && is_tree_edge(d1, d0, w))
+						valid_indices_r[offsets_r[vertex_owner_c(v0)]++] = vertex_local(v0);
+					if(edge_preds[bufsize + i] == v0 && is_tree_edge(d0, d1, w))
+						valid_indices_c[offsets_c[vertex_owner_r(v1)]++] = vertex_local(v1);
+				}
+			}
+			free(edge_preds); edge_preds = NULL;
+			free(edge_dists); edge_dists = NULL;
+			mark_valid(scatter_r, valid_indices_r, pred_valid);
+			mark_valid(scatter_c, valid_indices_c, pred_valid);
+			free(valid_indices_r);
+			free(valid_indices_c);
+		}
+		edge_list->endRead();
+
+#pragma omp parallel for
+		for(int64_t i = 0; i < nlocalverts; ++i) {
+			if(pred[i] == -1 || pred_valid[i] || (root_is_mine && i == root_local)) continue;
+			if(__sync_fetch_and_add(&error_counts, 1) < MAX_OUTPUT)
+				print_with_prefix("Validation error: no tree edge from vertex %" PRId64 " (distance %f) to its parent %" PRId64 ".",
+						i * mpi.size_2d + mpi.rank_2d, dist[i], pred[i]);
+		}
+		free(pred_valid);
+
+		MPI_Allreduce(MPI_IN_PLACE, &edge_visit_count, 1, MPI_INT64_T, MPI_SUM, mpi.comm_2d);
+		*edge_visit_count_ptr = edge_visit_count;
+		MPI_Allreduce(MPI_IN_PLACE, &error_counts, 1, MpiTypeOf<int64_t>::type, MPI_SUM, mpi.comm_2d);
+		return error_counts == 0;
+	}
+
+private:
+	const int64_t nglobalverts;
+	const int64_t nlocalverts;
+	const int64_t chunksize_;
+
+	static float tolerance(float d) {
+		return 1.0e-6f * std::max(1.0f, d);
+	}
+
+	// the edge (parent, v) is in the shortest path tree
+	static bool is_tree_edge(float parent_dist, float dist, float w) {
+		return parent_dist >= 0 && parent_dist < dist &&
+				fabsf(parent_dist + w - dist) <= tolerance(dist);
+	}
+
+	// gets the predecessors and the distances of the requested local vertices
+	void gather_values(ScatterContext& scatter, int64_t* remote_indices, const int* local_indices, int bufsize,
+			const int64_t* pred, const float* dist, int64_t* edge_preds, float* edge_dists)
+	{
+		int64_t* restrict reply_indices = scatter.scatter(remote_indices);
+		const int recv_count = scatter.get_recv_count();
+		int64_t* restrict reply_preds = (int64_t*)cache_aligned_xmalloc(recv_count * sizeof(int64_t));
+		float* restrict reply_dists = (float*)cache_aligned_xmalloc(recv_count * sizeof(float));
+#pragma omp parallel for
+		for(int i = 0; i < recv_count; ++i) {
+			reply_preds[i] = pred[reply_indices[i]];
+			reply_dists[i] = dist[reply_indices[i]];
+		}
+		scatter.free(reply_indices);
+		int64_t* restrict recv_preds = scatter.gather(reply_preds);
+		float* restrict recv_dists = scatter.gather(reply_dists);
+		free(reply_preds);
+		free(reply_dists);
+#pragma omp parallel for
+		for(int i = 0; i < bufsize; ++i) {
+			edge_preds[i] = recv_preds[local_indices[i]];
+			edge_dists[i] = recv_dists[local_indices[i]];
+		}
+		scatter.free(recv_preds);
+		scatter.free(recv_dists);
+	}
+
+	void mark_valid(ScatterContext& scatter, int64_t* valid_indices, unsigned char* pred_valid)
+	{
+		int64_t* restrict recv_indices = scatter.scatter(valid_indices);
+		const int recv_count = scatter.get_recv_count();
+#pragma omp parallel for
+		for(int i = 0; i < recv_count; ++i) {
+			pred_valid[recv_indices[i]] = 1;
+		}
+		scatter.free(recv_indices);
+	}
+}; // class SsspValidation
+
+// The weights are not the weights of the generator (WeightedEdge) but sssp_edge_weight(),
+// since the graph construction does not carry weights. The result is valid for these weights
+// and is not comparable with the Graph500 SSSP kernel.
+template <typename EdgeList>
+int validate_sssp_result(
+	EdgeList* edge_list,
+	const int64_t nglobalverts,
+	const int64_t nlocalverts,
+	const int64_t root,
+	const int64_t* const pred,
+	const float* const dist,
+	int64_t* const edge_visit_count_ptr)
+{
+	SsspValidation validation(nglobalverts, nlocalverts, EdgeList::CHUNK_SIZE);
+	return validation.validate(edge_list, root, pred, dist, edge_visit_count_ptr);
+}
+
+
 #endif /* VALIDATE_HPP_ */
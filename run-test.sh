@@ -4,3 +4,5 @@
 #mpirun -v -n 1 -outfile-pattern l-P1T4S18 -genv OMP_NUM_THREADS 4 ./mpi/runnable 18
 mpirun -v -n 1 -outfile-pattern l-P1T12S18 -genv OMP_NUM_THREADS 12 ./mpi/runnable 22
 #mpirun -v -n 1 -outfile-pattern l-P1T24S18 -genv OMP_NUM_THREADS 24 ./mpi/runnable 18
+# Adaptive direction switch with multiple processes (every BFS result is validated, build with make ADAPTIVE_DIRECTION_SWITCH=1 cpu)
+#mpirun -v -n 4 -outfile-pattern l-P4T2S13-AS -genv OMP_NUM_THREADS 2 -genv ADAPTIVE_SWITCH 1 ./mpi/runnable 13